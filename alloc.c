@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "stats.h"
+
+static void *system_alloc(void *ctx, size_t size)
+{
+    (void)ctx;
+
+    return malloc(size);
+}
+
+static void *system_realloc(void *ctx, void *ptr, size_t size)
+{
+    (void)ctx;
+
+    return realloc(ptr, size);
+}
+
+static void system_free(void *ctx, void *ptr)
+{
+    (void)ctx;
+
+    free(ptr);
+}
+
+static const struct json_allocator system_allocator = { system_alloc, system_realloc, system_free, NULL };
+static const struct json_allocator *global_allocator = &system_allocator;
+
+void json_set_allocator(const struct json_allocator *allocator)
+{
+    global_allocator = allocator == NULL ? &system_allocator : allocator;
+}
+
+const struct json_allocator *json_get_allocator()
+{
+    return global_allocator;
+}
+
+void *json_malloc(size_t size)
+{
+    JSON_STAT_ADD(allocs, 1);
+    JSON_STAT_ADD(alloc_bytes, size);
+
+    return global_allocator->alloc(global_allocator->ctx, size);
+}
+
+void *json_calloc(size_t count, size_t size)
+{
+    if(size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *ptr = json_malloc(count * size);
+    if(ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void *json_realloc(void *ptr, size_t size)
+{
+    JSON_STAT_ADD(allocs, 1);
+    JSON_STAT_ADD(alloc_bytes, size);
+
+    return global_allocator->realloc(global_allocator->ctx, ptr, size);
+}
+
+void json_free(void *ptr)
+{
+    if(ptr != NULL) {
+        global_allocator->free(global_allocator->ctx, ptr);
+    }
+}
+
+char *json_strndup(const char *str, size_t len)
+{
+    char *dst = (char *)json_malloc(len + 1);
+    if(dst == NULL) {
+        return NULL;
+    }
+
+    memcpy(dst, str, len);
+    dst[len] = '\0';
+
+    return dst;
+}
+
+void *json_allocator_alloc(const struct json_allocator *allocator, size_t size)
+{
+    if(allocator == NULL) {
+        return json_malloc(size);
+    }
+
+    JSON_STAT_ADD(allocs, 1);
+    JSON_STAT_ADD(alloc_bytes, size);
+
+    return allocator->alloc(allocator->ctx, size);
+}
+
+void *json_allocator_realloc(const struct json_allocator *allocator, void *ptr, size_t size)
+{
+    if(allocator == NULL) {
+        return json_realloc(ptr, size);
+    }
+
+    JSON_STAT_ADD(allocs, 1);
+    JSON_STAT_ADD(alloc_bytes, size);
+
+    return allocator->realloc(allocator->ctx, ptr, size);
+}
+
+void json_allocator_free(const struct json_allocator *allocator, void *ptr)
+{
+    if(allocator == NULL) {
+        json_free(ptr);
+    } else if(ptr != NULL) {
+        allocator->free(allocator->ctx, ptr);
+    }
+}
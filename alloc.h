@@ -0,0 +1,41 @@
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+#include <stddef.h>
+
+/*
+ * Where the library gets its memory. Everything goes through the global
+ * allocator, except that a document or arena created with an allocator of
+ * its own takes its blocks, and so every node and string in it, from that
+ * one; a document's parse stacks, stage-1 index and parallel ranges come
+ * from it as well, and so does a push parser feeding the document. Tapes
+ * and varstrs made with an allocator keep all their buffers there too.
+ * Memory is always given back to the allocator it came
+ * from, so set the global one before anything is allocated. Parallel parses
+ * and serializes call it from their workers, so it must be thread safe.
+ * Buffers the library hands out for the caller to free are released with
+ * json_free.
+ */
+typedef struct json_allocator {
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    void *ctx;
+}json_allocator;
+
+/* NULL goes back to malloc; the allocator must outlive everything it serves */
+void json_set_allocator(const struct json_allocator *allocator);
+const struct json_allocator *json_get_allocator();
+
+void *json_malloc(size_t size);
+void *json_calloc(size_t count, size_t size);
+void *json_realloc(void *ptr, size_t size);
+void json_free(void *ptr);
+char *json_strndup(const char *str, size_t len);
+
+/* the same through a given allocator, or the global one when it is NULL */
+void *json_allocator_alloc(const struct json_allocator *allocator, size_t size);
+void *json_allocator_realloc(const struct json_allocator *allocator, void *ptr, size_t size);
+void json_allocator_free(const struct json_allocator *allocator, void *ptr);
+
+#endif
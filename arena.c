@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN(size) (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+struct json_arena *create_json_arena(size_t block_size)
+{
+    return create_json_arena_allocator(block_size, NULL);
+}
+
+struct json_arena *create_json_arena_allocator(size_t block_size, const struct json_allocator *allocator)
+{
+    struct json_arena *arena = (struct json_arena *)json_allocator_alloc(allocator, sizeof(*arena));
+    if(arena == NULL) {
+        return NULL;
+    }
+
+    arena->blocks = NULL;
+    arena->spare = NULL;
+    arena->block_size = block_size == 0 ? JSON_ARENA_BLOCK_SIZE : block_size;
+    arena->allocator = allocator;
+
+    return arena;
+}
+
+static struct json_arena_block *json_arena_grow(struct json_arena *arena, size_t size)
+{
+    /* spares are sorted largest first, so a recycled arena fills its big blocks first */
+    struct json_arena_block **spare = &arena->spare;
+    while(*spare != NULL && (*spare)->cap < size) {
+        spare = &(*spare)->next;
+    }
+    if(*spare != NULL) {
+        struct json_arena_block *block = *spare;
+        *spare = block->next;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+        return block;
+    }
+
+    size_t cap = arena->block_size;
+    while(cap < size) {
+        cap *= 2;
+    }
+
+    struct json_arena_block *block = (struct json_arena_block *)json_allocator_alloc(arena->allocator, sizeof(*block) + cap);
+    if(block == NULL) {
+        return NULL;
+    }
+
+    block->cap = cap;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+
+    /* every new block doubles, so a parse touches only a handful of them */
+    if(arena->block_size < JSON_ARENA_BLOCK_MAX) {
+        arena->block_size *= 2;
+    }
+
+    return block;
+}
+
+void *json_arena_alloc(struct json_arena *arena, size_t size)
+{
+    if(arena == NULL) {
+        return NULL;
+    }
+
+    size = ARENA_ALIGN(size);
+
+    struct json_arena_block *block = arena->blocks;
+    if(block == NULL || block->cap - block->used < size) {
+        block = json_arena_grow(arena, size);
+        if(block == NULL) {
+            return NULL;
+        }
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+char *json_arena_strndup(struct json_arena *arena, const char *str, size_t len)
+{
+    char *dst = (char *)json_arena_alloc(arena, len + 1);
+    if(dst == NULL) {
+        return NULL;
+    }
+
+    memcpy(dst, str, len);
+    dst[len] = '\0';
+
+    return dst;
+}
+
+static void release_blocks(const struct json_allocator *allocator, struct json_arena_block *block)
+{
+    struct json_arena_block *next = NULL;
+    while(block != NULL) {
+        next = block->next;
+        json_allocator_free(allocator, block);
+        block = next;
+    }
+}
+
+/* hands src's blocks to dst, behind dst's current block, and frees src itself; both must share an allocator */
+int json_arena_merge(struct json_arena *dst, struct json_arena *src)
+{
+    if(dst == NULL || src == NULL || dst->allocator != src->allocator) {
+        return 0;
+    }
+
+    if(src->blocks != NULL) {
+        struct json_arena_block *tail = src->blocks;
+        while(tail->next != NULL) {
+            tail = tail->next;
+        }
+
+        if(dst->blocks == NULL) {
+            dst->blocks = src->blocks;
+        } else {
+            tail->next = dst->blocks->next;
+            dst->blocks->next = src->blocks;
+        }
+    }
+
+    release_blocks(src->allocator, src->spare);
+    json_allocator_free(src->allocator, src);
+
+    return 1;
+}
+
+int json_arena_reset(struct json_arena *arena)
+{
+    if(arena == NULL) {
+        return 0;
+    }
+
+    /* an arena holds a handful of blocks, so sorting them in one by one is cheap */
+    struct json_arena_block *block = arena->blocks, *next = NULL, **spare = NULL;
+    while(block != NULL) {
+        next = block->next;
+        block->used = 0;
+        spare = &arena->spare;
+        while(*spare != NULL && (*spare)->cap >= block->cap) {
+            spare = &(*spare)->next;
+        }
+        block->next = *spare;
+        *spare = block;
+        block = next;
+    }
+    arena->blocks = NULL;
+
+    return 1;
+}
+
+int release_json_arena(struct json_arena *arena)
+{
+    if(arena == NULL) {
+        return 0;
+    }
+
+    release_blocks(arena->allocator, arena->blocks);
+    release_blocks(arena->allocator, arena->spare);
+    json_allocator_free(arena->allocator, arena);
+
+    return 1;
+}
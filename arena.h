@@ -0,0 +1,35 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+#include "alloc.h"
+
+#define JSON_ARENA_BLOCK_SIZE (64 * 1024)
+#define JSON_ARENA_BLOCK_MAX (8 * 1024 * 1024)
+
+typedef struct json_arena_block {
+    struct json_arena_block *next;
+    size_t cap;
+    size_t used;
+    char data[];
+}json_arena_block;
+
+typedef struct json_arena {
+    struct json_arena_block *blocks;
+    /* blocks json_arena_reset took back, largest first, handed out again before anything is malloc'd */
+    struct json_arena_block *spare;
+    size_t block_size;
+    /* where the blocks and the arena itself come from; NULL means the global allocator */
+    const struct json_allocator *allocator;
+}json_arena;
+
+struct json_arena *create_json_arena(size_t block_size);
+struct json_arena *create_json_arena_allocator(size_t block_size, const struct json_allocator *allocator);
+void *json_arena_alloc(struct json_arena *arena, size_t size);
+char *json_arena_strndup(struct json_arena *arena, const char *str, size_t len);
+int json_arena_merge(struct json_arena *dst, struct json_arena *src);
+/* invalidates everything allocated so far but keeps the blocks for what comes next */
+int json_arena_reset(struct json_arena *arena);
+int release_json_arena(struct json_arena *arena);
+
+#endif
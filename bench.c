@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "varstr.h"
+#include "json.h"
+#include "ndjson.h"
+#include "serialize.h"
+#include "binary.h"
+#include "snapshot.h"
+#include "tape.h"
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static struct varstr *make_ndjson(size_t target)
+{
+    struct varstr *src = create_varstr();
+    char line[512];
+    long k = 0;
+
+    reserve_varstr(src, target + sizeof(line));
+    while(src->len < target) {
+        int len = snprintf(line, sizeof(line),
+                           "{\"id\":%ld,\"user\":\"user-%ld\",\"score\":%ld.%02ld,\"active\":%s,"
+                           "\"tags\":[\"alpha\",\"beta\",\"gamma\"],\"geo\":{\"lat\":%ld.125,\"lon\":-%ld.5},"
+                           "\"note\":\"escaped \\\"quote\\\" and \\\\ backslash\"}\n",
+                           k, k * 7, k % 1000, k % 100, k % 3 ? "true" : "false", k % 90, k % 180);
+        append_varstr(src, line, len);
+        k++;
+    }
+
+    return src;
+}
+
+static void bench_ndjson(int max_threads)
+{
+    struct varstr *src = make_ndjson(64 * 1024 * 1024);
+    double base = 0;
+    int threads;
+
+    printf("ndjson: %.1f MB\n", src->len / 1e6);
+    for(threads = 1; threads <= max_threads; threads *= 2) {
+        double best = 1e9;
+        int round;
+        for(round = 0; round < 3; round++) {
+            double start = now();
+            struct json_ndjson_batch *batch = json_ndjson_parse(src->data, src->len, threads, JSON_PARSE_ZERO_COPY, 0);
+            double elapsed = now() - start;
+            if(batch == NULL || batch->failures != 0) {
+                fprintf(stderr, "ndjson parse failed\n");
+                exit(1);
+            }
+            release_json_ndjson_batch(batch);
+            if(elapsed < best) {
+                best = elapsed;
+            }
+        }
+        if(threads == 1) {
+            base = best;
+        }
+        printf("  %2d threads: %8.1f MB/s  speedup %.2fx\n", threads, src->len / best / 1e6, base / best);
+        if(threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    release_varstr(src);
+}
+
+/* the same records, as one array inside one object */
+static struct varstr *make_array_document(size_t target)
+{
+    struct varstr *src = make_ndjson(target);
+    size_t k;
+
+    for(k = 0; k < src->len; k++) {
+        if(src->data[k] == '\n') {
+            src->data[k] = ',';
+        }
+    }
+    struct varstr *doc_text = create_varstr();
+    reserve_varstr(doc_text, src->len + 32);
+    append_varstr_literal(doc_text, "{\"records\":[");
+    append_varstr(doc_text, src->data, src->len - 1);
+    append_varstr_literal(doc_text, "]}");
+    release_varstr(src);
+
+    return doc_text;
+}
+
+static void bench_parallel_array(int max_threads)
+{
+    struct varstr *doc_text = make_array_document(64 * 1024 * 1024);
+
+    printf("top-level array: %.1f MB\n", doc_text->len / 1e6);
+    double base = 0;
+    int threads;
+    for(threads = 0; threads <= max_threads; threads = threads ? threads * 2 : 1) {
+        double best = 1e9;
+        int round;
+        for(round = 0; round < 3; round++) {
+            struct json_document *doc = create_json_document(threads ? JSON_PARSE_PARALLEL | JSON_PARSE_ZERO_COPY : JSON_PARSE_ZERO_COPY);
+            doc->threads = threads;
+            double start = now();
+            if(json_document_deserialize(doc, doc_text) != JSON_SUCCEED) {
+                fprintf(stderr, "array parse failed\n");
+                exit(1);
+            }
+            double elapsed = now() - start;
+            release_json_document(doc);
+            if(elapsed < best) {
+                best = elapsed;
+            }
+        }
+        if(threads == 0) {
+            base = best;
+            printf("      serial: %8.1f MB/s\n", doc_text->len / best / 1e6);
+        } else {
+            printf("  %2d threads: %8.1f MB/s  speedup %.2fx\n", threads, doc_text->len / best / 1e6, base / best);
+        }
+        if(threads && threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+
+    /* and back out again */
+    struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+    json_document_deserialize(doc, doc_text);
+    printf("serialize:\n");
+    for(threads = 0; threads <= max_threads; threads = threads ? threads * 2 : 1) {
+        double best = 1e9;
+        size_t len = 0;
+        int round;
+        for(round = 0; round < 3; round++) {
+            struct varstr *out = create_varstr();
+            double start = now();
+            if(threads == 0) {
+                json_serialize(&doc->root, out);
+            } else {
+                json_serialize_parallel(&doc->root, out, threads);
+            }
+            double elapsed = now() - start;
+            len = out->len;
+            release_varstr(out);
+            if(elapsed < best) {
+                best = elapsed;
+            }
+        }
+        if(threads == 0) {
+            base = best;
+            printf("      serial: %8.1f MB/s\n", len / best / 1e6);
+        } else {
+            printf("  %2d threads: %8.1f MB/s  speedup %.2fx\n", threads, len / best / 1e6, base / best);
+        }
+        if(threads && threads < max_threads && threads * 2 > max_threads) {
+            threads = max_threads / 2;
+        }
+    }
+    release_json_document(doc);
+
+    release_varstr(doc_text);
+}
+
+static void bench_codec(const char *name, struct json_root *root, int (*encode)(struct json_root *, struct varstr *),
+                        int (*decode)(struct json_root *, struct varstr *, int))
+{
+    double encode_best = 1e9, decode_best = 1e9;
+    size_t len = 0;
+    int round;
+
+    for(round = 0; round < 3; round++) {
+        struct varstr *out = create_varstr();
+        double start = now();
+        encode(root, out);
+        double elapsed = now() - start;
+        if(elapsed < encode_best) {
+            encode_best = elapsed;
+        }
+
+        struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+        start = now();
+        int res = decode == NULL ? json_document_deserialize(doc, out) : decode(&doc->root, out, JSON_PARSE_ZERO_COPY);
+        elapsed = now() - start;
+        if(res != JSON_SUCCEED) {
+            fprintf(stderr, "%s decode failed\n", name);
+            exit(1);
+        }
+        if(elapsed < decode_best) {
+            decode_best = elapsed;
+        }
+        release_json_document(doc);
+        len = out->len;
+        release_varstr(out);
+    }
+
+    printf("  %-8s %6.1f MB  encode %7.1f ms  decode %7.1f ms\n", name, len / 1e6, encode_best * 1e3, decode_best * 1e3);
+}
+
+static void bench_binary()
+{
+    struct varstr *doc_text = make_array_document(64 * 1024 * 1024);
+    struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+    json_document_deserialize(doc, doc_text);
+
+    printf("wire formats:\n");
+    bench_codec("json", &doc->root, json_serialize, NULL);
+    bench_codec("msgpack", &doc->root, json_msgpack_encode, json_msgpack_decode);
+    bench_codec("cbor", &doc->root, json_cbor_encode, json_cbor_decode);
+
+    release_json_document(doc);
+    release_varstr(doc_text);
+}
+
+static void bench_snapshot()
+{
+    struct varstr *doc_text = make_array_document(64 * 1024 * 1024);
+    char path[] = "/tmp/cjson_bench_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0) {
+        return;
+    }
+    close(fd);
+
+    double start = now();
+    struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+    json_document_deserialize(doc, doc_text);
+    double parse = now() - start;
+    json_snapshot_save(&doc->root, path);
+    release_json_document(doc);
+
+    start = now();
+    struct json_snapshot *snap = json_snapshot_open(path);
+    double open_time = now() - start;
+    if(snap == NULL) {
+        fprintf(stderr, "snapshot open failed\n");
+        exit(1);
+    }
+
+    char query[64];
+    long hits = 0, k;
+    start = now();
+    for(k = 0; k < 100000; k++) {
+        snprintf(query, sizeof(query), "records>[%ld]>geo>lat", (k * 7919) % 300000);
+        hits += json_view_valid(json_snapshot_find(snap, query, 0));
+    }
+    double lookups = now() - start;
+
+    printf("snapshot: %.1f MB image\n", snap->len / 1e6);
+    printf("  parse text %7.1f ms  open image %7.3f ms  %.2f us/lookup (%ld hits)\n", parse * 1e3, open_time * 1e3, lookups / 1e5 * 1e6, hits);
+
+    json_snapshot_close(snap);
+    unlink(path);
+    release_varstr(doc_text);
+}
+
+static void bench_tape()
+{
+    struct varstr *doc_text = make_array_document(64 * 1024 * 1024);
+    double tree_parse = 1e9, tape_parse = 1e9, tree_write = 1e9, tape_write = 1e9;
+    size_t tree_bytes = 0, tape_bytes = 0;
+    int round;
+
+    for(round = 0; round < 3; round++) {
+        struct json_document *doc = create_json_document(0);
+        double start = now();
+        json_document_deserialize(doc, doc_text);
+        double elapsed = now() - start;
+        tree_parse = elapsed < tree_parse ? elapsed : tree_parse;
+
+        struct json_arena_block *block;
+        for(tree_bytes = 0, block = doc->root.arena->blocks; block != NULL; block = block->next) {
+            tree_bytes += block->used;
+        }
+
+        struct varstr *out = create_varstr();
+        start = now();
+        json_serialize(&doc->root, out);
+        elapsed = now() - start;
+        tree_write = elapsed < tree_write ? elapsed : tree_write;
+        release_varstr(out);
+        release_json_document(doc);
+
+        struct json_tape *tape = create_json_tape();
+        start = now();
+        json_tape_deserialize(tape, doc_text, 0);
+        elapsed = now() - start;
+        tape_parse = elapsed < tape_parse ? elapsed : tape_parse;
+        tape_bytes = tape->count * sizeof(struct json_tape_entry) + tape->strings->len;
+
+        out = create_varstr();
+        start = now();
+        json_tape_serialize(tape, out);
+        elapsed = now() - start;
+        tape_write = elapsed < tape_write ? elapsed : tape_write;
+        release_varstr(out);
+        release_json_tape(tape);
+    }
+
+    printf("tape vs tree (copying strings):\n");
+    printf("  tree  parse %7.1f ms  serialize %7.1f ms  %6.1f MB\n", tree_parse * 1e3, tree_write * 1e3, tree_bytes / 1e6);
+    printf("  tape  parse %7.1f ms  serialize %7.1f ms  %6.1f MB\n", tape_parse * 1e3, tape_write * 1e3, tape_bytes / 1e6);
+
+    release_varstr(doc_text);
+}
+
+static void bench_keys()
+{
+    struct varstr *src = make_ndjson(64 * 1024 * 1024);
+    int modes[] = { 0, JSON_PARSE_INTERN_KEYS };
+    const char *labels[] = { "private", "interned" };
+    int m;
+
+    printf("ndjson member names, 1 thread:\n");
+    for(m = 0; m < 2; m++) {
+        double parse = 1e9, find = 1e9;
+        size_t bytes = 0, hits = 0, k;
+        int round;
+        for(round = 0; round < 3; round++) {
+            double start = now();
+            struct json_ndjson_batch *batch = json_ndjson_parse(src->data, src->len, 1, modes[m], 0);
+            double elapsed = now() - start;
+            parse = elapsed < parse ? elapsed : parse;
+
+            struct json_arena_block *block;
+            for(bytes = 0, block = batch->arenas[0]->blocks; block != NULL; block = block->next) {
+                bytes += block->used;
+            }
+
+            start = now();
+            for(k = 0; k < batch->count; k++) {
+                hits += json_find_value_flags(batch->roots[k], "note", JSON_FIND_CASE_SENSITIVE) != NULL;
+                hits += json_find_value_flags(batch->roots[k], "missing", JSON_FIND_CASE_SENSITIVE) != NULL;
+            }
+            elapsed = now() - start;
+            find = elapsed < find ? elapsed : find;
+            release_json_ndjson_batch(batch);
+        }
+        printf("  %-9s parse %7.1f ms  %6.1f MB  two finds per record %6.1f ms (%zu hits)\n",
+               labels[m], parse * 1e3, bytes / 1e6, find * 1e3, hits);
+    }
+
+    release_varstr(src);
+}
+
+static void bench_reset()
+{
+    struct varstr *doc_text = make_array_document(1024 * 1024);
+    double fresh = 1e9, reused = 1e9;
+    int round, k;
+
+    for(round = 0; round < 3; round++) {
+        double start = now();
+        for(k = 0; k < 50; k++) {
+            struct json_document *doc = create_json_document(0);
+            json_document_deserialize(doc, doc_text);
+            release_json_document(doc);
+        }
+        double elapsed = (now() - start) / 50;
+        fresh = elapsed < fresh ? elapsed : fresh;
+
+        struct json_document *doc = create_json_document(0);
+        start = now();
+        for(k = 0; k < 50; k++) {
+            json_document_reset(doc);
+            json_document_deserialize(doc, doc_text);
+        }
+        elapsed = (now() - start) / 50;
+        reused = elapsed < reused ? elapsed : reused;
+        release_json_document(doc);
+    }
+
+    printf("repeated %.1f MB parses:\n", doc_text->len / 1e6);
+    printf("  fresh document %7.2f ms  reset document %7.2f ms\n", fresh * 1e3, reused * 1e3);
+
+    release_varstr(doc_text);
+}
+
+static void bench_array_access()
+{
+    struct varstr *doc_text = make_array_document(64 * 1024 * 1024);
+    struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+    json_document_deserialize(doc, doc_text);
+    struct json_value *records = json_find_value(&doc->root, "records");
+    size_t count = json_value_count(records), k, hits = 0;
+    unsigned long long seed = 88172645463325252ULL;
+
+    double start = now();
+    for(k = 0; k < 1000000; k++) {
+        seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+        hits += json_value_child_at(records, seed % count) != NULL;
+    }
+    double indexed = now() - start;
+
+    /* what the linked list alone costs for the same kind of access */
+    start = now();
+    for(k = 0; k < 100; k++) {
+        seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+        struct json_value *child = records->value.children;
+        size_t n = seed % count;
+        while(n-- > 0) {
+            child = child->next;
+        }
+        hits += child != NULL;
+    }
+    double walked = now() - start;
+
+    printf("array access over %zu elements (%zu hits):\n", count, hits);
+    printf("  by position %8.1f ns  by walking %10.1f ns\n", indexed / 1e6 * 1e9, walked / 100 * 1e9);
+
+    release_json_document(doc);
+    release_varstr(doc_text);
+}
+
+static void bench_depth()
+{
+    struct varstr *doc_text = make_array_document(16 * 1024 * 1024);
+    struct varstr *deep = create_varstr();
+    int flags[] = { 0, JSON_PARSE_STRUCTURAL };
+    int f, k;
+
+    append_varstr_literal(deep, "{\"a\":");
+    for(k = 0; k < 100000; k++) {
+        append_varstr_char(deep, '[');
+    }
+    for(k = 0; k < 100000; k++) {
+        append_varstr_char(deep, ']');
+    }
+    append_varstr_char(deep, '}');
+
+    printf("nesting limit, %.1f MB document and 100000 levels of '[':\n", doc_text->len / 1e6);
+    for(f = 0; f < 2; f++) {
+        struct json_document *doc = create_json_document(flags[f]);
+        double parse = 1e9, refuse = 1e9;
+        for(k = 0; k < 5; k++) {
+            json_document_reset(doc);
+            double start = now();
+            json_document_deserialize(doc, doc_text);
+            double elapsed = now() - start;
+            parse = elapsed < parse ? elapsed : parse;
+
+            json_document_reset(doc);
+            start = now();
+            json_document_deserialize(doc, deep);
+            elapsed = now() - start;
+            refuse = elapsed < refuse ? elapsed : refuse;
+        }
+        printf("  %-10s parse %7.2f ms  refuse %7.3f ms\n", flags[f] ? "structural" : "builder", parse * 1e3, refuse * 1e3);
+        release_json_document(doc);
+    }
+
+    release_varstr(deep);
+    release_varstr(doc_text);
+}
+
+int main(int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)(cpus > 0 ? cpus : 1);
+
+    bench_ndjson(max_threads);
+    bench_parallel_array(max_threads);
+    bench_binary();
+    bench_snapshot();
+    bench_tape();
+    bench_array_access();
+    bench_keys();
+    bench_reset();
+    bench_depth();
+
+    return 0;
+}
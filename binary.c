@@ -0,0 +1,899 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "binary.h"
+#include "json_internal.h"
+#include "index.h"
+#include "keys.h"
+#include "scan.h"
+
+#define BINARY_MSGPACK 0
+#define BINARY_CBOR 1
+
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_SIMPLE 7
+
+/* an open container being written: its kind and the child to write next */
+struct encode_frame {
+    struct json_value *next;
+    JSON_TYPE type;
+};
+
+struct binary_encoder {
+    int format;
+    struct varstr *out;
+    /* unescaped copy of the string being written, for strings with escapes */
+    char *scratch;
+    size_t scratch_cap;
+    /* the containers open around the value being written, innermost last */
+    struct encode_frame *frames;
+    size_t depth;
+    size_t cap;
+    struct encode_frame inline_frames[JSON_WALK_INLINE_DEPTH];
+};
+
+/* an open container being read: the items it still owes, where the next links in, and its node (NULL for the root) */
+struct decode_frame {
+    JSON_TYPE type;
+    size_t left;
+    struct json_value **tail;
+    struct json_value *node;
+};
+
+struct binary_decoder {
+    int format;
+    struct json_parser *parser;
+    unsigned char *data;
+    size_t len;
+    size_t pos;
+    /* the containers open around the item being read, innermost last */
+    struct decode_frame *frames;
+    size_t depth;
+    size_t cap;
+    struct decode_frame inline_frames[JSON_WALK_INLINE_DEPTH];
+};
+
+static int put_be(struct varstr *out, unsigned char tag, uint64_t n, int bytes)
+{
+    if(reserve_varstr(out, 9) == 0) {
+        return JSON_FAILURE;
+    }
+
+    unsigned char *p = (unsigned char *)out->data + out->len;
+    int i;
+    p[0] = tag;
+    for(i = bytes; i > 0; i--) {
+        p[i] = (unsigned char)n;
+        n >>= 8;
+    }
+    out->len += bytes + 1;
+    out->data[out->len] = '\0';
+
+    return JSON_SUCCEED;
+}
+
+/* CBOR's head: major type and argument in the fewest bytes */
+static int put_cbor_head(struct varstr *out, int major, uint64_t n)
+{
+    unsigned char tag = (unsigned char)(major << 5);
+    if(n < 24) {
+        return put_be(out, tag | (unsigned char)n, 0, 0);
+    }
+    if(n <= 0xff) {
+        return put_be(out, tag | 24, n, 1);
+    }
+    if(n <= 0xffff) {
+        return put_be(out, tag | 25, n, 2);
+    }
+    if(n <= 0xffffffff) {
+        return put_be(out, tag | 26, n, 4);
+    }
+
+    return put_be(out, tag | 27, n, 8);
+}
+
+/* fixed, 16- and 32-bit forms share a layout across msgpack's str, array and map */
+static int put_msgpack_head(struct varstr *out, unsigned char fix, size_t fix_max, unsigned char tag8, unsigned char tag16, size_t n)
+{
+    if(n < fix_max) {
+        return put_be(out, fix | (unsigned char)n, 0, 0);
+    }
+    if(tag8 != 0 && n <= 0xff) {
+        return put_be(out, tag8, n, 1);
+    }
+    if(n <= 0xffff) {
+        return put_be(out, tag16, n, 2);
+    }
+    if((uint64_t)n > 0xffffffff) {
+        return JSON_FAILURE;
+    }
+
+    return put_be(out, tag16 + 1, n, 4);
+}
+
+static int put_integer(struct binary_encoder *enc, long long v)
+{
+    if(enc->format == BINARY_CBOR) {
+        if(v < 0) {
+            return put_cbor_head(enc->out, CBOR_NEGATIVE, ~(uint64_t)v);
+        }
+        return put_cbor_head(enc->out, CBOR_UNSIGNED, (uint64_t)v);
+    }
+
+    if(v >= 0) {
+        if(v < 128) {
+            return put_be(enc->out, (unsigned char)v, 0, 0);
+        }
+        if(v <= 0xff) {
+            return put_be(enc->out, 0xcc, v, 1);
+        }
+        if(v <= 0xffff) {
+            return put_be(enc->out, 0xcd, v, 2);
+        }
+        if(v <= 0xffffffffLL) {
+            return put_be(enc->out, 0xce, v, 4);
+        }
+        return put_be(enc->out, 0xcf, v, 8);
+    }
+
+    if(v >= -32) {
+        return put_be(enc->out, (unsigned char)v, 0, 0);
+    }
+    if(v >= INT8_MIN) {
+        return put_be(enc->out, 0xd0, (uint64_t)v, 1);
+    }
+    if(v >= INT16_MIN) {
+        return put_be(enc->out, 0xd1, (uint64_t)v, 2);
+    }
+    if(v >= INT32_MIN) {
+        return put_be(enc->out, 0xd2, (uint64_t)v, 4);
+    }
+
+    return put_be(enc->out, 0xd3, (uint64_t)v, 8);
+}
+
+static int put_text_head(struct binary_encoder *enc, size_t len)
+{
+    if(enc->format == BINARY_CBOR) {
+        return put_cbor_head(enc->out, CBOR_TEXT, len);
+    }
+
+    return put_msgpack_head(enc->out, 0xa0, 32, 0xd9, 0xda, len);
+}
+
+static int put_container_head(struct binary_encoder *enc, JSON_TYPE type, size_t count)
+{
+    if(enc->format == BINARY_CBOR) {
+        return put_cbor_head(enc->out, type == ARRAY ? CBOR_ARRAY : CBOR_MAP, count);
+    }
+
+    if(type == ARRAY) {
+        return put_msgpack_head(enc->out, 0x90, 16, 0, 0xdc, count);
+    }
+
+    return put_msgpack_head(enc->out, 0x80, 16, 0, 0xde, count);
+}
+
+/* strings are kept escaped; only those that hold an escape pay for decoding it */
+static int put_text(struct binary_encoder *enc, const char *text, size_t len)
+{
+    if(len == 0 || memchr(text, '\\', len) == NULL) {
+        if(put_text_head(enc, len) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        return len == 0 || append_varstr(enc->out, text, len);
+    }
+
+    if(enc->scratch_cap < len) {
+        char *scratch = (char *)json_realloc(enc->scratch, len);
+        if(scratch == NULL) {
+            return JSON_FAILURE;
+        }
+        enc->scratch = scratch;
+        enc->scratch_cap = len;
+    }
+
+    size_t n = json_unescape(enc->scratch, text, len);
+    if(put_text_head(enc, n) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    return append_varstr(enc->out, enc->scratch, n);
+}
+
+/* a scalar or a string; containers are put_members' business */
+static int put_scalar(struct binary_encoder *enc, struct json_value *value)
+{
+    int cbor = enc->format == BINARY_CBOR;
+    union {
+        float f;
+        uint32_t u;
+    }single;
+    union {
+        double d;
+        uint64_t u;
+    }wide;
+
+    switch(value->type) {
+    case NUMBER:
+        return put_integer(enc, value->value.number);
+    case BOOLEAN:
+        if(cbor) {
+            return put_be(enc->out, value->value.boolean ? 0xf5 : 0xf4, 0, 0);
+        }
+        return put_be(enc->out, value->value.boolean ? 0xc3 : 0xc2, 0, 0);
+    case FLOAT:
+        single.f = value->value.float_decimal;
+        return put_be(enc->out, cbor ? 0xfa : 0xca, single.u, 4);
+    case DOUBLE:
+        wide.d = value->value.double_decimal;
+        return put_be(enc->out, cbor ? 0xfb : 0xcb, wide.u, 8);
+    case STRING:
+        return put_text(enc, value->value.string, value->value.string == NULL ? 0 : value->string_len);
+    case ARRAY:
+    case OBJECT:
+        break;
+    }
+
+    return JSON_FAILURE;
+}
+
+/* the head of a container, and a frame for its children on top of the stack */
+static int put_container(struct binary_encoder *enc, JSON_TYPE type, struct json_value *children)
+{
+    struct json_value *child = NULL;
+    size_t count = 0;
+
+    for(child = children; child != NULL; child = child->next) {
+        count++;
+    }
+    if(put_container_head(enc, type, count) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    if(enc->depth == enc->cap) {
+        struct encode_frame *frames = (struct encode_frame *)json_stack_grow(enc->frames, enc->inline_frames, &enc->cap,
+                                                                             sizeof(*frames), NULL);
+        if(frames == NULL) {
+            return JSON_FAILURE;
+        }
+        enc->frames = frames;
+    }
+    enc->frames[enc->depth].next = children;
+    enc->frames[enc->depth].type = type;
+    enc->depth++;
+
+    return JSON_SUCCEED;
+}
+
+/* the container and everything in it, nesting followed on the encoder's stack */
+static int put_members(struct binary_encoder *enc, JSON_TYPE type, struct json_value *children)
+{
+    if(put_container(enc, type, children) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    while(enc->depth > 0) {
+        struct encode_frame *frame = &enc->frames[enc->depth - 1];
+        struct json_value *child = frame->next;
+        if(child == NULL) {
+            enc->depth--;
+            continue;
+        }
+        frame->next = child->next;
+
+        if(frame->type == OBJECT && put_text(enc, child->name, child->name == NULL ? 0 : child->name_len) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        if(child->type == ARRAY || child->type == OBJECT) {
+            if(put_container(enc, child->type, child->value.children) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+        } else if(put_scalar(enc, child) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+    }
+
+    return JSON_SUCCEED;
+}
+
+static int binary_encode(int format, struct json_root *root, struct varstr *str)
+{
+    if(root == NULL || str == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct binary_encoder enc;
+    enc.format = format;
+    enc.out = str;
+    enc.scratch = NULL;
+    enc.scratch_cap = 0;
+    enc.frames = enc.inline_frames;
+    enc.depth = 0;
+    enc.cap = JSON_WALK_INLINE_DEPTH;
+
+    int res = put_members(&enc, OBJECT, root->elems);
+
+    json_free(enc.scratch);
+    if(enc.frames != enc.inline_frames) {
+        json_free(enc.frames);
+    }
+
+    return res;
+}
+
+int json_msgpack_encode(struct json_root *root, struct varstr *str)
+{
+    return binary_encode(BINARY_MSGPACK, root, str);
+}
+
+int json_cbor_encode(struct json_root *root, struct varstr *str)
+{
+    return binary_encode(BINARY_CBOR, root, str);
+}
+
+static int get_be(struct binary_decoder *dec, int bytes, uint64_t *n)
+{
+    if(dec->len - dec->pos < (size_t)bytes) {
+        return JSON_FAILURE;
+    }
+
+    uint64_t v = 0;
+    int i;
+    for(i = 0; i < bytes; i++) {
+        v = (v << 8) | dec->data[dec->pos++];
+    }
+    *n = v;
+
+    return JSON_SUCCEED;
+}
+
+/* the bytes JSON needs to carry text as a string body */
+static size_t escaped_length(const unsigned char *text, size_t len)
+{
+    size_t n = len;
+    size_t i;
+    for(i = 0; i < len; i++) {
+        if(text[i] == '"' || text[i] == '\\' || text[i] == '\b' || text[i] == '\f'
+                || text[i] == '\n' || text[i] == '\r' || text[i] == '\t') {
+            n += 1;
+        } else if(text[i] < 0x20) {
+            n += 5;
+        }
+    }
+
+    return n;
+}
+
+static void escape_text(char *dst, const unsigned char *text, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i, j = 0;
+    for(i = 0; i < len; i++) {
+        unsigned char c = text[i];
+        switch(c) {
+        case '"':
+            dst[j++] = '\\';
+            dst[j++] = '"';
+            break;
+        case '\\':
+            dst[j++] = '\\';
+            dst[j++] = '\\';
+            break;
+        case '\b':
+            dst[j++] = '\\';
+            dst[j++] = 'b';
+            break;
+        case '\f':
+            dst[j++] = '\\';
+            dst[j++] = 'f';
+            break;
+        case '\n':
+            dst[j++] = '\\';
+            dst[j++] = 'n';
+            break;
+        case '\r':
+            dst[j++] = '\\';
+            dst[j++] = 'r';
+            break;
+        case '\t':
+            dst[j++] = '\\';
+            dst[j++] = 't';
+            break;
+        default:
+            if(c < 0x20) {
+                memcpy(dst + j, "\\u00", 4);
+                dst[j + 4] = hex[c >> 4];
+                dst[j + 5] = hex[c & 0xf];
+                j += 6;
+            } else {
+                dst[j++] = (char)c;
+            }
+            break;
+        }
+    }
+    dst[j] = '\0';
+}
+
+/* takes len bytes of raw text into the form json_value keeps: escaped, owned as the parser says */
+static char *get_text(struct binary_decoder *dec, size_t len, size_t *text_len, int key)
+{
+    if(dec->len - dec->pos < len) {
+        return NULL;
+    }
+
+    unsigned char *text = dec->data + dec->pos;
+    dec->pos += len;
+
+    if(json_scan_string((char *)text, len) == len) {
+        *text_len = len;
+        return key ? json_parser_key(dec->parser, (char *)text, len) : json_parser_strndup(dec->parser, (char *)text, len);
+    }
+
+    size_t n = escaped_length(text, len);
+    char *dst = NULL;
+    if(dec->parser->arena != NULL) {
+        dst = (char *)json_arena_alloc(dec->parser->arena, n + 1);
+    } else {
+        dst = (char *)json_malloc(n + 1);
+    }
+    if(dst == NULL) {
+        return NULL;
+    }
+
+    escape_text(dst, text, len);
+    *text_len = n;
+
+    /* interning only happens with an arena, so the escaped copy is simply left behind */
+    if(key && dec->parser->keys != NULL) {
+        return json_keys_intern(dec->parser->keys, dst, n);
+    }
+
+    return dst;
+}
+
+/* one item's kind and argument: a scalar, or a text length or element count */
+struct binary_item {
+    JSON_TYPE type;
+    union {
+        long long number;
+        int boolean;
+        float float_decimal;
+        double double_decimal;
+    }value;
+    size_t count;
+};
+
+static int get_msgpack_head(struct binary_decoder *dec, struct binary_item *item)
+{
+    uint64_t n = 0;
+    union {
+        float f;
+        uint32_t u;
+    }single;
+    union {
+        double d;
+        uint64_t u;
+    }wide;
+
+    if(dec->pos == dec->len) {
+        return JSON_FAILURE;
+    }
+
+    unsigned char tag = dec->data[dec->pos++];
+    if(tag < 0x80 || tag >= 0xe0) {
+        item->type = NUMBER;
+        item->value.number = (signed char)tag;
+        return JSON_SUCCEED;
+    }
+    if(tag < 0xc0) {
+        item->type = tag < 0x90 ? OBJECT : (tag < 0xa0 ? ARRAY : STRING);
+        item->count = tag & (tag < 0xa0 ? 0x0f : 0x1f);
+        return JSON_SUCCEED;
+    }
+
+    switch(tag) {
+    case 0xc2:
+    case 0xc3:
+        item->type = BOOLEAN;
+        item->value.boolean = tag == 0xc3;
+        return JSON_SUCCEED;
+    case 0xca:
+        if(get_be(dec, 4, &n) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        single.u = (uint32_t)n;
+        item->type = FLOAT;
+        item->value.float_decimal = single.f;
+        return JSON_SUCCEED;
+    case 0xcb:
+        if(get_be(dec, 8, &n) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        wide.u = n;
+        item->type = DOUBLE;
+        item->value.double_decimal = wide.d;
+        return JSON_SUCCEED;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        if(get_be(dec, 1 << (tag - 0xcc), &n) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        if(n > LLONG_MAX) {
+            item->type = DOUBLE;
+            item->value.double_decimal = (double)n;
+        } else {
+            item->type = NUMBER;
+            item->value.number = (long long)n;
+        }
+        return JSON_SUCCEED;
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3: {
+        int bytes = 1 << (tag - 0xd0);
+        if(get_be(dec, bytes, &n) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        /* sign-extend from the top bit of the stored width */
+        if(bytes < 8 && (n >> (bytes * 8 - 1)) != 0) {
+            n |= ~(uint64_t)0 << (bytes * 8);
+        }
+        item->type = NUMBER;
+        item->value.number = (long long)n;
+        return JSON_SUCCEED;
+    }
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        item->type = STRING;
+        break;
+    case 0xdc:
+    case 0xdd:
+        item->type = ARRAY;
+        break;
+    case 0xde:
+    case 0xdf:
+        item->type = OBJECT;
+        break;
+    default:
+        return JSON_FAILURE;
+    }
+
+    int bytes = 2;
+    if(tag == 0xd9) {
+        bytes = 1;
+    } else if(tag == 0xdb || tag == 0xdd || tag == 0xdf) {
+        bytes = 4;
+    }
+    if(get_be(dec, bytes, &n) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+    item->count = (size_t)n;
+
+    return JSON_SUCCEED;
+}
+
+static float half_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    union {
+        float f;
+        uint32_t u;
+    }single;
+
+    if(exp == 0x1f) {
+        single.u = sign | 0x7f800000 | (mant << 13);
+    } else if(exp != 0) {
+        single.u = sign | ((exp + 112) << 23) | (mant << 13);
+    } else {
+        /* subnormal halves are normal floats */
+        single.f = (float)mant / (1 << 24);
+        single.u |= sign;
+    }
+
+    return single.f;
+}
+
+static int get_cbor_head(struct binary_decoder *dec, struct binary_item *item)
+{
+    uint64_t n = 0;
+    union {
+        float f;
+        uint32_t u;
+    }single;
+    union {
+        double d;
+        uint64_t u;
+    }wide;
+
+    if(dec->pos == dec->len) {
+        return JSON_FAILURE;
+    }
+
+    unsigned char tag = dec->data[dec->pos++];
+    int major = tag >> 5;
+    int info = tag & 0x1f;
+
+    if(major == CBOR_SIMPLE) {
+        switch(info) {
+        case 20:
+        case 21:
+            item->type = BOOLEAN;
+            item->value.boolean = info == 21;
+            return JSON_SUCCEED;
+        case 25:
+            if(get_be(dec, 2, &n) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+            item->type = FLOAT;
+            item->value.float_decimal = half_to_float((uint16_t)n);
+            return JSON_SUCCEED;
+        case 26:
+            if(get_be(dec, 4, &n) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+            single.u = (uint32_t)n;
+            item->type = FLOAT;
+            item->value.float_decimal = single.f;
+            return JSON_SUCCEED;
+        case 27:
+            if(get_be(dec, 8, &n) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+            wide.u = n;
+            item->type = DOUBLE;
+            item->value.double_decimal = wide.d;
+            return JSON_SUCCEED;
+        default:
+            return JSON_FAILURE;
+        }
+    }
+
+    if(info < 24) {
+        n = info;
+    } else if(info <= 27) {
+        if(get_be(dec, 1 << (info - 24), &n) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+    } else {
+        return JSON_FAILURE;
+    }
+
+    switch(major) {
+    case CBOR_UNSIGNED:
+        if(n > LLONG_MAX) {
+            item->type = DOUBLE;
+            item->value.double_decimal = (double)n;
+        } else {
+            item->type = NUMBER;
+            item->value.number = (long long)n;
+        }
+        return JSON_SUCCEED;
+    case CBOR_NEGATIVE:
+        if(n > LLONG_MAX) {
+            item->type = DOUBLE;
+            item->value.double_decimal = -1.0 - (double)n;
+        } else {
+            item->type = NUMBER;
+            item->value.number = -1 - (long long)n;
+        }
+        return JSON_SUCCEED;
+    case CBOR_TEXT:
+        item->type = STRING;
+        break;
+    case CBOR_ARRAY:
+        item->type = ARRAY;
+        break;
+    case CBOR_MAP:
+        item->type = OBJECT;
+        break;
+    default:
+        return JSON_FAILURE;
+    }
+
+    if(n > SIZE_MAX) {
+        return JSON_FAILURE;
+    }
+    item->count = (size_t)n;
+
+    return JSON_SUCCEED;
+}
+
+static int get_head(struct binary_decoder *dec, struct binary_item *item)
+{
+    if(dec->format == BINARY_CBOR) {
+        return get_cbor_head(dec, item);
+    }
+
+    return get_msgpack_head(dec, item);
+}
+
+/* a frame for a container's count items on top of the stack, unless it is too deep or promises more than is left */
+static int open_container(struct binary_decoder *dec, JSON_TYPE type, size_t count, struct json_value **head, struct json_value *node)
+{
+    /* every element takes a byte, a member two */
+    size_t left = dec->len - dec->pos;
+    if(count > left || (type == OBJECT && count > left / 2)) {
+        return JSON_FAILURE;
+    }
+
+    if(dec->depth == dec->parser->max_depth) {
+        return JSON_FAILURE;
+    }
+    if(dec->depth == dec->cap) {
+        struct decode_frame *frames = (struct decode_frame *)json_stack_grow(dec->frames, dec->inline_frames, &dec->cap,
+                                                                             sizeof(*frames), json_parser_allocator(dec->parser));
+        if(frames == NULL) {
+            return JSON_FAILURE;
+        }
+        dec->frames = frames;
+    }
+
+    struct decode_frame *frame = &dec->frames[dec->depth++];
+    frame->type = type;
+    frame->left = count;
+    frame->tail = head;
+    frame->node = node;
+    while(*frame->tail != NULL) {
+        frame->tail = &(*frame->tail)->next;
+    }
+    JSON_STAT_DEPTH(dec->depth);
+
+    return JSON_SUCCEED;
+}
+
+/* decodes one item named name and links it into the innermost container; a container opens a frame of its own */
+static int get_value(struct binary_decoder *dec, char *name, size_t name_len)
+{
+    struct binary_item item;
+    if(get_head(dec, &item) != JSON_SUCCEED) {
+        discard_json_string(dec->parser, name);
+        return JSON_FAILURE;
+    }
+
+    struct json_value *node = NULL;
+    char *text = NULL;
+    size_t text_len = 0;
+    switch(item.type) {
+    case STRING:
+        text = get_text(dec, item.count, &text_len, 0);
+        if(text == NULL) {
+            break;
+        }
+        node = init_json_value(dec->parser, STRING, name, name_len, text, text_len);
+        if(node == NULL) {
+            discard_json_string(dec->parser, text);
+        }
+        break;
+    case ARRAY:
+    case OBJECT:
+        node = init_json_value(dec->parser, item.type, name, name_len, NULL, 0);
+        break;
+    default:
+        node = init_json_value(dec->parser, item.type, name, name_len, &item.value, 0);
+        break;
+    }
+
+    if(node == NULL) {
+        discard_json_string(dec->parser, name);
+        return JSON_FAILURE;
+    }
+
+    struct decode_frame *frame = &dec->frames[dec->depth - 1];
+    node->anonymous = name == NULL;
+    *frame->tail = node;
+    frame->tail = &node->next;
+
+    if(item.type == ARRAY || item.type == OBJECT) {
+        return open_container(dec, item.type, item.count, &node->value.children, node);
+    }
+
+    return JSON_SUCCEED;
+}
+
+/* the count items of a container, appended to *head; nesting is followed on the decoder's stack */
+static int get_members(struct binary_decoder *dec, JSON_TYPE type, size_t count, struct json_value **head)
+{
+    if(open_container(dec, type, count, head, NULL) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    while(dec->depth > 0) {
+        struct decode_frame *frame = &dec->frames[dec->depth - 1];
+        if(frame->left == 0) {
+            /* an array gets its position vector once every element is in */
+            if(frame->node != NULL && json_value_collect(dec->parser, frame->node) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+            dec->depth--;
+            continue;
+        }
+        frame->left--;
+
+        char *name = NULL;
+        size_t name_len = 0;
+        if(frame->type == OBJECT) {
+            struct binary_item key;
+            if(get_head(dec, &key) != JSON_SUCCEED || key.type != STRING) {
+                return JSON_FAILURE;
+            }
+            name = get_text(dec, key.count, &name_len, 1);
+            if(name == NULL) {
+                return JSON_FAILURE;
+            }
+        }
+
+        if(get_value(dec, name, name_len) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+    }
+
+    return JSON_SUCCEED;
+}
+
+static int binary_decode(int format, struct json_root *root, struct varstr *str, int flags)
+{
+    if(root == NULL || str == NULL || str->data == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* views can't be handed to free(), so zero-copy needs an arena-owned root */
+    if((flags & JSON_PARSE_ZERO_COPY) && root->arena == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct json_parser parser = { root->arena, flags, json_root_keys(root), NULL, json_root_max_depth(root) };
+    struct binary_decoder dec;
+    dec.format = format;
+    dec.parser = &parser;
+    dec.data = (unsigned char *)str->data;
+    dec.len = str->len;
+    dec.pos = 0;
+    dec.frames = dec.inline_frames;
+    dec.depth = 0;
+    dec.cap = JSON_WALK_INLINE_DEPTH;
+
+    struct binary_item item;
+    if(get_head(&dec, &item) != JSON_SUCCEED || item.type != OBJECT) {
+        return JSON_FAILURE;
+    }
+
+    /* members are appended behind the index's back */
+    if(root->index != NULL) {
+        release_json_index(root->index);
+        root->index = NULL;
+    }
+
+    int res = get_members(&dec, OBJECT, item.count, &root->elems);
+    if(dec.frames != dec.inline_frames) {
+        json_allocator_free(json_parser_allocator(&parser), dec.frames);
+    }
+    for(root->last = root->elems; root->last != NULL && root->last->next != NULL;) {
+        root->last = root->last->next;
+    }
+    if(res != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    return dec.pos == dec.len;
+}
+
+int json_msgpack_decode(struct json_root *root, struct varstr *str, int flags)
+{
+    return binary_decode(BINARY_MSGPACK, root, str, flags);
+}
+
+int json_cbor_decode(struct json_root *root, struct varstr *str, int flags)
+{
+    return binary_decode(BINARY_CBOR, root, str, flags);
+}
@@ -0,0 +1,23 @@
+#ifndef _BINARY_H_
+#define _BINARY_H_
+
+#include "json.h"
+
+/* containers nested deeper than the root's max_depth fail to decode; this is its default */
+#define JSON_BINARY_DEPTH_MAX JSON_PARSE_DEPTH_MAX
+
+/*
+ * MessagePack and CBOR (RFC 8949) encodings of a json_root, which travels as
+ * a map. Integers take their smallest form, FLOAT and DOUBLE keep their width,
+ * and strings are written unescaped. Decoding appends to the root and takes the
+ * same parse flags as json_deserialize_flags; JSON_PARSE_ZERO_COPY leaves
+ * strings that need no escaping as views into str. nil, binary, extension and
+ * tagged items and CBOR indefinite lengths have no JSON_TYPE and fail.
+ */
+int json_msgpack_encode(struct json_root *root, struct varstr *str);
+int json_msgpack_decode(struct json_root *root, struct varstr *str, int flags);
+
+int json_cbor_encode(struct json_root *root, struct varstr *str);
+int json_cbor_decode(struct json_root *root, struct varstr *str, int flags);
+
+#endif
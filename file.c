@@ -0,0 +1,78 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "json_internal.h"
+#include "scan.h"
+
+char *json_map_file(const char *path, size_t *size, int sequential)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char *data = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return NULL;
+    }
+
+    if(sequential) {
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    }
+    *size = (size_t)st.st_size;
+
+    return data;
+}
+
+/*
+ * The file is mapped read-only and parsed in place, so no copy of it is ever
+ * made. With JSON_PARSE_ZERO_COPY or JSON_PARSE_LAZY the document keeps
+ * pointing into the mapping, which therefore lives until the document does.
+ */
+int json_parse_file(struct json_document *doc, const char *path)
+{
+    if(doc == NULL || path == NULL || doc->map != NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* a lazy walk jumps around; everything else reads front to back exactly once */
+    size_t size = 0;
+    char *data = json_map_file(path, &size, !(doc->flags & JSON_PARSE_LAZY));
+    if(data == NULL) {
+        return JSON_FAILURE;
+    }
+
+    doc->map = data;
+    doc->map_len = size;
+
+    /* files usually end in a newline, which the top-level object check would trip on */
+    size_t start = json_skip_whitespace(data, size);
+    size_t end = size;
+    while(end > start && (data[end - 1] == ' ' || data[end - 1] == '\n' || data[end - 1] == '\r' || data[end - 1] == '\t')) {
+        end--;
+    }
+
+    int res = json_document_parse(doc, data + start, end - start);
+    if(!(doc->flags & (JSON_PARSE_ZERO_COPY | JSON_PARSE_LAZY))) {
+        json_document_unmap(doc);
+    }
+
+    return res;
+}
+
+void json_document_unmap(struct json_document *doc)
+{
+    if(doc->map != NULL) {
+        munmap(doc->map, doc->map_len);
+        doc->map = NULL;
+        doc->map_len = 0;
+    }
+}
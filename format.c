@@ -0,0 +1,424 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "format.h"
+#include "json.h"
+
+typedef struct diy_fp {
+    uint64_t f;
+    int e;
+}diy_fp;
+
+/* normalized 64-bit approximations of 10^k for k = -348, -340, ..., 340 */
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066
+};
+
+static const uint64_t pow10_table[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static diy_fp diy_fp_make(uint64_t f, int e)
+{
+    diy_fp fp;
+    fp.f = f;
+    fp.e = e;
+
+    return fp;
+}
+
+static diy_fp diy_fp_normalize(diy_fp fp)
+{
+    int shift = __builtin_clzll(fp.f);
+    fp.f <<= shift;
+    fp.e -= shift;
+
+    return fp;
+}
+
+static diy_fp diy_fp_mul(diy_fp a, diy_fp b)
+{
+    unsigned __int128 product = (unsigned __int128)a.f * b.f;
+    uint64_t h = (uint64_t)(product >> 64);
+    uint64_t l = (uint64_t)product;
+
+    if(l & (1ULL << 63)) {
+        h++;
+    }
+
+    return diy_fp_make(h, a.e + b.e + 64);
+}
+
+/* v is the value and f, e its significand and exponent; hidden is the implicit leading bit */
+static void normalized_boundaries(uint64_t f, int e, uint64_t hidden, diy_fp *minus, diy_fp *plus)
+{
+    diy_fp pl = diy_fp_normalize(diy_fp_make((f << 1) + 1, e - 1));
+    diy_fp mi = f == hidden ? diy_fp_make((f << 2) - 1, e - 2) : diy_fp_make((f << 1) - 1, e - 1);
+
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *plus = pl;
+    *minus = mi;
+}
+
+static diy_fp cached_power(int e, int *K)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if(dk - k > 0.0) {
+        k++;
+    }
+
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+
+    return diy_fp_make(cached_powers_f[index], cached_powers_e[index]);
+}
+
+static int count_digits32(uint32_t n)
+{
+    int digits = 1;
+    while(n >= 10) {
+        n /= 10;
+        digits++;
+    }
+
+    return digits;
+}
+
+/*
+ * Grisu3's weeding: walks the last digit down towards w while it stays in
+ * the safe interval, then reports whether the result is provably the
+ * shortest and closest, given that every scaled value is off by up to ulp.
+ */
+static int round_weed(char *buffer, int len, uint64_t wp_w, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t ulp)
+{
+    uint64_t wp_w_up = wp_w - ulp;
+    uint64_t wp_w_down = wp_w + ulp;
+
+    while(rest < wp_w_up && delta - rest >= ten_kappa &&
+          (rest + ten_kappa < wp_w_up || wp_w_up - rest >= rest + ten_kappa - wp_w_up)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+
+    /* another step would also have been closer to some value in the error range: undecided */
+    if(rest < wp_w_down && delta - rest >= ten_kappa &&
+       (rest + ten_kappa < wp_w_down || wp_w_down - rest > rest + ten_kappa - wp_w_down)) {
+        return 0;
+    }
+
+    return 2 * ulp <= rest && rest <= delta - 4 * ulp;
+}
+
+/* digits of W, cut off as soon as they land strictly inside (Wm, Wp) widened by the error */
+static int digit_gen(diy_fp Wm, diy_fp W, diy_fp Wp, char *buffer, int *len, int *K)
+{
+    uint64_t ulp = 1;
+    diy_fp too_high = diy_fp_make(Wp.f + ulp, Wp.e);
+    uint64_t unsafe = too_high.f - (Wm.f - ulp);
+    diy_fp one = diy_fp_make(1ULL << -W.e, W.e);
+    uint64_t wp_w = too_high.f - W.f;
+    uint32_t p1 = (uint32_t)(too_high.f >> -one.e);
+    uint64_t p2 = too_high.f & (one.f - 1);
+    int kappa = count_digits32(p1);
+
+    *len = 0;
+    while(kappa > 0) {
+        uint32_t divisor = (uint32_t)pow10_table[kappa - 1];
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        buffer[(*len)++] = (char)('0' + d);
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if(rest < unsafe) {
+            *K += kappa;
+            return round_weed(buffer, *len, wp_w, unsafe, rest, (uint64_t)divisor << -one.e, ulp);
+        }
+    }
+
+    for(;;) {
+        p2 *= 10;
+        ulp *= 10;
+        unsafe *= 10;
+        buffer[(*len)++] = (char)('0' + (p2 >> -one.e));
+        p2 &= one.f - 1;
+        kappa--;
+        if(p2 < unsafe) {
+            *K += kappa;
+            return round_weed(buffer, *len, wp_w * ulp, unsafe, p2, one.f, ulp);
+        }
+    }
+}
+
+/* JSON_FAILURE when the digits can't be proven shortest, which happens for about one value in two hundred */
+static int grisu3(uint64_t f, int e, uint64_t hidden, char *buffer, int *len, int *K)
+{
+    diy_fp w_m, w_p;
+    normalized_boundaries(f, e, hidden, &w_m, &w_p);
+
+    diy_fp c_mk = cached_power(w_p.e, K);
+    diy_fp W = diy_fp_mul(diy_fp_normalize(diy_fp_make(f, e)), c_mk);
+    diy_fp Wp = diy_fp_mul(w_p, c_mk);
+    diy_fp Wm = diy_fp_mul(w_m, c_mk);
+
+    return digit_gen(Wm, W, Wp, buffer, len, K) ? JSON_SUCCEED : JSON_FAILURE;
+}
+
+/*
+ * The slow, exact path for what Grisu3 leaves undecided: the C library
+ * prints correctly rounded digits at one length after another until they
+ * read back as the same value. Only the digits and the exponent are taken
+ * from the text, and the number read back has no decimal point, so the
+ * locale doesn't matter.
+ */
+static void exact_digits(double value, int single, char *buffer, int *len, int *K)
+{
+    char text[40], back[48];
+    int precision, max = single ? 9 : 17, exponent = 0;
+
+    for(precision = 1; precision <= max; precision++) {
+        const char *p = text;
+        snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+        *len = 0;
+        for(; *p != 'e'; p++) {
+            if(*p >= '0' && *p <= '9') {
+                buffer[(*len)++] = *p;
+            }
+        }
+        exponent = atoi(p + 1);
+        snprintf(back, sizeof(back), "%.*se%d", *len, buffer, exponent - *len + 1);
+        if(single ? strtof(back, NULL) == (float)value : strtod(back, NULL) == value) {
+            break;
+        }
+    }
+
+    *K = exponent - *len + 1;
+}
+
+static size_t write_exponent(int K, char *buffer)
+{
+    size_t i = 0;
+
+    if(K < 0) {
+        buffer[i++] = '-';
+        K = -K;
+    }
+
+    if(K >= 100) {
+        buffer[i++] = (char)('0' + K / 100);
+        K %= 100;
+        memcpy(buffer + i, digit_pairs + 2 * K, 2);
+        i += 2;
+    } else if(K >= 10) {
+        memcpy(buffer + i, digit_pairs + 2 * K, 2);
+        i += 2;
+    } else {
+        buffer[i++] = (char)('0' + K);
+    }
+
+    return i;
+}
+
+/* turns digits * 10^k into plain or exponent notation; a decimal always shows a '.' or an 'e' */
+static size_t prettify(char *buffer, int length, int k)
+{
+    int kk = length + k;
+    int i;
+
+    if(k >= 0 && kk <= 21) {
+        /* 1234e7 -> 12340000000.0 */
+        for(i = length; i < kk; i++) {
+            buffer[i] = '0';
+        }
+        buffer[kk] = '.';
+        buffer[kk + 1] = '0';
+        return kk + 2;
+    }
+
+    if(kk > 0 && kk <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memmove(buffer + kk + 1, buffer + kk, length - kk);
+        buffer[kk] = '.';
+        return length + 1;
+    }
+
+    if(kk > -6 && kk <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        int offset = 2 - kk;
+        memmove(buffer + offset, buffer, length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for(i = 2; i < offset; i++) {
+            buffer[i] = '0';
+        }
+        return length + offset;
+    }
+
+    if(length == 1) {
+        /* 1e30 */
+        buffer[1] = 'e';
+        return 2 + write_exponent(kk - 1, buffer + 2);
+    }
+
+    /* 1234e30 -> 1.234e33 */
+    memmove(buffer + 2, buffer + 1, length - 1);
+    buffer[1] = '.';
+    buffer[length + 1] = 'e';
+    return length + 2 + write_exponent(kk - 1, buffer + length + 2);
+}
+
+static size_t format_special(int negative, int nan, char *buffer)
+{
+    size_t i = 0;
+
+    if(nan) {
+        memcpy(buffer, "nan", 3);
+        return 3;
+    }
+
+    if(negative) {
+        buffer[i++] = '-';
+    }
+    memcpy(buffer + i, "inf", 3);
+
+    return i + 3;
+}
+
+size_t json_format_double(double value, char *buffer)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int negative = (int)(bits >> 63);
+    int biased = (int)((bits >> 52) & 0x7ff);
+    uint64_t f = bits & 0x000fffffffffffffULL;
+    size_t i = 0;
+    int len = 0, K = 0;
+
+    if(biased == 0x7ff) {
+        return format_special(negative, f != 0, buffer);
+    }
+
+    if(negative) {
+        buffer[i++] = '-';
+    }
+
+    if(biased == 0 && f == 0) {
+        memcpy(buffer + i, "0.0", 3);
+        return i + 3;
+    }
+
+    int exact = biased != 0 ? grisu3(f | (1ULL << 52), biased - 1075, 1ULL << 52, buffer + i, &len, &K) :
+                              grisu3(f, -1074, 1ULL << 52, buffer + i, &len, &K);
+    if(exact != JSON_SUCCEED) {
+        exact_digits(negative ? -value : value, 0, buffer + i, &len, &K);
+    }
+
+    return i + prettify(buffer + i, len, K);
+}
+
+size_t json_format_float(float value, char *buffer)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int negative = (int)(bits >> 31);
+    int biased = (int)((bits >> 23) & 0xff);
+    uint64_t f = bits & 0x7fffff;
+    size_t i = 0;
+    int len = 0, K = 0;
+
+    if(biased == 0xff) {
+        return format_special(negative, f != 0, buffer);
+    }
+
+    if(negative) {
+        buffer[i++] = '-';
+    }
+
+    if(biased == 0 && f == 0) {
+        memcpy(buffer + i, "0.0", 3);
+        return i + 3;
+    }
+
+    /* same digit generation, with the rounding interval of a float */
+    int exact = biased != 0 ? grisu3(f | (1ULL << 23), biased - 150, 1ULL << 23, buffer + i, &len, &K) :
+                              grisu3(f, -149, 1ULL << 23, buffer + i, &len, &K);
+    if(exact != JSON_SUCCEED) {
+        exact_digits(negative ? -value : value, 1, buffer + i, &len, &K);
+    }
+
+    return i + prettify(buffer + i, len, K);
+}
+
+size_t json_format_integer(long long value, char *buffer)
+{
+    char digits[20];
+    size_t i = 0, n = sizeof(digits);
+    unsigned long long u = (unsigned long long)value;
+
+    if(value < 0) {
+        buffer[i++] = '-';
+        u = 0 - u;
+    }
+
+    while(u >= 100) {
+        unsigned pair = (unsigned)(u % 100);
+        u /= 100;
+        n -= 2;
+        memcpy(digits + n, digit_pairs + 2 * pair, 2);
+    }
+    if(u >= 10) {
+        n -= 2;
+        memcpy(digits + n, digit_pairs + 2 * u, 2);
+    } else {
+        digits[--n] = (char)('0' + u);
+    }
+
+    memcpy(buffer + i, digits + n, sizeof(digits) - n);
+
+    return i + sizeof(digits) - n;
+}
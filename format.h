@@ -0,0 +1,14 @@
+#ifndef _FORMAT_H_
+#define _FORMAT_H_
+
+#include <stddef.h>
+
+/* large enough for any output of the functions below, without a terminator */
+#define JSON_NUMBER_BUFFER_SIZE 32
+
+/* shortest text that reads back as the same value (Grisu3, exact fallback), locale independent */
+size_t json_format_double(double value, char *buffer);
+size_t json_format_float(float value, char *buffer);
+size_t json_format_integer(long long value, char *buffer);
+
+#endif
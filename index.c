@@ -0,0 +1,191 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "index.h"
+#include "alloc.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static int fold_char(int c)
+{
+    return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+uint64_t json_index_hash(const char *name, size_t len)
+{
+    uint64_t hash = FNV_OFFSET;
+    size_t i;
+
+    for(i = 0; i < len; i++) {
+        hash ^= (unsigned char)fold_char((unsigned char)name[i]);
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static int keys_equal(struct json_value *value, const char *name, size_t len, int flags)
+{
+    if(value->name == name) {
+        return 1;
+    }
+    if(value->name_len != len) {
+        return 0;
+    }
+
+    if(flags & JSON_FIND_CASE_SENSITIVE) {
+        return !memcmp(value->name, name, len);
+    }
+
+    return !strncasecmp(value->name, name, len);
+}
+
+static struct json_index_slot *alloc_slots(struct json_index *index, size_t cap)
+{
+    struct json_index_slot *slots = NULL;
+
+    if(index->arena != NULL) {
+        slots = (struct json_index_slot *)json_arena_alloc(index->arena, cap * sizeof(*slots));
+        if(slots != NULL) {
+            memset(slots, 0, cap * sizeof(*slots));
+        }
+    } else {
+        slots = (struct json_index_slot *)json_calloc(cap, sizeof(*slots));
+    }
+
+    return slots;
+}
+
+static void place_slot(struct json_index_slot *slots, size_t cap, uint64_t hash, struct json_value *value)
+{
+    size_t mask = cap - 1;
+    size_t i = (size_t)hash & mask;
+
+    while(slots[i].value != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    slots[i].hash = hash;
+    slots[i].value = value;
+}
+
+static int grow_index(struct json_index *index)
+{
+    size_t cap = index->cap * 2;
+    struct json_index_slot *slots = alloc_slots(index, cap);
+    if(slots == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* start behind an empty slot so no cluster wraps and equal keys keep their order */
+    size_t mask = index->cap - 1;
+    size_t start = 0, i;
+    while(index->slots[start].value != NULL) {
+        start++;
+    }
+    for(i = 0; i < index->cap; i++) {
+        struct json_index_slot *slot = &index->slots[(start + i) & mask];
+        if(slot->value != NULL) {
+            place_slot(slots, cap, slot->hash, slot->value);
+        }
+    }
+
+    if(index->arena == NULL) {
+        json_free(index->slots);
+    }
+    index->slots = slots;
+    index->cap = cap;
+
+    return JSON_SUCCEED;
+}
+
+struct json_index *create_json_index(struct json_arena *arena, struct json_value *members)
+{
+    struct json_index *index = NULL;
+    struct json_value *curr = NULL;
+    size_t count = 0;
+
+    if(arena != NULL) {
+        index = (struct json_index *)json_arena_alloc(arena, sizeof(*index));
+    } else {
+        index = (struct json_index *)json_malloc(sizeof(*index));
+    }
+    if(index == NULL) {
+        return NULL;
+    }
+
+    for(curr = members; curr != NULL; curr = curr->next) {
+        count++;
+    }
+
+    index->arena = arena;
+    index->count = 0;
+    index->cap = 16;
+    while(index->cap < count * 2) {
+        index->cap *= 2;
+    }
+
+    index->slots = alloc_slots(index, index->cap);
+    if(index->slots == NULL) {
+        if(arena == NULL) {
+            json_free(index);
+        }
+        return NULL;
+    }
+
+    for(curr = members; curr != NULL; curr = curr->next) {
+        place_slot(index->slots, index->cap, json_index_hash(curr->name, curr->name_len), curr);
+    }
+    index->count = count;
+
+    return index;
+}
+
+int json_index_insert(struct json_index *index, struct json_value *member)
+{
+    if(index == NULL || member == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* members are appended, so probing past equal keys keeps the first one winning */
+    uint64_t hash = json_index_hash(member->name, member->name_len);
+
+    if((index->count + 1) * 2 > index->cap && grow_index(index) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    place_slot(index->slots, index->cap, hash, member);
+    index->count++;
+
+    return JSON_SUCCEED;
+}
+
+struct json_value *json_index_find(struct json_index *index, const char *name, size_t len, uint64_t hash, int flags)
+{
+    size_t mask = index->cap - 1;
+    size_t i = (size_t)hash & mask;
+
+    while(index->slots[i].value != NULL) {
+        if(index->slots[i].hash == hash && keys_equal(index->slots[i].value, name, len, flags)) {
+            return index->slots[i].value;
+        }
+        i = (i + 1) & mask;
+    }
+
+    return NULL;
+}
+
+int release_json_index(struct json_index *index)
+{
+    if(index == NULL) {
+        return JSON_FAILURE;
+    }
+
+    if(index->arena == NULL) {
+        json_free(index->slots);
+        json_free(index);
+    }
+
+    return JSON_SUCCEED;
+}
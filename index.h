@@ -0,0 +1,33 @@
+#ifndef _INDEX_H_
+#define _INDEX_H_
+
+#include <stdint.h>
+#include "json.h"
+
+/* objects with at least this many members get a hash index on their first lookup */
+#define JSON_INDEX_THRESHOLD 16
+
+typedef struct json_index_slot {
+    uint64_t hash;
+    struct json_value *value;
+}json_index_slot;
+
+/*
+ * Open-addressed table over an object's members. Hashes fold ASCII case so
+ * one table answers both case-sensitive and case-insensitive lookups; members
+ * with equal keys sit in list order along their probe sequence.
+ */
+typedef struct json_index {
+    struct json_arena *arena;
+    size_t cap;
+    size_t count;
+    struct json_index_slot *slots;
+}json_index;
+
+uint64_t json_index_hash(const char *name, size_t len);
+struct json_index *create_json_index(struct json_arena *arena, struct json_value *members);
+int json_index_insert(struct json_index *index, struct json_value *member);
+struct json_value *json_index_find(struct json_index *index, const char *name, size_t len, uint64_t hash, int flags);
+int release_json_index(struct json_index *index);
+
+#endif
@@ -2,24 +2,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include "json.h"
+#include "json_internal.h"
+#include "scan.h"
+#include "structural.h"
+#include "sax.h"
+#include "number.h"
+#include "format.h"
+#include "index.h"
+#include "keys.h"
+#include "path.h"
+#include "parallel.h"
 
 static const char *json_false = "false";
 static const char *json_true  = "true";
 static int jfalse = 0;
 static int jtrue = 1;
 
-#define JSON_MAX_SIZE 1024
-
-char *escape_string(char *str, int str_len)
+char *escape_string(char *str, size_t str_len)
 {
     if(str == NULL || str_len == 0) {
         return NULL;
     }
 
-    char buffer[JSON_MAX_SIZE];
-    memset(buffer, 0, JSON_MAX_SIZE);
+    char *dst = (char *)json_malloc(2 * str_len + 1);
+    if(dst == NULL) {
+        return NULL;
+    }
 
-    int i = 0, j = 0;
+    size_t i = 0, j = 0;
     while (i < str_len) {
         switch (str[i]) {
             case '\t':
@@ -29,58 +39,171 @@ char *escape_string(char *str, int str_len)
             case '\r':
             case '\"':
             case '\\':
-                buffer[j++] = '\\';
+                dst[j++] = '\\';
             default:
-                buffer[j++] = str[i++];
+                dst[j++] = str[i++];
                 break;
         }
     }
-
-    char *dst = strndup(buffer, JSON_MAX_SIZE - 1);
+    dst[j] = '\0';
 
     return dst;
 }
 
-char *unescape_string(char *str, int str_len)
+static int hex_value(char c)
 {
-    if(str == NULL || str_len == 0) {
-        return NULL;
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+static int unescape_unicode(const char *str, size_t str_len, size_t i, unsigned int *code)
+{
+    if(i + 4 > str_len) {
+        return 0;
+    }
+
+    unsigned int value = 0;
+    int k;
+    for(k = 0; k < 4; k++) {
+        int digit = hex_value(str[i + k]);
+        if(digit < 0) {
+            return 0;
+        }
+        value = (value << 4) | digit;
+    }
+
+    *code = value;
+
+    return 4;
+}
+
+static int encode_utf8(char *dst, unsigned int code)
+{
+    if(code < 0x80) {
+        dst[0] = code;
+        return 1;
+    }
+    if(code < 0x800) {
+        dst[0] = 0xc0 | (code >> 6);
+        dst[1] = 0x80 | (code & 0x3f);
+        return 2;
+    }
+    if(code < 0x10000) {
+        dst[0] = 0xe0 | (code >> 12);
+        dst[1] = 0x80 | ((code >> 6) & 0x3f);
+        dst[2] = 0x80 | (code & 0x3f);
+        return 3;
     }
 
-    char buffer[JSON_MAX_SIZE];
-    memset(buffer, 0, JSON_MAX_SIZE);
+    dst[0] = 0xf0 | (code >> 18);
+    dst[1] = 0x80 | ((code >> 12) & 0x3f);
+    dst[2] = 0x80 | ((code >> 6) & 0x3f);
+    dst[3] = 0x80 | (code & 0x3f);
+    return 4;
+}
 
-    int i = 0, j = 0;
+size_t json_unescape(char *dst, const char *str, size_t str_len)
+{
+    size_t i = 0, j = 0;
+    unsigned int code = 0, low = 0;
     while(i < str_len) {
-        if(str[i] == '\\') {
-            i++;
+        if(str[i] != '\\' || i + 1 == str_len) {
+            dst[j++] = str[i++];
+            continue;
+        }
+
+        i++;
+        switch(str[i]) {
+        case 'b': dst[j++] = '\b'; i++; break;
+        case 'f': dst[j++] = '\f'; i++; break;
+        case 'n': dst[j++] = '\n'; i++; break;
+        case 'r': dst[j++] = '\r'; i++; break;
+        case 't': dst[j++] = '\t'; i++; break;
+        case 'u':
+            if(unescape_unicode(str, str_len, i + 1, &code) == 0) {
+                dst[j++] = str[i++];
+                break;
+            }
+            i += 5;
+            if(code >= 0xd800 && code < 0xdc00 && i + 1 < str_len && str[i] == '\\' && str[i + 1] == 'u'
+                    && unescape_unicode(str, str_len, i + 2, &low) && low >= 0xdc00 && low < 0xe000) {
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            j += encode_utf8(dst + j, code);
+            break;
+        default:
+            dst[j++] = str[i++];
+            break;
         }
+    }
+
+    return j;
+}
+
+char *unescape_string(char *str, size_t str_len)
+{
+    if(str == NULL || str_len == 0) {
+        return NULL;
+    }
 
-        buffer[j++] = str[i++];
+    char *dst = (char *)json_malloc(str_len + 1);
+    if(dst == NULL) {
+        return NULL;
     }
 
-    char *dst = strndup(buffer, JSON_MAX_SIZE - 1);
+    dst[json_unescape(dst, str, str_len)] = '\0';
 
     return dst;
 }
 
-struct json_value *create_json_value(JSON_TYPE type, char *name, int name_len, void *value, int value_len)
+char *json_value_unescape_name(struct json_value *value)
+{
+    if(value == NULL) {
+        return NULL;
+    }
+
+    return unescape_string(value->name, value->name_len);
+}
+
+char *json_value_unescape_string(struct json_value *value)
+{
+    if(value == NULL || value->type != STRING) {
+        return NULL;
+    }
+
+    return unescape_string(value->value.string, value->string_len);
+}
+
+struct json_value *create_json_value(JSON_TYPE type, char *name, size_t name_len, void *value, size_t value_len)
 {
-    struct json_value *elem = (struct json_value *)malloc(sizeof(*elem));
+    struct json_value *elem = (struct json_value *)json_malloc(sizeof(*elem));
     if(elem == NULL) {
         return NULL;
     }
     elem->type = type;
     elem->next = NULL;
     elem->anonymous = 0;
+    elem->index = NULL;
 
     char *node_name = NULL, *node_value = NULL;
     node_name = escape_string(name, name_len);
     if(node_name == NULL) {
-        free(elem);
+        json_free(elem);
         return NULL;
     }
     elem->name = node_name;
+    elem->name_len = strlen(node_name);
+    elem->string_len = 0;
 
     switch(elem->type) {
         case NUMBER:
@@ -89,11 +212,12 @@ struct json_value *create_json_value(JSON_TYPE type, char *name, int name_len, v
         case STRING:
             node_value = escape_string(value, value_len);
             if(node_value == NULL && value_len != 0) {
-                free(elem->name);
-                free(elem);
+                json_free(elem->name);
+                json_free(elem);
                 return NULL;
             }
             elem->value.string = node_value;
+            elem->string_len = node_value == NULL ? 0 : strlen(node_value);
             break;
         case FLOAT:
             elem->value.float_decimal = *(float *)value;
@@ -106,6 +230,7 @@ struct json_value *create_json_value(JSON_TYPE type, char *name, int name_len, v
             break;
         case OBJECT:
             elem->value.children = NULL;
+            elem->tail = NULL;
             break;
         case BOOLEAN:
             elem->value.number = *(int *)value;
@@ -115,16 +240,81 @@ struct json_value *create_json_value(JSON_TYPE type, char *name, int name_len, v
     return elem;
 }
 
-struct json_value *init_json_value(JSON_TYPE type, char *name, void *value)
+static struct json_value *alloc_json_value(struct json_parser *parser)
+{
+    if(parser->arena != NULL) {
+        return (struct json_value *)json_arena_alloc(parser->arena, sizeof(struct json_value));
+    }
+
+    return (struct json_value *)json_malloc(sizeof(struct json_value));
+}
+
+const struct json_allocator *json_parser_allocator(struct json_parser *parser)
+{
+    return parser->arena != NULL ? parser->arena->allocator : NULL;
+}
+
+char *json_parser_strndup(struct json_parser *parser, char *str, size_t len)
+{
+    if(parser->flags & JSON_PARSE_ZERO_COPY) {
+        return str;
+    }
+
+    if(parser->arena != NULL) {
+        return json_arena_strndup(parser->arena, str, len);
+    }
+
+    return json_strndup(str, len);
+}
+
+char *json_parser_key(struct json_parser *parser, char *str, size_t len)
+{
+    if(parser->keys != NULL) {
+        return json_keys_intern(parser->keys, str, len);
+    }
+
+    return json_parser_strndup(parser, str, len);
+}
+
+/* interned names are shared, so only arena roots, which never free a name on its own, take them */
+struct json_keys *json_root_keys(struct json_root *root)
+{
+    return root->arena != NULL ? root->keys : NULL;
+}
+
+size_t json_root_max_depth(struct json_root *root)
+{
+    return root->max_depth == 0 ? JSON_PARSE_DEPTH_MAX : root->max_depth;
+}
+
+void discard_json_string(struct json_parser *parser, char *str)
+{
+    if(parser->arena == NULL) {
+        json_free(str);
+    }
+}
+
+void discard_json_value(struct json_parser *parser, struct json_value *value)
 {
-    struct json_value *value_node = (struct json_value *)malloc(sizeof(*value_node));
+    if(parser->arena == NULL) {
+        release_json_value(value);
+    }
+}
+
+struct json_value *init_json_value(struct json_parser *parser, JSON_TYPE type, char *name, size_t name_len, void *value, size_t value_len)
+{
+    struct json_value *value_node = alloc_json_value(parser);
     if(value_node  == NULL) {
         return NULL;
     }
+    JSON_STAT_ADD(nodes[type], 1);
 
     value_node->type = type;
     value_node->name = name;
+    value_node->name_len = name_len;
+    value_node->string_len = 0;
     value_node->anonymous = 0;
+    value_node->index = NULL;
     value_node->next = NULL;
     switch(type) {
         case NUMBER:
@@ -132,6 +322,7 @@ struct json_value *init_json_value(JSON_TYPE type, char *name, void *value)
         break;
         case STRING:
             value_node->value.string = (char *)value;
+            value_node->string_len = value_len;
         break;
         case FLOAT:
             value_node->value.float_decimal = *(float *)value;
@@ -144,6 +335,7 @@ struct json_value *init_json_value(JSON_TYPE type, char *name, void *value)
         break;
         case OBJECT:
             value_node->value.children = NULL;
+            value_node->tail = NULL;
         break;
         case BOOLEAN:
             value_node->value.boolean = *(int *)value;
@@ -155,7 +347,7 @@ struct json_value *init_json_value(JSON_TYPE type, char *name, void *value)
 
 struct json_value *create_json_string(char *name, char *value)
 {
-    int name_len, value_len;
+    size_t name_len, value_len;
     if(name == NULL) {
         name_len = 0;
     } else {
@@ -177,7 +369,7 @@ struct json_value *create_json_boolean(char *name, int value)
         return NULL;
     }
 
-    int name_len = strlen(name);
+    size_t name_len = strlen(name);
     if(name_len == 0) {
         return NULL;
     }
@@ -191,7 +383,7 @@ struct json_value *create_json_number(char *name, long long value)
         return NULL;
     }
 
-    int name_len = strlen(name);
+    size_t name_len = strlen(name);
     if(name_len == 0) {
         return NULL;
     }
@@ -205,7 +397,7 @@ struct json_value *create_json_float(char *name, float value)
         return NULL;
     }
 
-    int name_len = strlen(name);
+    size_t name_len = strlen(name);
     if(name_len == 0) {
         return NULL;
     }
@@ -219,7 +411,7 @@ struct json_value *create_json_double(char *name, double value)
         return NULL;
     }
 
-    int name_len = strlen(name);
+    size_t name_len = strlen(name);
     if(name_len == 0) {
         return NULL;
     }
@@ -233,7 +425,7 @@ struct json_value *create_json_object(char *name)
         return NULL;
     }
 
-    int name_len = strlen(name);
+    size_t name_len = strlen(name);
     if(name_len == 0) {
         return NULL;
     }
@@ -247,7 +439,7 @@ struct json_value *create_json_array(char *name)
         return NULL;
     }
 
-    int name_len = strlen(name);
+    size_t name_len = strlen(name);
     if(name_len == 0) {
         return NULL;
     }
@@ -255,384 +447,886 @@ struct json_value *create_json_array(char *name)
     return create_json_value(ARRAY, name, name_len, NULL, 0);
 }
 
-int json_value_insert_child(struct json_value *parent, struct json_value *child)
+/* makes room for one more child; a vector carved from an arena grows into a fresh copy from the same arena */
+static int reserve_json_vector(struct json_vector **vector)
 {
-    if(parent == NULL || child == NULL) {
+    struct json_vector *items = *vector;
+    if(items != NULL && items->count < items->cap) {
+        return JSON_SUCCEED;
+    }
+
+    size_t cap = items == NULL || items->cap < 4 ? 4 : items->cap * 2;
+    size_t size = sizeof(*items) + cap * sizeof(items->items[0]);
+    struct json_vector *grown = NULL;
+    if(items == NULL) {
+        grown = (struct json_vector *)json_malloc(size);
+        if(grown != NULL) {
+            grown->count = 0;
+            grown->arena = NULL;
+        }
+    } else if(items->arena == NULL) {
+        grown = (struct json_vector *)json_realloc(items, size);
+    } else {
+        grown = (struct json_vector *)json_arena_alloc(items->arena, size);
+        if(grown != NULL) {
+            memcpy(grown->items, items->items, items->count * sizeof(items->items[0]));
+            grown->count = items->count;
+            grown->arena = items->arena;
+        }
+    }
+    if(grown == NULL) {
         return JSON_FAILURE;
     }
 
-    if(parent->type == ARRAY || parent->type == OBJECT) {
-        child->next = parent->value.children;
+    grown->cap = cap;
+    *vector = grown;
+
+    return JSON_SUCCEED;
+}
+
+void json_value_link(struct json_value *parent, struct json_value *child, struct json_value **last)
+{
+    child->next = NULL;
+    if(*last == NULL) {
         parent->value.children = child;
+    } else {
+        (*last)->next = child;
+    }
+    *last = child;
 
-        if(parent->type == ARRAY) {
-            child->anonymous = 1;
-        }
+    if(parent->type == ARRAY) {
+        child->anonymous = 1;
+    }
+}
+
+int json_value_collect(struct json_parser *parser, struct json_value *parent)
+{
+    struct json_value *child = NULL;
+    size_t count = 0;
+    if(parent->type != ARRAY) {
+        return JSON_SUCCEED;
+    }
 
+    for(child = parent->value.children; child != NULL; child = child->next) {
+        count++;
+    }
+    /* an empty array in an arena still gets a vector, so whatever is appended later lands in that arena */
+    if(count == 0 && parser->arena == NULL) {
         return JSON_SUCCEED;
     }
 
-    return JSON_FAILURE;
+    size_t size = sizeof(struct json_vector) + count * sizeof(struct json_value *);
+    struct json_vector *items = NULL;
+    if(parser->arena != NULL) {
+        items = (struct json_vector *)json_arena_alloc(parser->arena, size);
+    } else {
+        items = (struct json_vector *)json_malloc(size);
+    }
+    if(items == NULL) {
+        return JSON_FAILURE;
+    }
+
+    items->count = 0;
+    items->cap = count;
+    items->arena = parser->arena;
+    for(child = parent->value.children; child != NULL; child = child->next) {
+        items->items[items->count++] = child;
+    }
+    parent->items = items;
+
+    return JSON_SUCCEED;
 }
 
-int json_value_serialize(struct json_value *elem, struct varstr *string)
+int json_value_insert_child(struct json_value *parent, struct json_value *child)
 {
-    if(elem == NULL || string == NULL) {
+    struct json_value *last = NULL;
+    if(parent == NULL || child == NULL) {
+        return JSON_FAILURE;
+    }
+
+    if(parent->type == ARRAY) {
+        if(reserve_json_vector(&parent->items) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        struct json_vector *items = parent->items;
+        if(items->count != 0) {
+            last = items->items[items->count - 1];
+        }
+        json_value_link(parent, child, &last);
+        items->items[items->count++] = child;
+        return JSON_SUCCEED;
+    }
+
+    if(parent->type != OBJECT) {
         return JSON_FAILURE;
     }
 
-    char buffer[JSON_MAX_SIZE] = {0};
-    memset(buffer, 0, JSON_MAX_SIZE);
+    last = parent->tail;
+    if(last == NULL) {
+        for(last = parent->value.children; last != NULL && last->next != NULL;) {
+            last = last->next;
+        }
+    }
+    json_value_link(parent, child, &last);
+    parent->tail = last;
+
+    if(parent->index != NULL && json_index_insert(parent->index, child) != JSON_SUCCEED) {
+        release_json_index(parent->index);
+        parent->index = NULL;
+    }
+
+    return JSON_SUCCEED;
+}
+
+size_t json_value_count(struct json_value *array)
+{
+    if(array == NULL || array->type != ARRAY || array->items == NULL) {
+        return 0;
+    }
+
+    return array->items->count;
+}
 
-    int first = 1;
+void *json_stack_grow(void *frames, void *inline_frames, size_t *cap, size_t size, const struct json_allocator *allocator)
+{
+    size_t grown_cap = *cap * 2;
+    void *grown = NULL;
+
+    if(frames == inline_frames) {
+        grown = json_allocator_alloc(allocator, grown_cap * size);
+        if(grown != NULL) {
+            memcpy(grown, frames, *cap * size);
+        }
+    } else {
+        grown = json_allocator_realloc(allocator, frames, grown_cap * size);
+    }
+    if(grown != NULL) {
+        *cap = grown_cap;
+    }
+
+    return grown;
+}
 
+/* an open container being written: the child to write next, and whether one came before */
+struct serialize_frame {
+    /* objects, and arrays built without a vector, follow the sibling list */
+    struct json_value *next;
+    /* arrays step through their vector */
+    struct json_value **items;
+    size_t left;
+    JSON_TYPE type;
+    int started;
+};
+
+/* the container's next child to write, or NULL once it is done */
+static struct json_value *serialize_next(struct serialize_frame *frame)
+{
     struct json_value *child = NULL;
+    if(frame->items != NULL) {
+        if(frame->left > 0) {
+            child = *frame->items++;
+            frame->left--;
+        }
+    } else if(frame->next != NULL) {
+        child = frame->next;
+        frame->next = child->next;
+    }
+
+    return child;
+}
+
+/* a scalar, or the opening bracket of a container */
+static void serialize_head(struct json_value *elem, struct varstr *string)
+{
+    char buffer[JSON_NUMBER_BUFFER_SIZE];
 
     if(elem->anonymous != 1) {
-        append_varstr(string, "\"", 1);
-        append_varstr(string, elem->name, strlen(elem->name));
-        append_varstr(string, "\":", 2);
+        append_varstr_char(string, '\"');
+        append_varstr(string, elem->name, elem->name_len);
+        append_varstr_literal(string, "\":");
     }
 
     switch(elem->type) {
     case NUMBER:
-        snprintf(buffer, JSON_MAX_SIZE, "%lld", elem->value.number);
-        append_varstr(string, buffer, strlen(buffer));
+        append_varstr(string, buffer, json_format_integer(elem->value.number, buffer));
         break;
     case DOUBLE:
-        snprintf(buffer, JSON_MAX_SIZE, "%f", elem->value.double_decimal);
-        append_varstr(string, buffer, strlen(buffer));
+        append_varstr(string, buffer, json_format_double(elem->value.double_decimal, buffer));
         break;
     case FLOAT:
-        snprintf(buffer, JSON_MAX_SIZE, "%f", elem->value.float_decimal);
-        append_varstr(string, buffer, strlen(buffer));
+        append_varstr(string, buffer, json_format_float(elem->value.float_decimal, buffer));
         break;
     case BOOLEAN:
         if(elem->value.boolean == 0) {
-            append_varstr(string, json_false, strlen(json_false));
+            append_varstr_literal(string, "false");
         } else {
-            append_varstr(string, json_true, strlen(json_true));
+            append_varstr_literal(string, "true");
         }
         break;
     case STRING:
-        append_varstr(string, "\"", 1);
+        append_varstr_char(string, '\"');
         if(elem->value.string != NULL) {
-            append_varstr(string, elem->value.string, strlen(elem->value.string));
+            append_varstr(string, elem->value.string, elem->string_len);
         }
-        append_varstr(string, "\"", 1);
+        append_varstr_char(string, '\"');
         break;
     case OBJECT:
-        append_varstr(string, "{", 1);
-        child = elem->value.children;
-        while(child != NULL) {
-            if( !first ) {
-                append_varstr(string, ",", 1);
+        append_varstr_char(string, '{');
+        break;
+    case ARRAY:
+        append_varstr_char(string, '[');
+        break;
+    }
+}
+
+/* containers are followed on an explicit stack, so nesting costs no C stack */
+int json_value_serialize(struct json_value *elem, struct varstr *string)
+{
+    if(elem == NULL || string == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct serialize_frame inline_frames[JSON_WALK_INLINE_DEPTH];
+    struct serialize_frame *frames = inline_frames, *grown = NULL;
+    size_t depth = 0, cap = JSON_WALK_INLINE_DEPTH;
+    int res = JSON_FAILURE;
+
+    for(;;) {
+        serialize_head(elem, string);
+        if(elem->type == OBJECT || elem->type == ARRAY) {
+            if(depth == cap) {
+                grown = (struct serialize_frame *)json_stack_grow(frames, inline_frames, &cap, sizeof(*frames), NULL);
+                if(grown == NULL) {
+                    goto done;
+                }
+                frames = grown;
             }
-            json_value_serialize(child, string);
-            if( first ) {
-                first = 0;
+            frames[depth].next = elem->value.children;
+            frames[depth].items = NULL;
+            frames[depth].left = 0;
+            if(elem->type == ARRAY && elem->items != NULL) {
+                frames[depth].items = elem->items->items;
+                frames[depth].left = elem->items->count;
             }
-            child = child->next;
+            frames[depth].type = elem->type;
+            frames[depth].started = 0;
+            depth++;
         }
-        append_varstr(string, "}", 1);
-        break;
-    case ARRAY:
-        append_varstr(string, "[", 1);
-        child = elem->value.children;
-        while(child != NULL) {
-            if( !first ) {
-                append_varstr(string, ",", 1);
+
+        /* close whatever is finished; the next child, if any, is written by the loop */
+        elem = NULL;
+        while(depth > 0 && elem == NULL) {
+            struct serialize_frame *frame = &frames[depth - 1];
+            elem = serialize_next(frame);
+            if(elem == NULL) {
+                append_varstr_char(string, frame->type == OBJECT ? '}' : ']');
+                depth--;
+                continue;
             }
-            json_value_serialize(child, string);
-            if( first ) {
-                first = 0;
+            if(frame->started) {
+                append_varstr_char(string, ',');
             }
-            child = child->next;
+            frame->started = 1;
+        }
+        if(elem == NULL) {
+            break;
         }
-        append_varstr(string, "]", 1);
-        break;
     }
+    res = JSON_SUCCEED;
 
-    return JSON_SUCCEED;
+done:
+    if(frames != inline_frames) {
+        json_free(frames);
+    }
+
+    return res;
 }
 
-int extract_string(char *data, int len, char **str)
+/* finds the string starting at the first non-blank byte; returns the bytes consumed through the closing quote */
+static size_t lex_string(char *data, size_t len, size_t *start, size_t *str_len)
 {
+    size_t i = 0;
+
     if(data == NULL || len == 0) {
-        *str = NULL;
         return 0;
     }
 
-    int i = 0, j = 0;
-
-    while(data[i] == ' ' || data[i] == '\n' || data[i] == '\t' || data[i] == '\r') {
-        i++;
-    }
-
-    if(data[i++] != '\"') {
-        *str = NULL;
+    i += json_skip_whitespace(data, len);
+    if(i >= len || data[i++] != '\"') {
         return 0;
     }
 
-    char buffer[JSON_MAX_SIZE];
-    memset(buffer, 0, JSON_MAX_SIZE);
-
-    int done = 0;
-    int prev_is_esc = 0;
-    
+    *start = i;
     while(i < len) {
+        i += json_scan_string(data + i, len - i);
+        if(i >= len) {
+            break;
+        }
+
         if(data[i] == '\\') {
-	    if(!prev_is_esc) {
-	        prev_is_esc = 1;
-                buffer[j++] = data[i++];
-                continue;
-	    } else {
-	        prev_is_esc = 0;
-		buffer[j++] = data[i++];
-		continue;
-	    }
+            i += 2;
+            continue;
         }
-        
+
+        if(data[i] == '\"') {
+            *str_len = i - *start;
+            return i + 1;
+        }
+
         if(data[i] == '\n' || data[i] == '\r' || data[i] == '\t' || data[i] == '\b') {
-	    if(!prev_is_esc) {
-	        done = 0;
-		break;
-	    } else {
-	        prev_is_esc = 0;
-	        buffer[j++] = data[i++];
-		continue;
-	    }
-	}
-
-	if(data[i] == '\"') {
-	    if(!prev_is_esc) {
-	        i++;
-	        done = 1;
-		break;
-	    } else {
-	        prev_is_esc = 0;
-	        buffer[j++] = data[i++];
-		continue;
-	    }
-	}
-	
-	prev_is_esc = 0;
-
-        buffer[j++] = data[i++];
-    }
-    
-    if(done == 0) {
-        *str = NULL;
+            break;
+        }
+
+        i++;
+    }
+
+    return 0;
+}
+
+static size_t extract_text(struct json_parser *parser, char *data, size_t len, char **str, size_t *str_len, int key)
+{
+    size_t start = 0;
+    size_t used = lex_string(data, len, &start, str_len);
+
+    *str = NULL;
+    if(used == 0) {
         return 0;
     }
 
-    char *res = strndup(buffer, JSON_MAX_SIZE);
-    if(res != NULL) {
-        *str = res;
+    char *res = key ? json_parser_key(parser, data + start, *str_len) : json_parser_strndup(parser, data + start, *str_len);
+    if(res == NULL) {
+        return 0;
     }
 
-    return i;
+    *str = res;
+
+    return used;
 }
 
-int json_value_deserialize(struct json_value **value, char *rawdata, int maxlen, int anonymous)
+size_t extract_string(struct json_parser *parser, char *data, size_t len, char **str, size_t *str_len)
 {
-    if(rawdata == NULL || maxlen == 0) {
-        return JSON_FAILURE;
-    }
+    return extract_text(parser, data, len, str, str_len, 0);
+}
 
-    struct json_value *node = NULL, *child = NULL;
-    char *node_name = NULL, *node_value = NULL;
+size_t json_lex_scalar(char *data, size_t len, struct json_scalar *scalar)
+{
+    struct json_number number;
+    size_t used = 0;
 
-    int len = 0, i = 0, j = 0;
-    JSON_TYPE type = NUMBER;
+    if(len == 0) {
+        return 0;
+    }
 
-    if(!anonymous) {
-        len = extract_string(rawdata, maxlen, &node_name);
-        if(len == 0) {
-            return JSON_FAILURE;
+    if(data[0] == '-' || (data[0] <= '9' && data[0] >= '0')) {
+        used = json_parse_number(data, len, &number);
+        if(used == 0) {
+            return 0;
         }
-    }
-    i += len;
 
-    while(rawdata[i] == '\n' || rawdata[i] == ' ' || rawdata[i] == '\r' || rawdata[i] == '\t') {
-        i++;
+        if(number.integer) {
+            scalar->type = NUMBER;
+            scalar->value.number = number.number;
+        } else {
+            scalar->type = DOUBLE;
+            scalar->value.double_decimal = number.decimal;
+        }
+
+        return used;
     }
 
-    if(!anonymous) {
-        if(rawdata[i++] != ':') {
-            free(node_name);
-            return JSON_FAILURE;
-        }
+    if(len >= 4 && !strncmp(data, json_true, 4)) {
+        scalar->type = BOOLEAN;
+        scalar->value.boolean = jtrue;
+        return 4;
     }
 
-    while(rawdata[i] == '\n' || rawdata[i] == ' ' || rawdata[i] == '\r' || rawdata[i] == '\t') {
-        i++;
+    if(len >= 5 && !strncmp(data, json_false, 5)) {
+        scalar->type = BOOLEAN;
+        scalar->value.boolean = jfalse;
+        return 5;
     }
 
-    switch(rawdata[i]) {
-    case '[':
-        i++;
-        while(rawdata[i] == ' ' || rawdata[i] == '\n' || rawdata[i] == '\r' || rawdata[i] == '\t') {
-            i++;
-        }
+    return 0;
+}
 
-        node = init_json_value(ARRAY, node_name, NULL);
-        if(node == NULL) {
-            free(node_name);
-            return JSON_FAILURE;
-        }
+static struct json_value *init_json_scalar(struct json_parser *parser, struct json_scalar *scalar, char *node_name, size_t name_len)
+{
+    if(scalar->type == BOOLEAN) {
+        return init_json_value(parser, BOOLEAN, node_name, name_len, &scalar->value.boolean, 0);
+    }
 
-        if(rawdata[i] == ']') {
-            *value = node;
-            i++;
-            break;
-        }
+    return init_json_value(parser, scalar->type, node_name, name_len, &scalar->value, 0);
+}
 
-        while(i < maxlen) {
-            len = json_value_deserialize(&child, rawdata + i, maxlen - i, 1);
-            if(len == 0) {
-                release_json_value(node);
-                return JSON_FAILURE;
-            }
-            i += len;
-            json_value_insert_child(node, child);
+size_t json_parse_scalar(struct json_parser *parser, struct json_value **value, char *rawdata, size_t maxlen, char *node_name, size_t name_len)
+{
+    struct json_scalar scalar;
 
-            if(rawdata[i] == ',') {
-                i++;
-            }else if(rawdata[i] == ']') {
-                break;
-            }
+    if(maxlen == 0) {
+        return 0;
+    }
 
-            while(rawdata[i] == ' ' || rawdata[i] == '\n' || rawdata[i] == '\r' || rawdata[i] == '\t') {
-                i++;
-            }
-        }
-        *value = node;
-        i++;
-        break;
-    case '{':
-        i++;
-        while(rawdata[i] == ' ' || rawdata[i] == '\n' || rawdata[i] == '\r' || rawdata[i] == '\t') {
-            i++;
-        }
+    size_t len = json_lex_scalar(rawdata, maxlen, &scalar);
+    if(len == 0) {
+        return 0;
+    }
 
-        node = init_json_value(OBJECT, node_name, NULL);
-        if(node == NULL) {
-            free(node_name);
-            return JSON_FAILURE;
+    struct json_value *node = init_json_scalar(parser, &scalar, node_name, name_len);
+    if(node == NULL) {
+        return 0;
+    }
+
+    *value = node;
+
+    return len;
+}
+
+static int scalar_ends(char *data, size_t len, size_t end)
+{
+    if(end >= len) {
+        return 1;
+    }
+
+    switch(data[end]) {
+    case ' ': case '\n': case '\r': case '\t':
+    case ',': case ':': case '}': case ']': case '{': case '[':
+        return 1;
+    }
+
+    return 0;
+}
+
+struct json_sax {
+    const struct json_sax_handler *handler;
+    void *ctx;
+    char *data;
+    size_t len;
+    /* containers the walk may open before it gives up */
+    size_t max_depth;
+    /* where a stack deeper than SAX_INLINE_DEPTH comes from; NULL means the global allocator */
+    const struct json_allocator *allocator;
+};
+
+#define SAX_EMIT(sax, event, ...) ((sax)->handler->event == NULL || (sax)->handler->event((sax)->ctx, ##__VA_ARGS__))
+
+/* open containers a walk tracks on the C stack; only deeper documents move to the heap */
+#define SAX_INLINE_DEPTH 64
+
+static size_t sax_skip(struct json_sax *sax, size_t i)
+{
+    if(i < sax->len) {
+        i += json_skip_whitespace(sax->data + i, sax->len - i);
+    }
+
+    return i;
+}
+
+/* a member name and its colon; returns the index of the value, or 0 */
+static size_t sax_key(struct json_sax *sax, size_t i)
+{
+    size_t start = 0, str_len = 0;
+    size_t used = lex_string(sax->data + i, sax->len - i, &start, &str_len);
+    if(used == 0 || !SAX_EMIT(sax, key, sax->data + i + start, str_len)) {
+        return 0;
+    }
+
+    i = sax_skip(sax, i + used);
+    if(i >= sax->len || sax->data[i] != ':') {
+        return 0;
+    }
+
+    return i + 1;
+}
+
+/*
+ * Walks the value at i and returns the index just past it, or 0. Nesting is
+ * followed on an explicit stack holding one byte per open container, the
+ * close it waits for, so hostile depth costs neither C stack nor more than
+ * max_depth bytes: the container that would go past it fails before any
+ * event for it is sent.
+ */
+static size_t sax_value(struct json_sax *sax, size_t i)
+{
+    char frames[SAX_INLINE_DEPTH];
+    char *stack = frames, *grown = NULL;
+    size_t depth = 0, cap = SAX_INLINE_DEPTH, res = 0;
+    size_t start = 0, str_len = 0, used = 0;
+    struct json_scalar scalar;
+    char close;
+    int ok;
+
+    for(;;) {
+        i = sax_skip(sax, i);
+        if(i >= sax->len) {
+            goto done;
         }
 
-        if(rawdata[i] == '}') {
-            *value = node;
-            i++;
+        switch(sax->data[i]) {
+        case '{':
+        case '[':
+            close = sax->data[i] == '{' ? '}' : ']';
+            if(depth == sax->max_depth) {
+                goto done;
+            }
+            if(depth == cap) {
+                grown = (char *)json_stack_grow(stack, frames, &cap, 1, sax->allocator);
+                if(grown == NULL) {
+                    goto done;
+                }
+                stack = grown;
+            }
+            ok = close == '}' ? SAX_EMIT(sax, start_object) : SAX_EMIT(sax, start_array);
+            if(!ok) {
+                goto done;
+            }
+            stack[depth++] = close;
+
+            /* an empty container goes straight to being closed below */
+            i = sax_skip(sax, i + 1);
+            if(i < sax->len && sax->data[i] == close) {
+                break;
+            }
+            if(close == '}' && (i = sax_key(sax, i)) == 0) {
+                goto done;
+            }
+            continue;
+        case '\"':
+            used = lex_string(sax->data + i, sax->len - i, &start, &str_len);
+            if(used == 0 || !SAX_EMIT(sax, string, sax->data + i + start, str_len)) {
+                goto done;
+            }
+            i += used;
+            break;
+        default:
+            used = json_lex_scalar(sax->data + i, sax->len - i, &scalar);
+            if(used == 0 || !scalar_ends(sax->data, sax->len, i + used)) {
+                goto done;
+            }
+
+            switch(scalar.type) {
+            case BOOLEAN:
+                ok = SAX_EMIT(sax, boolean, scalar.value.boolean);
+                break;
+            case NUMBER:
+                ok = SAX_EMIT(sax, number, scalar.value.number);
+                break;
+            default:
+                ok = SAX_EMIT(sax, decimal, scalar.value.double_decimal);
+                break;
+            }
+            if(!ok) {
+                goto done;
+            }
+            i += used;
             break;
         }
 
-        while(i < maxlen) {
-            len = json_value_deserialize(&child, rawdata + i, maxlen - i, 0);
-            if(len == 0) {
-                release_json_value(node);
-                return JSON_FAILURE;
+        /* a value is complete: close the containers ending behind it, up to the next comma */
+        for(;;) {
+            if(depth == 0) {
+                res = i;
+                goto done;
             }
-            i += len;
-            json_value_insert_child(node, child);
 
-            if(rawdata[i] == ',') {
+            i = sax_skip(sax, i);
+            if(i >= sax->len) {
+                goto done;
+            }
+            if(sax->data[i] == ',') {
                 i++;
-            }else if(rawdata[i] == '}') {
+                if(stack[depth - 1] == '}' && (i = sax_key(sax, i)) == 0) {
+                    goto done;
+                }
                 break;
             }
+            if(sax->data[i] != stack[depth - 1]) {
+                goto done;
+            }
 
-            while(rawdata[i] == ' ' || rawdata[i] == '\n' || rawdata[i] == '\r' || rawdata[i] == '\t') {
-                i++;
+            i++;
+            ok = stack[--depth] == '}' ? SAX_EMIT(sax, end_object) : SAX_EMIT(sax, end_array);
+            if(!ok) {
+                goto done;
             }
         }
-        *value = node;
-        i++;
-        break;
-    case '\"':
-        len = extract_string(rawdata + i, maxlen, &node_value);
-        if(len == 0) {
-            free(node_name);
-            return JSON_FAILURE;
+    }
+
+done:
+    if(stack != frames) {
+        json_allocator_free(sax->allocator, stack);
+    }
+
+    return res;
+}
+
+int json_sax_parse_allocator(const char *data, size_t len, const struct json_sax_handler *handler, void *ctx, size_t max_depth,
+                             const struct json_allocator *allocator)
+{
+    if(data == NULL || handler == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct json_sax sax = { handler, ctx, (char *)data, len, max_depth == 0 ? JSON_PARSE_DEPTH_MAX : max_depth, allocator };
+
+    size_t i = sax_value(&sax, 0);
+    if(i == 0 || sax_skip(&sax, i) != len) {
+        return JSON_FAILURE;
+    }
+
+    return JSON_SUCCEED;
+}
+
+int json_sax_parse(const char *data, size_t len, const struct json_sax_handler *handler, void *ctx)
+{
+    return json_sax_parse_depth(data, len, handler, ctx, 0);
+}
+
+int json_sax_parse_depth(const char *data, size_t len, const struct json_sax_handler *handler, void *ctx, size_t max_depth)
+{
+    return json_sax_parse_allocator(data, len, handler, ctx, max_depth, NULL);
+}
+
+/* an open container and its last child so far; node is NULL for the root's members */
+struct parse_frame {
+    struct json_value *node;
+    struct json_value *last;
+};
+
+/* frames a parse carries itself; only deeper documents put their stack on the heap */
+#define PARSE_INLINE_DEPTH 32
+
+/* the containers open around a DOM parse, innermost last */
+struct parse_stack {
+    struct parse_frame *frames;
+    size_t depth;
+    size_t cap;
+    /* the parser's, so a document's deep stacks come from its allocator too */
+    const struct json_allocator *allocator;
+    struct parse_frame inline_frames[PARSE_INLINE_DEPTH];
+};
+
+static void init_parse_stack(struct parse_stack *stack, struct json_parser *parser)
+{
+    stack->frames = stack->inline_frames;
+    stack->depth = 0;
+    stack->cap = PARSE_INLINE_DEPTH;
+    stack->allocator = json_parser_allocator(parser);
+}
+
+/* the new innermost frame, or NULL when out of memory */
+static struct parse_frame *parse_stack_push(struct parse_stack *stack, struct json_value *node)
+{
+    if(stack->depth == stack->cap) {
+        struct parse_frame *frames = (struct parse_frame *)json_stack_grow(stack->frames, stack->inline_frames, &stack->cap,
+                                                                           sizeof(*frames), stack->allocator);
+        if(frames == NULL) {
+            return NULL;
         }
-        i += len;
-        node = init_json_value(STRING, node_name, node_value);
-        if(node == NULL) {
-            free(node_name);
-            free(node_value);
+        stack->frames = frames;
+    }
+
+    struct parse_frame *frame = &stack->frames[stack->depth++];
+    frame->node = node;
+    frame->last = NULL;
+    JSON_STAT_DEPTH(stack->depth);
+
+    return frame;
+}
+
+static void release_parse_stack(struct parse_stack *stack)
+{
+    if(stack->frames != stack->inline_frames) {
+        json_allocator_free(stack->allocator, stack->frames);
+    }
+}
+
+/* links node into the innermost container, or onto root when that is the root object */
+static void parse_frame_attach(struct json_root *root, struct parse_frame *frame, struct json_value *node)
+{
+    if(frame->node == NULL) {
+        json_root_insert_value(root, node);
+    } else {
+        json_value_link(frame->node, node, &frame->last);
+    }
+}
+
+/*
+ * The tree builder is a sax client; the outermost object maps onto the json_root.
+ * Without a root it builds one detached value instead and leaves it in result.
+ */
+struct json_tree_builder {
+    struct json_parser *parser;
+    struct json_root *root;
+    char *key;
+    size_t key_len;
+    struct json_value *result;
+    struct parse_stack stack;
+};
+
+static void init_builder(struct json_tree_builder *builder, struct json_parser *parser, struct json_root *root)
+{
+    builder->parser = parser;
+    builder->root = root;
+    builder->key = NULL;
+    builder->key_len = 0;
+    builder->result = NULL;
+    init_parse_stack(&builder->stack, parser);
+}
+
+static struct json_value *builder_attach(struct json_tree_builder *builder, struct json_value *node)
+{
+    if(node == NULL) {
+        return NULL;
+    }
+
+    /* the node owns the key now, even if it is a view */
+    builder->key = NULL;
+    builder->key_len = 0;
+
+    if(builder->stack.depth == 0) {
+        builder->result = node;
+        return node;
+    }
+
+    parse_frame_attach(builder->root, &builder->stack.frames[builder->stack.depth - 1], node);
+
+    return node;
+}
+
+static void release_builder(struct json_tree_builder *builder)
+{
+    discard_json_string(builder->parser, builder->key);
+    release_parse_stack(&builder->stack);
+}
 
+static int builder_container(struct json_tree_builder *builder, JSON_TYPE type)
+{
+    if(builder->stack.depth == 0 && builder->root != NULL) {
+        if(type != OBJECT) {
             return JSON_FAILURE;
         }
+        return parse_stack_push(&builder->stack, NULL) != NULL;
+    }
 
-        while(rawdata[i] == ' ' || rawdata[i] == '\n' || rawdata[i] == '\r') {
-            i++;
-        }
+    struct json_value *node = init_json_value(builder->parser, type, builder->key, builder->key_len, NULL, 0);
+    if(builder_attach(builder, node) == NULL) {
+        return JSON_FAILURE;
+    }
 
-        *value = node;
-        break;
-    default:
-        j = i;
-        if(rawdata[i] <= '9' && rawdata[i] >= '0') {
-            while(rawdata[i] <= '9' && rawdata[i] >= '0') {
-                i++;
-            }
+    return parse_stack_push(&builder->stack, node) != NULL;
+}
 
-            if(rawdata[i] == '.') {
-                type = FLOAT;
-            }
+static int builder_start_object(void *ctx)
+{
+    return builder_container((struct json_tree_builder *)ctx, OBJECT);
+}
 
-            while(rawdata[i] <= '9' && rawdata[i] >= '0') {
-                i++;
-            }
+static int builder_start_array(void *ctx)
+{
+    return builder_container((struct json_tree_builder *)ctx, ARRAY);
+}
 
-            if(type == NUMBER) {
-                long long number = atoll(rawdata + j);
-                node = init_json_value(NUMBER, node_name, &number);
-                if(node == NULL) {
-                    free(node_name);
-                    return JSON_FAILURE;
-                }
-            } else {
-                float float_decimal = strtof(rawdata + j, NULL);
-                node = init_json_value(FLOAT, node_name, &float_decimal);
-                if(node == NULL) {
-                    free(node_name);
-                    return JSON_FAILURE;
-                }
-            }
+static int builder_end(void *ctx)
+{
+    struct json_tree_builder *builder = (struct json_tree_builder *)ctx;
+    struct json_value *node = builder->stack.frames[--builder->stack.depth].node;
 
-            *value = node;
-            break;
-        } else {
-            if(rawdata[i] == 't' && rawdata[i+1] == 'r' && rawdata[i+2] == 'u' && rawdata[i+3] == 'e') {
-                node = init_json_value(BOOLEAN, node_name, &jtrue);
-                i += 4;
-            }
+    return node == NULL ? JSON_SUCCEED : json_value_collect(builder->parser, node);
+}
 
-            if(rawdata[i] == 'f' && rawdata[i+1] == 'a' && rawdata[i+3] == 'l' && rawdata[i+3] == 's' && rawdata[i+4] == 'e') {
-                node = init_json_value(BOOLEAN, node_name, &jfalse);
-                i += 5;
-            }
-        }
+static int builder_key(void *ctx, const char *key, size_t len)
+{
+    struct json_tree_builder *builder = (struct json_tree_builder *)ctx;
+
+    builder->key = json_parser_key(builder->parser, (char *)key, len);
+    builder->key_len = len;
+
+    return builder->key != NULL;
+}
+
+static int builder_string(void *ctx, const char *value, size_t len)
+{
+    struct json_tree_builder *builder = (struct json_tree_builder *)ctx;
+
+    char *node_value = json_parser_strndup(builder->parser, (char *)value, len);
+    if(node_value == NULL) {
+        return JSON_FAILURE;
     }
 
-    return i;
+    struct json_value *node = init_json_value(builder->parser, STRING, builder->key, builder->key_len, node_value, len);
+    if(builder_attach(builder, node) == NULL) {
+        discard_json_string(builder->parser, node_value);
+        return JSON_FAILURE;
+    }
+
+    return JSON_SUCCEED;
+}
+
+static int builder_scalar(struct json_tree_builder *builder, struct json_scalar *scalar)
+{
+    struct json_value *node = init_json_scalar(builder->parser, scalar, builder->key, builder->key_len);
+
+    return builder_attach(builder, node) != NULL;
+}
+
+static int builder_number(void *ctx, long long value)
+{
+    struct json_scalar scalar;
+    scalar.type = NUMBER;
+    scalar.value.number = value;
+
+    return builder_scalar((struct json_tree_builder *)ctx, &scalar);
+}
+
+static int builder_decimal(void *ctx, double value)
+{
+    struct json_scalar scalar;
+    scalar.type = DOUBLE;
+    scalar.value.double_decimal = value;
+
+    return builder_scalar((struct json_tree_builder *)ctx, &scalar);
 }
 
+static int builder_boolean(void *ctx, int value)
+{
+    struct json_scalar scalar;
+    scalar.type = BOOLEAN;
+    scalar.value.boolean = value;
+
+    return builder_scalar((struct json_tree_builder *)ctx, &scalar);
+}
 
+static const struct json_sax_handler json_tree_handler = {
+    builder_start_object,
+    builder_end,
+    builder_start_array,
+    builder_end,
+    builder_key,
+    builder_string,
+    builder_number,
+    builder_decimal,
+    builder_boolean
+};
+
+/* nodes waiting to be freed are chained through their own next links, so nesting costs no stack at all */
 void release_json_value(struct json_value *value)
 {
-    struct json_value *curr = NULL, *next = NULL;
-    if(value != NULL) {
-        if(value->name != NULL) {
-            free(value->name);
-            value->name = NULL;
+    struct json_value *pending = value, *curr = NULL, *last = NULL;
+    if(value == NULL) {
+        return;
+    }
+
+    value->next = NULL;
+    while(pending != NULL) {
+        curr = pending;
+        pending = curr->next;
+        if(curr->name != NULL) {
+            json_free(curr->name);
         }
-        switch(value->type) {
+        switch(curr->type) {
         case STRING:
-            if(value->value.string != NULL) {
-                free(value->value.string);
+            if(curr->value.string != NULL) {
+                json_free(curr->value.string);
             }
             break;
         case NUMBER:
@@ -642,34 +1336,71 @@ void release_json_value(struct json_value *value)
             break;
         case OBJECT:
         case ARRAY:
-            curr = value->value.children;
-            while(curr != NULL) {
-                next = curr->next;
-                release_json_value(curr);
-                curr = next;
+            if(curr->value.children != NULL) {
+                for(last = curr->value.children; last->next != NULL;) {
+                    last = last->next;
+                }
+                last->next = pending;
+                pending = curr->value.children;
+            }
+            if(curr->type == ARRAY && curr->items != NULL && curr->items->arena == NULL) {
+                json_free(curr->items);
+            }
+            if(curr->type == OBJECT && curr->index != NULL) {
+                release_json_index(curr->index);
             }
             break;
         }
-        free(value);
+        json_free(curr);
     }
 }
 
 struct json_root *create_json_root()
 {
-    struct json_root *root = (struct json_root *)malloc(sizeof(*root));
+    struct json_root *root = (struct json_root *)json_malloc(sizeof(*root));
     if(root != NULL) {
         root->elems = NULL;
+        root->last = NULL;
+        root->arena = NULL;
+        root->index = NULL;
+        root->keys = NULL;
+        root->max_depth = 0;
         return root;
     }
 
     return NULL;
 }
 
+struct json_root *init_json_root(struct json_arena *arena)
+{
+    struct json_root *root = (struct json_root *)json_arena_alloc(arena, sizeof(*root));
+    if(root != NULL) {
+        root->elems = NULL;
+        root->last = NULL;
+        root->arena = arena;
+        root->index = NULL;
+        root->keys = NULL;
+        root->max_depth = 0;
+    }
+
+    return root;
+}
+
 int json_root_insert_value(struct json_root *root, struct json_value *value)
 {
     if(root != NULL && value != NULL) {
-        value->next = root->elems;
-        root->elems = value;
+        value->next = NULL;
+        if(root->elems == NULL) {
+            root->elems = value;
+        } else {
+            root->last->next = value;
+        }
+        root->last = value;
+
+        if(root->index != NULL && json_index_insert(root->index, value) != JSON_SUCCEED) {
+            release_json_index(root->index);
+            root->index = NULL;
+        }
 
         return JSON_SUCCEED;
     }
@@ -677,21 +1408,17 @@ int json_root_insert_value(struct json_root *root, struct json_value *value)
     return JSON_FAILURE;
 }
 
-int json_serialize(json_root *root, struct varstr *string)
+static int serialize_root(json_root *root, struct varstr *string)
 {
-    if(root == NULL || string == NULL) {
-        return JSON_FAILURE;
-    }
-
     struct json_value *elem = NULL;
-    append_varstr(string, "{", 1);
+    append_varstr_char(string, '{');
 
     elem = root->elems;
     if(elem != NULL) {
         json_value_serialize(elem, string);
         elem = elem->next;
         while(elem != NULL) {
-            append_varstr(string, ",", 1);
+            append_varstr_char(string, ',');
             int res = json_value_serialize(elem, string);
             if(res != JSON_SUCCEED) {
                 return JSON_FAILURE;
@@ -700,110 +1427,830 @@ int json_serialize(json_root *root, struct varstr *string)
         }
     }
 
-    append_varstr(string, "}", 1);
+    append_varstr_char(string, '}');
 
     return JSON_SUCCEED;
 }
 
-int json_deserialize(struct json_root *root, struct varstr *string)
+int json_serialize(json_root *root, struct varstr *string)
 {
-    if(root == NULL || string == NULL || string->data == NULL) {
-        return JSON_FAILURE;
-    }
-
-    char *rawdata = string->data;
-    int len = string->len;
-
-    if(rawdata[0] == '{' && rawdata[1] == '}') {
-        return JSON_SUCCEED;
-    }
-
-    if(rawdata[0] != '{' || rawdata[len - 1] != '}') {
+    if(root == NULL || string == NULL) {
         return JSON_FAILURE;
     }
 
-    struct json_value *value = NULL;
-    int i = 1;
-    int offset = 0;
+    JSON_STAT_START(start);
+    int res = serialize_root(root, string);
+    JSON_STAT_STOP(serializes, serialize_ns, start);
 
-    while(i < len - 1) {
-        offset = json_value_deserialize(&value, rawdata + i, len - i, 0);
-        json_root_insert_value(root, value);
-        value = NULL;
-        i += offset;
+    return res;
+}
 
-        while( rawdata[i] == ' ' || rawdata[i] == '\r' || rawdata[i] == '\n' || rawdata[i] == '\t') {
-            i++;
-        }
+struct json_stage2 {
+    struct json_parser *parser;
+    char *data;
+    size_t len;
+    size_t *positions;
+    size_t count;
+    size_t cur;
+};
 
-        if(rawdata[i] == ',') {
-            i++;
-        }
+static char stage2_peek(struct json_stage2 *st)
+{
+    if(st->cur >= st->count) {
+        return '\0';
     }
 
-    return JSON_SUCCEED;
+    return st->data[st->positions[st->cur]];
 }
 
-int release_json_root(struct json_root *root)
+static char stage2_close(struct parse_frame *frame)
 {
-    if(root != NULL) {
-        struct json_value *curr = root->elems;
-        struct json_value *next = NULL;
-        while(curr != NULL) {
-            next = curr->next;
-            release_json_value(curr);
-            curr = next;
-        }
-
-        root->elems = NULL;
-        free(root);
-
-        return JSON_SUCCEED;
-    }
-
-    return JSON_FAILURE;
+    return frame->node == NULL || frame->node->type == OBJECT ? '}' : ']';
 }
 
-struct json_value *json_find_value_same_level(struct json_value *value, char *name)
+/* the value at cur, with the name it goes under; containers come back open and empty */
+static struct json_value *stage2_value(struct json_stage2 *st, char *name, size_t name_len)
 {
-    while(value != NULL && name != NULL) {
-        if(!strcasecmp(value->name, name)) {
-            return value;
-        }
-        value = value->next;
+    struct json_value *node = NULL;
+    char *node_value = NULL;
+    size_t value_len = 0;
+    size_t pos, len;
+
+    if(st->cur >= st->count) {
+        discard_json_string(st->parser, name);
+        return NULL;
     }
 
-    return NULL;
-}
+    pos = st->positions[st->cur];
+    switch(st->data[pos]) {
+    case '{':
+    case '[':
+        node = init_json_value(st->parser, st->data[pos] == '{' ? OBJECT : ARRAY, name, name_len, NULL, 0);
+        if(node == NULL) {
+            discard_json_string(st->parser, name);
+            return NULL;
+        }
+        break;
+    case '\"':
+        if(extract_string(st->parser, st->data + pos, st->len - pos, &node_value, &value_len) == 0) {
+            discard_json_string(st->parser, name);
+            return NULL;
+        }
+        node = init_json_value(st->parser, STRING, name, name_len, node_value, value_len);
+        if(node == NULL) {
+            discard_json_string(st->parser, name);
+            discard_json_string(st->parser, node_value);
+            return NULL;
+        }
+        break;
+    case '}':
+    case ']':
+    case ':':
+    case ',':
+        discard_json_string(st->parser, name);
+        return NULL;
+    default:
+        len = json_parse_scalar(st->parser, &node, st->data + pos, st->len - pos, name, name_len);
+        if(len == 0) {
+            discard_json_string(st->parser, name);
+            return NULL;
+        }
+        if(!scalar_ends(st->data, st->len, pos + len)) {
+            discard_json_value(st->parser, node);
+            return NULL;
+        }
+        break;
+    }
+    st->cur++;
 
-struct json_value *json_find_value(struct json_root *root, char *name)
+    return node;
+}
+
+/*
+ * Walks the root object's members, cur being just past its '{'. Containers
+ * are followed on a parse_stack rather than by recursion, and every node is
+ * linked into its parent as soon as it exists, so a failed parse leaves
+ * what was built with the root, as the tree builder does.
+ */
+static int stage2_members(struct json_stage2 *st, struct json_root *root, struct parse_stack *stack)
 {
-    if(root == NULL || name == NULL || root->elems == NULL) {
+    struct json_value *node = NULL;
+    struct parse_frame *top = NULL;
+    char *key = NULL;
+    size_t key_len = 0;
+    size_t pos;
+    int opened = 1;
+
+    if(parse_stack_push(stack, NULL) == NULL) {
+        return JSON_FAILURE;
+    }
+
+    for(;;) {
+        top = &stack->frames[stack->depth - 1];
+
+        /* a container just opened may close right away; anything else is a member first */
+        if(!opened || stage2_peek(st) != stage2_close(top)) {
+            if(stage2_close(top) == '}') {
+                pos = st->cur < st->count ? st->positions[st->cur] : st->len;
+                if(pos >= st->len || st->data[pos] != '\"' ||
+                   extract_text(st->parser, st->data + pos, st->len - pos, &key, &key_len, 1) == 0) {
+                    return JSON_FAILURE;
+                }
+                st->cur++;
+                if(stage2_peek(st) != ':') {
+                    discard_json_string(st->parser, key);
+                    return JSON_FAILURE;
+                }
+                st->cur++;
+            }
+
+            node = stage2_value(st, key, key_len);
+            key = NULL;
+            key_len = 0;
+            if(node == NULL) {
+                return JSON_FAILURE;
+            }
+            parse_frame_attach(root, top, node);
+
+            if(node->type == OBJECT || node->type == ARRAY) {
+                if(stack->depth == st->parser->max_depth || parse_stack_push(stack, node) == NULL) {
+                    return JSON_FAILURE;
+                }
+                opened = 1;
+                continue;
+            }
+        }
+        opened = 0;
+
+        /* a value is complete: close the containers ending behind it, up to the next comma */
+        for(;;) {
+            top = &stack->frames[stack->depth - 1];
+            if(stage2_peek(st) == ',') {
+                st->cur++;
+                break;
+            }
+            if(stage2_peek(st) != stage2_close(top)) {
+                return JSON_FAILURE;
+            }
+            st->cur++;
+            if(top->node != NULL && json_value_collect(st->parser, top->node) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+            if(--stack->depth == 0) {
+                return JSON_SUCCEED;
+            }
+        }
+    }
+}
+
+static int json_root_deserialize_structural(struct json_parser *parser, struct json_root *root, char *rawdata, size_t len)
+{
+    struct json_structurals *index = parser->structurals;
+    if(index == NULL) {
+        index = create_json_structurals_allocator(json_parser_allocator(parser));
+    }
+    if(index == NULL) {
+        return JSON_FAILURE;
+    }
+
+    int res = JSON_FAILURE;
+    if(json_structurals_build(index, rawdata, len) && index->count > 0 && index->positions[0] == 0) {
+        struct json_stage2 st = { parser, rawdata, len, index->positions, index->count, 1 };
+        struct parse_stack stack;
+        init_parse_stack(&stack, parser);
+        res = stage2_members(&st, root, &stack);
+        release_parse_stack(&stack);
+        if(st.cur != st.count) {
+            res = JSON_FAILURE;
+        }
+    }
+
+    if(index != parser->structurals) {
+        release_json_structurals(index);
+    }
+
+    return res;
+}
+
+static int root_deserialize(struct json_parser *parser, struct json_root *root, char *rawdata, size_t len)
+{
+    if(len < 2) {
+        return JSON_FAILURE;
+    }
+
+    if(rawdata[0] == '{' && rawdata[1] == '}') {
+        return JSON_SUCCEED;
+    }
+
+    if(rawdata[0] != '{' || rawdata[len - 1] != '}') {
+        return JSON_FAILURE;
+    }
+
+    if(parser->flags & JSON_PARSE_STRUCTURAL) {
+        return json_root_deserialize_structural(parser, root, rawdata, len);
+    }
+
+    struct json_tree_builder builder;
+    init_builder(&builder, parser, root);
+
+    int res = json_sax_parse_allocator(rawdata, len, &json_tree_handler, &builder, parser->max_depth, json_parser_allocator(parser));
+
+    release_builder(&builder);
+
+    return res;
+}
+
+int json_root_deserialize(struct json_parser *parser, struct json_root *root, char *rawdata, size_t len)
+{
+    JSON_STAT_START(start);
+    int res = root_deserialize(parser, root, rawdata, len);
+    JSON_STAT_STOP(parses, parse_ns, start);
+    JSON_STAT_ADD(bytes_parsed, len);
+
+    return res;
+}
+
+struct json_value *json_build_value(struct json_parser *parser, char *data, size_t len, size_t *pos, char *name, size_t name_len)
+{
+    struct json_tree_builder builder;
+    struct json_sax sax = { &json_tree_handler, &builder, data, len, parser->max_depth, json_parser_allocator(parser) };
+    init_builder(&builder, parser, NULL);
+
+    if(name != NULL) {
+        builder.key = json_parser_key(parser, name, name_len);
+        builder.key_len = name_len;
+        if(builder.key == NULL) {
+            return NULL;
+        }
+    }
+
+    size_t end = sax_value(&sax, *pos);
+
+    release_builder(&builder);
+
+    if(end == 0) {
+        discard_json_value(parser, builder.result);
         return NULL;
     }
 
-    struct json_value *value = NULL;
-    struct json_value *target = NULL;
-    char curr_name[64] = {0};
+    if(name == NULL && builder.result != NULL) {
+        builder.result->anonymous = 1;
+    }
+    *pos = end;
+
+    return builder.result;
+}
 
-    int name_len = strlen(name);
-    int i = 0, j;
-    value = root->elems;
-    while( i < name_len) {
-        j = 0;
-        while(*(name + i) != '>' && i < name_len) {
-            curr_name[j++] = name[i++];
+int json_build_sequence(struct json_parser *parser, char *data, size_t end, size_t pos, struct json_value **first, struct json_value **last)
+{
+    struct json_tree_builder builder;
+    struct json_sax sax = { &json_tree_handler, &builder, data, end, parser->max_depth, json_parser_allocator(parser) };
+    init_builder(&builder, parser, NULL);
+    int res = JSON_FAILURE;
+
+    *first = NULL;
+    *last = NULL;
+    for(;;) {
+        builder.result = NULL;
+        pos = sax_value(&sax, pos);
+        if(pos == 0 || builder.result == NULL) {
+            break;
         }
 
-        target = json_find_value_same_level(value, curr_name);
-        if(target == NULL) {
+        builder.result->anonymous = 1;
+        if(*last == NULL) {
+            *first = builder.result;
+        } else {
+            (*last)->next = builder.result;
+        }
+        *last = builder.result;
+
+        pos = sax_skip(&sax, pos);
+        if(pos >= end) {
+            res = JSON_SUCCEED;
+            break;
+        }
+        if(data[pos] != ',') {
+            break;
+        }
+        pos++;
+    }
+
+    release_builder(&builder);
+
+    return res;
+}
+
+int json_deserialize_flags(struct json_root *root, struct varstr *string, int flags)
+{
+    if(root == NULL || string == NULL || string->data == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* views can't be handed to free(), so zero-copy needs an arena-owned root */
+    if((flags & JSON_PARSE_ZERO_COPY) && root->arena == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct json_parser parser = { root->arena, flags, json_root_keys(root), NULL, json_root_max_depth(root) };
+
+    return json_root_deserialize(&parser, root, string->data, string->len);
+}
+
+int json_deserialize(struct json_root *root, struct varstr *string)
+{
+    return json_deserialize_flags(root, string, 0);
+}
+
+int release_json_root(struct json_root *root)
+{
+    if(root != NULL && root->arena == NULL) {
+        struct json_value *curr = root->elems;
+        struct json_value *next = NULL;
+        while(curr != NULL) {
+            next = curr->next;
+            release_json_value(curr);
+            curr = next;
+        }
+
+        release_json_index(root->index);
+        root->index = NULL;
+        root->elems = NULL;
+        root->last = NULL;
+        json_free(root);
+
+        return JSON_SUCCEED;
+    }
+
+    return JSON_FAILURE;
+}
+
+struct json_document *create_json_document(int flags)
+{
+    return create_json_document_allocator(flags, NULL);
+}
+
+struct json_document *create_json_document_allocator(int flags, const struct json_allocator *allocator)
+{
+    struct json_document *doc = (struct json_document *)json_allocator_alloc(allocator, sizeof(*doc));
+    if(doc == NULL) {
+        return NULL;
+    }
+
+    doc->flags = flags;
+    doc->data = NULL;
+    doc->len = 0;
+    doc->map = NULL;
+    doc->map_len = 0;
+    doc->threads = 0;
+    doc->structurals = NULL;
+    doc->ranges = NULL;
+    doc->range_count = 0;
+    doc->lazy = NULL;
+    doc->root.elems = NULL;
+    doc->root.last = NULL;
+    doc->root.index = NULL;
+    doc->root.keys = NULL;
+    doc->root.max_depth = 0;
+    doc->root.arena = create_json_arena_allocator(JSON_ARENA_BLOCK_SIZE, allocator);
+    if(doc->root.arena == NULL) {
+        json_allocator_free(allocator, doc);
+        return NULL;
+    }
+
+    return doc;
+}
+
+/* one range of a split array: the elements between two cut commas */
+struct parallel_array {
+    struct json_parser *parser;
+    char *data;
+    size_t *starts;
+    size_t *ends;
+    struct json_value **firsts;
+    struct json_value **lasts;
+    struct json_arena **arenas;
+};
+
+static int parallel_array_task(void *ctx, size_t worker, size_t task)
+{
+    struct parallel_array *work = (struct parallel_array *)ctx;
+    /* the elements sit inside the array */
+    struct json_parser parser = { work->arenas[task], work->parser->flags, NULL, NULL, work->parser->max_depth - 1 };
+
+    return json_build_sequence(&parser, work->data, work->ends[task], work->starts[task],
+                               &work->firsts[task], &work->lasts[task]);
+}
+
+/*
+ * The document keeps the range arenas, so a reset recycles what they built
+ * like the rest. They go by range rather than by worker: which worker takes
+ * a range changes from run to run, what a range holds doesn't.
+ */
+static int reserve_ranges(struct json_document *doc, size_t ranges)
+{
+    const struct json_allocator *allocator = doc->root.arena->allocator;
+    size_t k;
+
+    if(ranges <= doc->range_count) {
+        return JSON_SUCCEED;
+    }
+
+    struct json_arena **arenas = (struct json_arena **)json_allocator_alloc(allocator, ranges * sizeof(*arenas));
+    if(arenas == NULL) {
+        return JSON_FAILURE;
+    }
+    for(k = 0; k < ranges; k++) {
+        arenas[k] = k < doc->range_count ? doc->ranges[k] : NULL;
+    }
+    json_allocator_free(allocator, doc->ranges);
+    doc->ranges = arenas;
+
+    while(doc->range_count < ranges) {
+        doc->ranges[doc->range_count] = create_json_arena_allocator(JSON_ARENA_BLOCK_SIZE, allocator);
+        if(doc->ranges[doc->range_count] == NULL) {
+            return JSON_FAILURE;
+        }
+        doc->range_count++;
+    }
+
+    return JSON_SUCCEED;
+}
+
+/*
+ * The array at data[*pos] is cut at top-level commas about every
+ * JSON_PARALLEL_STEP bytes, and the ranges are built on the worker pool,
+ * each range in an arena of its own that the document keeps. The pieces
+ * are chained back in order; the per-range bookkeeping comes from the
+ * document arena, so a recycled document parses without calling malloc.
+ */
+static struct json_value *parse_parallel_array(struct json_document *doc, struct json_parser *parser, char *data, size_t len,
+                                               size_t *pos, char *name, size_t name_len)
+{
+    size_t k;
+    if(parser->max_depth == 0) {
+        return NULL;
+    }
+
+    if(doc->structurals == NULL) {
+        doc->structurals = create_json_structurals_allocator(doc->root.arena->allocator);
+        if(doc->structurals == NULL) {
             return NULL;
+        }
+    }
+
+    struct json_structurals *cuts = doc->structurals;
+    size_t used = json_structurals_split(data + *pos, len - *pos, JSON_PARALLEL_STEP, cuts);
+    if(used == 0 || cuts->count == 0) {
+        return used == 0 ? NULL : json_build_value(parser, data, len, pos, name, name_len);
+    }
+
+    size_t threads = json_parallel_threads(doc->threads), ranges = cuts->count + 1;
+    struct parallel_array work = { parser, data, NULL, NULL, NULL, NULL, NULL };
+    struct json_value *node = NULL;
+    char *key = NULL;
+
+    if(reserve_ranges(doc, ranges) != JSON_SUCCEED) {
+        return NULL;
+    }
+    work.arenas = doc->ranges;
+    work.starts = (size_t *)json_arena_alloc(doc->root.arena, ranges * sizeof(size_t));
+    work.ends = (size_t *)json_arena_alloc(doc->root.arena, ranges * sizeof(size_t));
+    work.firsts = (struct json_value **)json_arena_alloc(doc->root.arena, ranges * sizeof(struct json_value *));
+    work.lasts = (struct json_value **)json_arena_alloc(doc->root.arena, ranges * sizeof(struct json_value *));
+    if(work.starts == NULL || work.ends == NULL || work.firsts == NULL || work.lasts == NULL) {
+        return NULL;
+    }
+
+    for(k = 0; k < ranges; k++) {
+        work.starts[k] = *pos + (k == 0 ? 1 : cuts->positions[k - 1] + 1);
+        work.ends[k] = *pos + (k == cuts->count ? used - 1 : cuts->positions[k]);
+        work.firsts[k] = NULL;
+        work.lasts[k] = NULL;
+    }
+
+    if(json_parallel_run(threads, ranges, parallel_array_task, &work, doc->root.arena->allocator) != JSON_SUCCEED) {
+        return NULL;
+    }
+
+    key = json_parser_strndup(parser, name, name_len);
+    if(key == NULL) {
+        return NULL;
+    }
+    node = init_json_value(parser, ARRAY, key, name_len, NULL, 0);
+    if(node == NULL) {
+        discard_json_string(parser, key);
+        return NULL;
+    }
+
+    for(k = 0; k < ranges; k++) {
+        if(k == 0) {
+            node->value.children = work.firsts[k];
         } else {
-            value = target->value.children;
+            work.lasts[k - 1]->next = work.firsts[k];
+        }
+    }
+    if(json_value_collect(parser, node) != JSON_SUCCEED) {
+        return NULL;
+    }
+    *pos += used;
+
+    return node;
+}
+
+/* top-level members are walked here; only arrays among them are split across threads */
+static int parse_parallel(struct json_document *doc, char *data, size_t len)
+{
+    /* the members' values sit inside the root object */
+    struct json_parser parser = { doc->root.arena, doc->flags, NULL, NULL, json_root_max_depth(&doc->root) - 1 };
+    size_t pos, start = 0, key_len = 0, used;
+
+    if(len < 2 || data[0] != '{' || data[len - 1] != '}') {
+        return JSON_FAILURE;
+    }
+
+    pos = 1 + json_skip_whitespace(data + 1, len - 1);
+    if(data[pos] == '}') {
+        return pos + 1 == len ? JSON_SUCCEED : JSON_FAILURE;
+    }
+
+    while(pos < len) {
+        used = lex_string(data + pos, len - pos, &start, &key_len);
+        if(used == 0) {
+            return JSON_FAILURE;
+        }
+        char *key = data + pos + start;
+        pos += used;
+        pos += json_skip_whitespace(data + pos, len - pos);
+        if(pos >= len || data[pos] != ':') {
+            return JSON_FAILURE;
+        }
+        pos++;
+        pos += json_skip_whitespace(data + pos, len - pos);
+        if(pos >= len) {
+            return JSON_FAILURE;
+        }
+
+        struct json_value *node = NULL;
+        if(data[pos] == '[') {
+            node = parse_parallel_array(doc, &parser, data, len, &pos, key, key_len);
+        } else {
+            node = json_build_value(&parser, data, len, &pos, key, key_len);
+        }
+        if(node == NULL) {
+            return JSON_FAILURE;
+        }
+        json_root_insert_value(&doc->root, node);
+
+        pos += json_skip_whitespace(data + pos, len - pos);
+        if(pos < len && data[pos] == ',') {
+            pos++;
+        } else if(pos < len && data[pos] == '}') {
+            return pos + 1 == len ? JSON_SUCCEED : JSON_FAILURE;
+        } else {
+            return JSON_FAILURE;
+        }
+    }
+
+    return JSON_FAILURE;
+}
+
+int json_document_parse(struct json_document *doc, char *data, size_t len)
+{
+    if(doc->flags & JSON_PARSE_LAZY) {
+        size_t i = json_skip_whitespace(data, len);
+        if(i >= len || data[i] != '{') {
+            return JSON_FAILURE;
+        }
+        doc->data = data;
+        doc->len = len;
+        doc->lazy = NULL;
+        return JSON_SUCCEED;
+    }
+
+    if((doc->flags & JSON_PARSE_STRUCTURAL) && doc->structurals == NULL) {
+        doc->structurals = create_json_structurals_allocator(doc->root.arena->allocator);
+        if(doc->structurals == NULL) {
+            return JSON_FAILURE;
+        }
+    }
+
+    /* workers can't share a key table, so interning keeps the parse on this thread */
+    struct json_parser parser = { doc->root.arena, doc->flags, json_root_keys(&doc->root), doc->structurals,
+                                  json_root_max_depth(&doc->root) };
+    if((doc->flags & JSON_PARSE_PARALLEL) && parser.keys == NULL) {
+        JSON_STAT_START(start);
+        int res = parse_parallel(doc, data, len);
+        JSON_STAT_STOP(parses, parse_ns, start);
+        JSON_STAT_ADD(bytes_parsed, len);
+        return res;
+    }
+
+    return json_root_deserialize(&parser, &doc->root, data, len);
+}
+
+int json_document_deserialize(struct json_document *doc, struct varstr *string)
+{
+    if(doc == NULL || string == NULL || string->data == NULL) {
+        return JSON_FAILURE;
+    }
+
+    return json_document_parse(doc, string->data, string->len);
+}
+
+int json_document_reset(struct json_document *doc)
+{
+    size_t k;
+
+    if(doc == NULL) {
+        return JSON_FAILURE;
+    }
+
+    json_document_unmap(doc);
+    json_arena_reset(doc->root.arena);
+    for(k = 0; k < doc->range_count; k++) {
+        json_arena_reset(doc->ranges[k]);
+    }
+    doc->data = NULL;
+    doc->len = 0;
+    doc->root.elems = NULL;
+    doc->root.last = NULL;
+    doc->root.index = NULL;
+    doc->lazy = NULL;
+
+    return JSON_SUCCEED;
+}
+
+int release_json_document(struct json_document *doc)
+{
+    if(doc != NULL) {
+        const struct json_allocator *allocator = doc->root.arena->allocator;
+        size_t k;
+        json_document_unmap(doc);
+        release_json_structurals(doc->structurals);
+        for(k = 0; k < doc->range_count; k++) {
+            release_json_arena(doc->ranges[k]);
+        }
+        json_allocator_free(allocator, doc->ranges);
+        release_json_arena(doc->root.arena);
+        doc->root.arena = NULL;
+        doc->root.elems = NULL;
+        doc->root.index = NULL;
+        json_allocator_free(allocator, doc);
+
+        return JSON_SUCCEED;
+    }
+
+    return JSON_FAILURE;
+}
+
+static int member_matches(struct json_value *value, const char *name, size_t name_len, int flags)
+{
+    if(value->name == name) {
+        return 1;
+    }
+    if(value->name_len != name_len) {
+        return 0;
+    }
+    /* array elements have no name at all, which only an empty one matches */
+    if(name_len == 0) {
+        return 1;
+    }
+
+    if(flags & JSON_FIND_CASE_SENSITIVE) {
+        return !memcmp(value->name, name, name_len);
+    }
+
+    return !strncasecmp(value->name, name, name_len);
+}
+
+struct json_value *json_find_value_same_level(struct json_value *value, const char *name, size_t name_len, int flags)
+{
+    while(value != NULL && name != NULL) {
+        if(member_matches(value, name, name_len, flags)) {
+            return value;
+        }
+        value = value->next;
+    }
+
+    return NULL;
+}
+
+/*
+ * Scan the member list; once it proves to be long, index it in the given arena
+ * (or on the heap) and answer from the index from then on. Lookups on a large
+ * object therefore mutate it the first time and must not race each other.
+ */
+static struct json_value *find_member(struct json_value *members, struct json_index **index, struct json_arena *arena, const char *name, size_t name_len, uint64_t hash, int flags)
+{
+    if(*index == NULL) {
+        struct json_value *value = members;
+        int count = 0;
+        while(value != NULL && count < JSON_INDEX_THRESHOLD) {
+            if(member_matches(value, name, name_len, flags)) {
+                return value;
+            }
+            value = value->next;
+            count++;
+        }
+        if(value == NULL) {
+            return NULL;
+        }
+
+        *index = create_json_index(arena, members);
+        if(*index == NULL) {
+            return json_find_value_same_level(value, name, name_len, flags);
+        }
+    }
+
+    return json_index_find(*index, name, name_len, hash, flags);
+}
+
+struct json_value *json_find_member(struct json_root *root, struct json_value *parent, const char *name, size_t name_len, uint64_t hash, int flags)
+{
+    struct json_keys *keys = json_root_keys(root);
+    if(keys != NULL) {
+        /*
+         * parsed members share the table's copy and match on the pointer;
+         * members inserted since keep their own names and compare by bytes
+         */
+        const char *interned = json_keys_find(keys, name, name_len, hash, flags);
+        if(interned != NULL) {
+            name = interned;
         }
-        memset(curr_name, 0, 64);
-        i++;
     }
 
+    if(parent == NULL) {
+        return find_member(root->elems, &root->index, root->arena, name, name_len, hash, flags);
+    }
+    if(parent->type == OBJECT) {
+        return find_member(parent->value.children, &parent->index, root->arena, name, name_len, hash, flags);
+    }
+    if(parent->type == ARRAY) {
+        return json_find_value_same_level(parent->value.children, name, name_len, flags);
+    }
+
+    return NULL;
+}
+
+struct json_value *json_value_find_member(struct json_value *object, const char *name, size_t name_len, int flags)
+{
+    if(object == NULL || name == NULL) {
+        return NULL;
+    }
+
+    /* the owning arena is unknown here, so only an index built through the root is used */
+    if(object->type == OBJECT && object->index != NULL) {
+        return json_index_find(object->index, name, name_len, json_index_hash(name, name_len), flags);
+    }
+    if(object->type == OBJECT || object->type == ARRAY) {
+        return json_find_value_same_level(object->value.children, name, name_len, flags);
+    }
+
+    return NULL;
+}
+
+struct json_value *json_value_child_at(struct json_value *array, size_t n)
+{
+    if(n >= json_value_count(array)) {
+        return NULL;
+    }
+
+    return array->items->items[n];
+}
+
+struct json_value *json_find_value(struct json_root *root, char *name)
+{
+    return json_find_value_flags(root, name, 0);
+}
+
+static struct json_value *find_value(struct json_root *root, char *name, int flags)
+{
+    struct json_path_segment segment;
+    struct json_value *target = NULL;
+    size_t len = strlen(name);
+    size_t i = 0;
+
+    while(i < len) {
+        i += json_path_lex_segment(name + i, len - i, &segment);
+        target = json_path_step(root, target, &segment, flags);
+        if(target == NULL) {
+            return NULL;
+        }
+    }
+
+    return target;
+}
+
+struct json_value *json_find_value_flags(struct json_root *root, char *name, int flags)
+{
+    if(root == NULL || name == NULL || root->elems == NULL) {
+        return NULL;
+    }
+
+    JSON_STAT_START(start);
+    struct json_value *target = find_value(root, name, flags);
+    JSON_STAT_STOP(finds, find_ns, start);
+
     return target;
 }
@@ -2,12 +2,33 @@
 #define _JSON_H_
 
 #include "varstr.h"
+#include "arena.h"
 
 #define JSON_SUCCEED 1
 #define JSON_FAILURE 0
 
 #define VALUE_SIZE_MAX 512
 
+/* names and strings point into the caller's varstr, which must outlive the document */
+#define JSON_PARSE_ZERO_COPY 0x1
+/* two-stage engine: vectorized structural index, then a walk over the index */
+#define JSON_PARSE_STRUCTURAL 0x2
+/* deserialize only keeps the text, which must outlive the document; lookups build what they reach */
+#define JSON_PARSE_LAZY 0x4
+/* arrays among the top-level members are cut into ranges and built on doc->threads workers */
+#define JSON_PARSE_PARALLEL 0x8
+/* ndjson: every worker interns member names in a json_keys table of its own, kept with the batch */
+#define JSON_PARSE_INTERN_KEYS 0x10
+
+/* how deep containers may nest, the outermost object included, unless the root says otherwise */
+#define JSON_PARSE_DEPTH_MAX 1024
+
+/* how many bytes of array each parallel range covers, at least */
+#define JSON_PARALLEL_STEP (256 * 1024)
+
+/* compare member names exactly instead of ignoring ASCII case */
+#define JSON_FIND_CASE_SENSITIVE 0x1
+
 typedef enum {
     NUMBER,
     BOOLEAN,
@@ -18,10 +39,23 @@ typedef enum {
     OBJECT
 }JSON_TYPE;
 
+struct json_index;
+struct json_vector;
+struct json_keys;
+struct json_structurals;
+struct json_lazy_cache;
+
 typedef struct json_value {
     JSON_TYPE type;
     int anonymous;
     char *name;
+    size_t name_len;
+    union {
+        /* strings only */
+        size_t string_len;
+        /* objects only: the last member once an append has looked for it, so appends don't walk the list */
+        struct json_value *tail;
+    };
     union {
         char *string;
         long long number;
@@ -30,15 +64,58 @@ typedef struct json_value {
         double double_decimal;
         struct json_value *children;
     }value;
+    union {
+        /* objects only: member hash index, built by the first lookup on a large object */
+        struct json_index *index;
+        /* arrays only: the elements again, by position */
+        struct json_vector *items;
+    };
     struct json_value *next;
 }json_value;
 
+/* parsers size it exactly once an array closes; json_value_insert_child grows it by doubling */
+typedef struct json_vector {
+    size_t count;
+    size_t cap;
+    /* the arena it was carved from, which grows it too; NULL means malloc'd and freed with the array */
+    struct json_arena *arena;
+    struct json_value *items[];
+}json_vector;
+
 typedef struct json_root {
     struct json_value *elems;
+    struct json_value *last;
+    struct json_arena *arena;
+    struct json_index *index;
+    /* set before parsing to intern member names there; ignored by roots without an arena */
+    struct json_keys *keys;
+    /* set before parsing to refuse deeper nesting; 0 means JSON_PARSE_DEPTH_MAX */
+    size_t max_depth;
 }json_root;
 
-char *escape_string(char *str, int str_len);
-char *unescape_string(char *str, int str_len);
+/* a json_root whose nodes, names and strings all live in one arena */
+typedef struct json_document {
+    struct json_root root;
+    int flags;
+    char *data;
+    size_t len;
+    void *map;
+    size_t map_len;
+    /* workers for JSON_PARSE_PARALLEL; 0 means one per online cpu */
+    int threads;
+    /* the JSON_PARSE_STRUCTURAL index, or the JSON_PARSE_PARALLEL cuts, kept for the next parse */
+    struct json_structurals *structurals;
+    /* one arena per JSON_PARSE_PARALLEL range, holding the nodes built from it; reset with the document */
+    struct json_arena **ranges;
+    size_t range_count;
+    /* JSON_PARSE_LAZY: the values lookups have built so far, by offset; lives in the arena */
+    struct json_lazy_cache *lazy;
+}json_document;
+
+char *escape_string(char *str, size_t str_len);
+char *unescape_string(char *str, size_t str_len);
+char *json_value_unescape_name(struct json_value *value);
+char *json_value_unescape_string(struct json_value *value);
 
 struct json_value *create_json_string(char *name, char *value);
 struct json_value *create_json_boolean(char *name, int value);
@@ -49,15 +126,39 @@ struct json_value *create_json_object(char *name);
 struct json_value *create_json_array(char *name);
 void release_json_value(struct json_value *value);
 
+/* children keep the order they were inserted, or parsed, in; arrays and objects append in amortized O(1) */
 int json_value_insert_child(struct json_value *parent, struct json_value *child);
+/* elements of an array, 0 for anything else */
+size_t json_value_count(struct json_value *array);
 
 struct json_root *create_json_root();
 int json_root_insert_value(struct json_root *root, struct json_value *value);
 int release_json_root(json_root *root);
 
+struct json_document *create_json_document(int flags);
+/* the document and every node parsed into it take their memory from allocator */
+struct json_document *create_json_document_allocator(int flags, const struct json_allocator *allocator);
+int json_document_deserialize(struct json_document *doc, struct varstr *str);
+int json_parse_file(struct json_document *doc, const char *path);
+/*
+ * Drops the parsed document, and with it every value and name taken from it,
+ * but keeps the memory: the next parse refills the arena's blocks and the
+ * scratch buffers, so parsing documents no bigger than the ones before calls
+ * malloc not at all. Flags, threads, root.keys and root.max_depth stay as
+ * they are.
+ */
+int json_document_reset(struct json_document *doc);
+int release_json_document(struct json_document *doc);
+struct json_value *json_document_find(struct json_document *doc, char *name);
+
 int json_serialize(struct json_root *root, struct varstr *str);
 int json_deserialize(struct json_root *root, struct varstr *str);
+int json_deserialize_flags(struct json_root *root, struct varstr *str, int flags);
 
 struct json_value *json_find_value(struct json_root *root, char *name);
+struct json_value *json_find_value_flags(struct json_root *root, char *name, int flags);
+struct json_value *json_value_find_member(struct json_value *object, const char *name, size_t name_len, int flags);
+/* O(1) */
+struct json_value *json_value_child_at(struct json_value *array, size_t n);
 
 #endif
@@ -0,0 +1,90 @@
+#ifndef _JSON_INTERNAL_H_
+#define _JSON_INTERNAL_H_
+
+#include <stdint.h>
+#include "json.h"
+#include "sax.h"
+#include "stats.h"
+
+/* where a parse puts its nodes: the root's arena (or malloc), the parse flags and the member name table */
+struct json_parser {
+    struct json_arena *arena;
+    int flags;
+    struct json_keys *keys;
+    /* a stage-1 index to refill instead of building a fresh one, or NULL */
+    struct json_structurals *structurals;
+    /* containers the text being parsed may still open; deeper input fails as soon as it is seen */
+    size_t max_depth;
+};
+
+struct json_value *init_json_value(struct json_parser *parser, JSON_TYPE type, char *name, size_t name_len, void *value, size_t value_len);
+char *json_parser_strndup(struct json_parser *parser, char *str, size_t len);
+/* what a parse allocates its scratch from: its arena's allocator, NULL meaning the global one */
+const struct json_allocator *json_parser_allocator(struct json_parser *parser);
+/* a member name: the table's copy when the parse interns names, otherwise json_parser_strndup */
+char *json_parser_key(struct json_parser *parser, char *str, size_t len);
+/* the table a parse into root interns names in, NULL if it keeps them private */
+struct json_keys *json_root_keys(struct json_root *root);
+/* the nesting a parse into root allows, the root object included */
+size_t json_root_max_depth(struct json_root *root);
+void discard_json_string(struct json_parser *parser, char *str);
+/* links child behind *last while a parser fills parent; json_value_collect seals it when parent closes */
+void json_value_link(struct json_value *parent, struct json_value *child, struct json_value **last);
+/* sizes parent's position vector to its children list, from the parser's arena if it has one */
+int json_value_collect(struct json_parser *parser, struct json_value *parent);
+void discard_json_value(struct json_parser *parser, struct json_value *value);
+
+typedef struct json_scalar {
+    JSON_TYPE type;
+    union {
+        long long number;
+        int boolean;
+        double double_decimal;
+    }value;
+}json_scalar;
+
+size_t json_lex_scalar(char *data, size_t len, struct json_scalar *scalar);
+size_t json_parse_scalar(struct json_parser *parser, struct json_value **value, char *rawdata, size_t maxlen, char *node_name, size_t name_len);
+
+/* a root that lives in, and is released with, the arena */
+struct json_root *init_json_root(struct json_arena *arena);
+/* parses one top-level object; data must start with '{' and end with '}' */
+int json_root_deserialize(struct json_parser *parser, struct json_root *root, char *rawdata, size_t len);
+
+/* decodes escapes from str into dst, which needs str_len bytes; returns the decoded length */
+size_t json_unescape(char *dst, const char *str, size_t str_len);
+
+/* json_sax_parse_depth with the stack of a deep walk taken from allocator */
+int json_sax_parse_allocator(const char *data, size_t len, const struct json_sax_handler *handler, void *ctx, size_t max_depth,
+                             const struct json_allocator *allocator);
+
+/* appends one value, its name included unless it is anonymous */
+int json_value_serialize(struct json_value *elem, struct varstr *string);
+
+/* frames a tree walk keeps on the C stack; deeper trees move the walk's stack to the heap */
+#define JSON_WALK_INLINE_DEPTH 32
+
+/*
+ * Doubles a walk's stack of *cap frames of size bytes, copying it off
+ * inline_frames, its C-stack start, the first time. Returns the new frames,
+ * or NULL with the old ones untouched.
+ */
+void *json_stack_grow(void *frames, void *inline_frames, size_t *cap, size_t size, const struct json_allocator *allocator);
+
+/* parses len bytes at data into the document as its flags say */
+int json_document_parse(struct json_document *doc, char *data, size_t len);
+/* drops the file mapping json_parse_file left in the document, if any */
+void json_document_unmap(struct json_document *doc);
+/* maps a whole non-empty file read-only; sequential asks the kernel for read-ahead */
+char *json_map_file(const char *path, size_t *size, int sequential);
+
+/* builds the single value starting at *pos, named name unless that is NULL, and moves *pos past it */
+struct json_value *json_build_value(struct json_parser *parser, char *data, size_t len, size_t *pos, char *name, size_t name_len);
+
+/* builds the comma-separated values in data[pos, end) as an anonymous sibling chain, in order */
+int json_build_sequence(struct json_parser *parser, char *data, size_t end, size_t pos, struct json_value **first, struct json_value **last);
+
+/* one lookup step below parent, or at the top level when parent is NULL; hash is json_index_hash(name) */
+struct json_value *json_find_member(struct json_root *root, struct json_value *parent, const char *name, size_t name_len, uint64_t hash, int flags);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "keys.h"
+#include "index.h"
+
+/* names are short, so small blocks keep a table of a few dozen keys small */
+#define JSON_KEYS_BLOCK_SIZE 4096
+
+struct json_keys *create_json_keys()
+{
+    struct json_keys *keys = (struct json_keys *)json_malloc(sizeof(*keys));
+    if(keys == NULL) {
+        return NULL;
+    }
+
+    keys->arena = create_json_arena(JSON_KEYS_BLOCK_SIZE);
+    keys->cap = 64;
+    keys->count = 0;
+    keys->slots = (struct json_key_slot *)json_calloc(keys->cap, sizeof(*keys->slots));
+    if(keys->arena == NULL || keys->slots == NULL) {
+        release_json_keys(keys);
+        return NULL;
+    }
+
+    return keys;
+}
+
+static int grow_keys(struct json_keys *keys)
+{
+    size_t cap = keys->cap * 2, mask = cap - 1, i;
+    struct json_key_slot *slots = (struct json_key_slot *)json_calloc(cap, sizeof(*slots));
+    if(slots == NULL) {
+        return JSON_FAILURE;
+    }
+
+    for(i = 0; i < keys->cap; i++) {
+        if(keys->slots[i].name != NULL) {
+            size_t k = (size_t)keys->slots[i].hash & mask;
+            while(slots[k].name != NULL) {
+                k = (k + 1) & mask;
+            }
+            slots[k] = keys->slots[i];
+        }
+    }
+
+    json_free(keys->slots);
+    keys->slots = slots;
+    keys->cap = cap;
+
+    return JSON_SUCCEED;
+}
+
+char *json_keys_intern(struct json_keys *keys, const char *name, size_t len)
+{
+    if(keys == NULL || name == NULL) {
+        return NULL;
+    }
+
+    uint64_t hash = json_index_hash(name, len);
+    char *found = (char *)json_keys_find(keys, name, len, hash, JSON_FIND_CASE_SENSITIVE);
+    if(found != NULL) {
+        return found;
+    }
+
+    if((keys->count + 1) * 2 > keys->cap && grow_keys(keys) != JSON_SUCCEED) {
+        return NULL;
+    }
+
+    char *copy = json_arena_strndup(keys->arena, name, len);
+    if(copy == NULL) {
+        return NULL;
+    }
+
+    size_t mask = keys->cap - 1;
+    size_t i = (size_t)hash & mask;
+    while(keys->slots[i].name != NULL) {
+        i = (i + 1) & mask;
+    }
+    keys->slots[i].hash = hash;
+    keys->slots[i].len = len;
+    keys->slots[i].name = copy;
+    keys->count++;
+
+    return copy;
+}
+
+const char *json_keys_find(struct json_keys *keys, const char *name, size_t len, uint64_t hash, int flags)
+{
+    size_t mask = keys->cap - 1;
+    size_t i = (size_t)hash & mask;
+    const char *folded = NULL;
+
+    /* spellings that differ only in case hash alike, so they all sit in this probe run */
+    while(keys->slots[i].name != NULL) {
+        struct json_key_slot *slot = &keys->slots[i];
+        if(slot->hash == hash && slot->len == len) {
+            if(!memcmp(slot->name, name, len)) {
+                return slot->name;
+            }
+            if(folded == NULL && !(flags & JSON_FIND_CASE_SENSITIVE) && !strncasecmp(slot->name, name, len)) {
+                folded = slot->name;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+
+    return folded;
+}
+
+int release_json_keys(struct json_keys *keys)
+{
+    if(keys == NULL) {
+        return JSON_FAILURE;
+    }
+
+    if(keys->arena != NULL) {
+        release_json_arena(keys->arena);
+    }
+    json_free(keys->slots);
+    json_free(keys);
+
+    return JSON_SUCCEED;
+}
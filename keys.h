@@ -0,0 +1,38 @@
+#ifndef _KEYS_H_
+#define _KEYS_H_
+
+#include <stdint.h>
+#include "json.h"
+
+typedef struct json_key_slot {
+    uint64_t hash;
+    size_t len;
+    char *name;
+}json_key_slot;
+
+/*
+ * The member names seen by every parse that shares the table, each stored
+ * once. A root whose keys field points here gets all its member names from
+ * the table, so a name repeated in every record costs no allocation, and a
+ * lookup resolves its name in the table once, so parsed members match on
+ * the pointer; members inserted by hand keep their own names and still
+ * compare by bytes. Names hash with
+ * json_index_hash and stay escaped like any other name. The table only grows
+ * and is not thread safe, so give each thread its own, and keep it alive as
+ * long as any document parsed with it.
+ */
+typedef struct json_keys {
+    struct json_arena *arena;
+    size_t cap;
+    size_t count;
+    struct json_key_slot *slots;
+}json_keys;
+
+struct json_keys *create_json_keys();
+/* the table's copy of name, added the first time it is seen; NULL when out of memory */
+char *json_keys_intern(struct json_keys *keys, const char *name, size_t len);
+/* the table's copy, or without JSON_FIND_CASE_SENSITIVE the first one equal ignoring case; NULL if absent */
+const char *json_keys_find(struct json_keys *keys, const char *name, size_t len, uint64_t hash, int flags);
+int release_json_keys(struct json_keys *keys);
+
+#endif
@@ -0,0 +1,297 @@
+#include <string.h>
+#include <strings.h>
+#include "json_internal.h"
+#include "path.h"
+#include "scan.h"
+#include "structural.h"
+
+/*
+ * Lookups on a JSON_PARSE_LAZY document walk the raw text: members that are
+ * not on the path are skipped without being parsed, and only the value the
+ * path ends at is built, in the document arena. The skipped text is checked
+ * for balance only, so errors outside the reached values go unnoticed.
+ *
+ * A value is built the first time a lookup reaches it; later lookups that
+ * end at the same place get the same node back, so the arena grows with the
+ * distinct values looked up rather than with the number of lookups. Nodes
+ * live until the document is reset or released. Like lookups on a large
+ * object of an eager tree, lookups fill the cache and must not race.
+ */
+
+/* a built value and the offset of its text */
+typedef struct lazy_slot {
+    size_t offset;
+    struct json_value *value;
+}lazy_slot;
+
+typedef struct json_lazy_cache {
+    struct lazy_slot *slots;
+    size_t count;
+    size_t cap;
+}json_lazy_cache;
+
+#define LAZY_CACHE_MIN 16
+
+static size_t skip_ws(const char *data, size_t len, size_t i)
+{
+    return i < len ? i + json_skip_whitespace(data + i, len - i) : i;
+}
+
+/* i is on the opening quote; returns the index after the closing one, or 0 */
+static size_t skip_string(const char *data, size_t len, size_t i)
+{
+    i++;
+    while(i < len) {
+        i += json_scan_string(data + i, len - i);
+        if(i >= len) {
+            break;
+        }
+        if(data[i] == '\"') {
+            return i + 1;
+        }
+        if(data[i] == '\\') {
+            i += 2;
+            continue;
+        }
+        i++;
+    }
+
+    return 0;
+}
+
+/* i is on the first byte of a value; returns the index just past it, or 0 */
+static size_t skip_value(const char *data, size_t len, size_t i)
+{
+    if(data[i] == '\"') {
+        return skip_string(data, len, i);
+    }
+
+    if(data[i] != '{' && data[i] != '[') {
+        while(i < len && data[i] != ',' && data[i] != '}' && data[i] != ']' &&
+              data[i] != ' ' && data[i] != '\n' && data[i] != '\r' && data[i] != '\t') {
+            i++;
+        }
+        return i;
+    }
+
+    /* brackets are not matched by kind; the value is parsed properly if it is ever reached */
+    size_t used = json_structurals_skip(data + i, len - i);
+
+    return used == 0 ? 0 : i + used;
+}
+
+static int key_matches(const char *key, size_t key_len, const struct json_path_segment *segment, int flags)
+{
+    if(key_len != segment->name_len) {
+        return 0;
+    }
+
+    if(flags & JSON_FIND_CASE_SENSITIVE) {
+        return !memcmp(key, segment->name, key_len);
+    }
+
+    return !strncasecmp(key, segment->name, key_len);
+}
+
+/*
+ * i is on the '{' or '[' of a container; returns the index of the value the
+ * segment selects, or 0. A member's raw key is left in key/key_len; an array
+ * element leaves key NULL. The first of several equal keys wins.
+ */
+static size_t lazy_step(const char *data, size_t len, size_t i, const struct json_path_segment *segment, int flags, const char **key, size_t *key_len)
+{
+    long long n = segment->index;
+    char close = data[i] == '{' ? '}' : ']';
+
+    i = skip_ws(data, len, i + 1);
+    while(i < len && data[i] != close) {
+        if(close == '}') {
+            if(data[i] != '\"') {
+                return 0;
+            }
+            size_t end = skip_string(data, len, i);
+            if(end == 0) {
+                return 0;
+            }
+            *key = data + i + 1;
+            *key_len = end - i - 2;
+
+            i = skip_ws(data, len, end);
+            if(i >= len || data[i] != ':') {
+                return 0;
+            }
+            i = skip_ws(data, len, i + 1);
+            if(i >= len) {
+                return 0;
+            }
+            if(key_matches(*key, *key_len, segment, flags)) {
+                return i;
+            }
+        } else {
+            *key = NULL;
+            *key_len = 0;
+            /* elements have no name, so as in json_find_value only an empty name matches, the first one */
+            if(n < 0 ? segment->name_len == 0 : n-- == 0) {
+                return i;
+            }
+        }
+
+        i = skip_value(data, len, i);
+        if(i == 0) {
+            return 0;
+        }
+        i = skip_ws(data, len, i);
+        if(i < len && data[i] == ',') {
+            i = skip_ws(data, len, i + 1);
+        } else if(i >= len || data[i] != close) {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+static struct lazy_slot *lazy_find_slot(struct json_lazy_cache *cache, size_t offset)
+{
+    size_t mask = cache->cap - 1;
+    size_t i = (size_t)((offset * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+
+    while(cache->slots[i].value != NULL && cache->slots[i].offset != offset) {
+        i = (i + 1) & mask;
+    }
+
+    return &cache->slots[i];
+}
+
+/* makes room for one more value; outgrown tables stay behind in the arena, at most as big as the last */
+static int lazy_reserve(struct json_document *doc)
+{
+    struct json_lazy_cache *cache = doc->lazy;
+    size_t k;
+
+    if(cache == NULL) {
+        cache = (struct json_lazy_cache *)json_arena_alloc(doc->root.arena, sizeof(*cache));
+        if(cache == NULL) {
+            return JSON_FAILURE;
+        }
+        cache->slots = NULL;
+        cache->count = 0;
+        cache->cap = 0;
+        doc->lazy = cache;
+    }
+    if((cache->count + 1) * 2 <= cache->cap) {
+        return JSON_SUCCEED;
+    }
+
+    size_t cap = cache->cap == 0 ? LAZY_CACHE_MIN : cache->cap * 2;
+    struct lazy_slot *slots = (struct lazy_slot *)json_arena_alloc(doc->root.arena, cap * sizeof(*slots));
+    if(slots == NULL) {
+        return JSON_FAILURE;
+    }
+    memset(slots, 0, cap * sizeof(*slots));
+
+    struct lazy_slot *old = cache->slots;
+    size_t old_cap = cache->cap;
+    cache->slots = slots;
+    cache->cap = cap;
+    for(k = 0; k < old_cap; k++) {
+        if(old[k].value != NULL) {
+            *lazy_find_slot(cache, old[k].offset) = old[k];
+        }
+    }
+
+    return JSON_SUCCEED;
+}
+
+/* the value at i sits inside depth containers, which count against the root's limit */
+static struct json_value *lazy_build(struct json_document *doc, size_t i, size_t depth, const char *key, size_t key_len)
+{
+    size_t max_depth = json_root_max_depth(&doc->root);
+    if(depth > max_depth || lazy_reserve(doc) != JSON_SUCCEED) {
+        return NULL;
+    }
+
+    struct lazy_slot *slot = lazy_find_slot(doc->lazy, i);
+    if(slot->value != NULL) {
+        return slot->value;
+    }
+
+    struct json_parser parser = { doc->root.arena, doc->flags, json_root_keys(&doc->root), NULL, max_depth - depth };
+    size_t pos = i;
+    struct json_value *value = json_build_value(&parser, doc->data, doc->len, &pos, (char *)key, key_len);
+    if(value != NULL) {
+        slot->offset = i;
+        slot->value = value;
+        doc->lazy->count++;
+    }
+
+    return value;
+}
+
+struct json_value *json_document_find(struct json_document *doc, char *name)
+{
+    if(doc == NULL || name == NULL) {
+        return NULL;
+    }
+
+    if(!(doc->flags & JSON_PARSE_LAZY)) {
+        return json_find_value(&doc->root, name);
+    }
+
+    struct json_path_segment segment;
+    const char *key = NULL;
+    size_t key_len = 0;
+    size_t len = strlen(name);
+    size_t i = 0, pos = 0, depth = 0;
+
+    if(doc->data == NULL || len == 0) {
+        return NULL;
+    }
+
+    pos = skip_ws(doc->data, doc->len, 0);
+    while(i < len) {
+        i += json_path_lex_segment(name + i, len - i, &segment);
+        if(doc->data[pos] != '{' && doc->data[pos] != '[') {
+            return NULL;
+        }
+        pos = lazy_step(doc->data, doc->len, pos, &segment, 0, &key, &key_len);
+        if(pos == 0) {
+            return NULL;
+        }
+        depth++;
+    }
+
+    return lazy_build(doc, pos, depth, key, key_len);
+}
+
+struct json_value *json_document_find_path(struct json_document *doc, const struct json_path *path)
+{
+    if(doc == NULL || path == NULL) {
+        return NULL;
+    }
+
+    if(!(doc->flags & JSON_PARSE_LAZY)) {
+        return json_path_find(&doc->root, path);
+    }
+
+    const char *key = NULL;
+    size_t key_len = 0;
+    size_t i, pos = 0;
+
+    if(doc->data == NULL || path->count == 0) {
+        return NULL;
+    }
+
+    pos = skip_ws(doc->data, doc->len, 0);
+    for(i = 0; i < path->count; i++) {
+        if(doc->data[pos] != '{' && doc->data[pos] != '[') {
+            return NULL;
+        }
+        pos = lazy_step(doc->data, doc->len, pos, &path->segments[i], path->flags, &key, &key_len);
+        if(pos == 0) {
+            return NULL;
+        }
+    }
+
+    return lazy_build(doc, pos, path->count, key, key_len);
+}
@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "ndjson.h"
+#include "json_internal.h"
+#include "keys.h"
+#include "parallel.h"
+#include "scan.h"
+
+/* input is cut into about this many chunks per worker so a slow chunk doesn't hold up the rest */
+#define NDJSON_CHUNKS_PER_THREAD 8
+#define NDJSON_CHUNK_MIN (64 * 1024)
+
+typedef struct ndjson_chunk {
+    size_t start;
+    size_t end;
+    struct json_root **roots;
+    size_t count;
+    size_t cap;
+    size_t failures;
+}ndjson_chunk;
+
+typedef struct ndjson_job {
+    char *data;
+    int flags;
+    size_t max_depth;
+    struct ndjson_chunk *chunks;
+    size_t chunk_count;
+    struct json_arena **arenas;
+    struct json_keys **keys;
+    json_ndjson_callback callback;
+    void *ctx;
+}ndjson_job;
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static int chunk_push(struct ndjson_chunk *chunk, struct json_root *root)
+{
+    if(chunk->count == chunk->cap) {
+        size_t cap = chunk->cap == 0 ? 256 : chunk->cap * 2;
+        struct json_root **roots = (struct json_root **)json_realloc(chunk->roots, cap * sizeof(*roots));
+        if(roots == NULL) {
+            return JSON_FAILURE;
+        }
+        chunk->roots = roots;
+        chunk->cap = cap;
+    }
+
+    chunk->roots[chunk->count++] = root;
+
+    return JSON_SUCCEED;
+}
+
+static struct json_root *parse_record(struct ndjson_job *job, struct json_arena *arena, struct json_keys *keys, char *data, size_t len)
+{
+    struct json_parser parser = { arena, job->flags, keys, NULL, job->max_depth };
+    struct json_root *root = init_json_root(arena);
+    if(root == NULL) {
+        return NULL;
+    }
+    root->keys = keys;
+    if(json_root_deserialize(&parser, root, data, len) != JSON_SUCCEED) {
+        return NULL;
+    }
+
+    return root;
+}
+
+/* records are kept in the worker's arena, or in one per chunk when they only go to a callback */
+static int parse_chunk(struct ndjson_job *job, struct ndjson_chunk *chunk, struct json_arena *arena, struct json_keys *keys)
+{
+    size_t pos = chunk->start;
+
+    while(pos < chunk->end) {
+        char *line = job->data + pos;
+        char *newline = (char *)memchr(line, '\n', chunk->end - pos);
+        size_t line_len = newline == NULL ? chunk->end - pos : (size_t)(newline - line);
+        size_t next = pos + line_len + 1;
+
+        size_t start = json_skip_whitespace(line, line_len);
+        while(line_len > start && is_blank(line[line_len - 1])) {
+            line_len--;
+        }
+
+        if(start < line_len) {
+            struct json_root *root = parse_record(job, arena, keys, line + start, line_len - start);
+            if(root == NULL) {
+                chunk->failures++;
+            }
+            if(job->callback != NULL) {
+                if(job->callback(job->ctx, pos + start, root) != JSON_SUCCEED) {
+                    return JSON_FAILURE;
+                }
+            } else if(chunk_push(chunk, root) != JSON_SUCCEED) {
+                return JSON_FAILURE;
+            }
+        }
+
+        pos = next;
+    }
+
+    return JSON_SUCCEED;
+}
+
+static int ndjson_task(void *ctx, size_t worker, size_t task)
+{
+    struct ndjson_job *job = (struct ndjson_job *)ctx;
+    struct json_keys *keys = job->keys != NULL ? job->keys[worker] : NULL;
+
+    if(job->callback == NULL) {
+        return parse_chunk(job, &job->chunks[task], job->arenas[worker], keys);
+    }
+
+    struct json_arena *arena = create_json_arena(JSON_ARENA_BLOCK_SIZE);
+    if(arena == NULL) {
+        return JSON_FAILURE;
+    }
+    int res = parse_chunk(job, &job->chunks[task], arena, keys);
+    release_json_arena(arena);
+
+    return res;
+}
+
+/* chunk boundaries are moved forward to the byte after a newline, so no record is split */
+static struct ndjson_chunk *split_chunks(char *data, size_t len, size_t threads, size_t *count)
+{
+    size_t wanted = threads * NDJSON_CHUNKS_PER_THREAD;
+    if(wanted > len / NDJSON_CHUNK_MIN + 1) {
+        wanted = len / NDJSON_CHUNK_MIN + 1;
+    }
+
+    struct ndjson_chunk *chunks = (struct ndjson_chunk *)json_calloc(wanted, sizeof(*chunks));
+    if(chunks == NULL) {
+        return NULL;
+    }
+
+    size_t size = len / wanted;
+    size_t start = 0, k, n = 0;
+    for(k = 0; k < wanted && start < len; k++) {
+        size_t end = len;
+        if(k + 1 < wanted && start + size < len) {
+            char *newline = (char *)memchr(data + start + size, '\n', len - start - size);
+            end = newline == NULL ? len : (size_t)(newline - data) + 1;
+        }
+        chunks[n].start = start;
+        chunks[n].end = end;
+        n++;
+        start = end;
+    }
+    *count = n;
+
+    return chunks;
+}
+
+static void release_keys(struct json_keys **keys, size_t threads)
+{
+    size_t k;
+    if(keys != NULL) {
+        for(k = 0; k < threads; k++) {
+            release_json_keys(keys[k]);
+        }
+        json_free(keys);
+    }
+}
+
+/* workers keep their table across chunks, so each name is interned once per worker */
+static struct json_keys **create_keys(size_t threads)
+{
+    struct json_keys **keys = (struct json_keys **)json_calloc(threads, sizeof(*keys));
+    if(keys == NULL) {
+        return NULL;
+    }
+
+    size_t k;
+    for(k = 0; k < threads; k++) {
+        keys[k] = create_json_keys();
+        if(keys[k] == NULL) {
+            release_keys(keys, threads);
+            return NULL;
+        }
+    }
+
+    return keys;
+}
+
+static void release_chunks(struct ndjson_chunk *chunks, size_t count)
+{
+    size_t k;
+    for(k = 0; k < count; k++) {
+        json_free(chunks[k].roots);
+    }
+    json_free(chunks);
+}
+
+int json_ndjson_parse_each(char *data, size_t len, int threads, int flags, size_t max_depth, json_ndjson_callback callback, void *ctx)
+{
+    if(data == NULL || callback == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct ndjson_job job;
+    memset(&job, 0, sizeof(job));
+    job.data = data;
+    job.flags = flags;
+    job.max_depth = max_depth == 0 ? JSON_PARSE_DEPTH_MAX : max_depth;
+    job.callback = callback;
+    job.ctx = ctx;
+
+    size_t workers = json_parallel_threads(threads);
+    if(flags & JSON_PARSE_INTERN_KEYS) {
+        job.keys = create_keys(workers);
+        if(job.keys == NULL) {
+            return JSON_FAILURE;
+        }
+    }
+    job.chunks = split_chunks(data, len, workers, &job.chunk_count);
+    if(job.chunks == NULL) {
+        release_keys(job.keys, workers);
+        return JSON_FAILURE;
+    }
+
+    int res = json_parallel_run(workers, job.chunk_count, ndjson_task, &job, NULL);
+
+    release_chunks(job.chunks, job.chunk_count);
+    release_keys(job.keys, workers);
+
+    return res;
+}
+
+struct json_ndjson_batch *json_ndjson_parse(char *data, size_t len, int threads, int flags, size_t max_depth)
+{
+    if(data == NULL) {
+        return NULL;
+    }
+
+    struct json_ndjson_batch *batch = (struct json_ndjson_batch *)json_calloc(1, sizeof(*batch));
+    if(batch == NULL) {
+        return NULL;
+    }
+
+    batch->threads = json_parallel_threads(threads);
+    batch->arenas = (struct json_arena **)json_calloc(batch->threads, sizeof(*batch->arenas));
+    if(batch->arenas == NULL) {
+        json_free(batch);
+        return NULL;
+    }
+
+    size_t k;
+    for(k = 0; k < batch->threads; k++) {
+        batch->arenas[k] = create_json_arena(JSON_ARENA_BLOCK_SIZE);
+        if(batch->arenas[k] == NULL) {
+            release_json_ndjson_batch(batch);
+            return NULL;
+        }
+    }
+    if(flags & JSON_PARSE_INTERN_KEYS) {
+        batch->keys = create_keys(batch->threads);
+        if(batch->keys == NULL) {
+            release_json_ndjson_batch(batch);
+            return NULL;
+        }
+    }
+
+    struct ndjson_job job;
+    memset(&job, 0, sizeof(job));
+    job.data = data;
+    job.flags = flags;
+    job.max_depth = max_depth == 0 ? JSON_PARSE_DEPTH_MAX : max_depth;
+    job.arenas = batch->arenas;
+    job.keys = batch->keys;
+    job.chunks = split_chunks(data, len, batch->threads, &job.chunk_count);
+    if(job.chunks == NULL) {
+        release_json_ndjson_batch(batch);
+        return NULL;
+    }
+
+    int res = json_parallel_run(batch->threads, job.chunk_count, ndjson_task, &job, NULL);
+
+    size_t total = 0;
+    for(k = 0; k < job.chunk_count; k++) {
+        total += job.chunks[k].count;
+    }
+
+    batch->roots = (struct json_root **)json_malloc((total + 1) * sizeof(*batch->roots));
+    if(res != JSON_SUCCEED || batch->roots == NULL) {
+        release_chunks(job.chunks, job.chunk_count);
+        release_json_ndjson_batch(batch);
+        return NULL;
+    }
+
+    for(k = 0; k < job.chunk_count; k++) {
+        memcpy(batch->roots + batch->count, job.chunks[k].roots, job.chunks[k].count * sizeof(*batch->roots));
+        batch->count += job.chunks[k].count;
+        batch->failures += job.chunks[k].failures;
+    }
+    release_chunks(job.chunks, job.chunk_count);
+
+    return batch;
+}
+
+struct json_ndjson_batch *json_ndjson_parse_file(const char *path, int threads, int flags, size_t max_depth)
+{
+    if(path == NULL) {
+        return NULL;
+    }
+
+    size_t size = 0;
+    char *data = json_map_file(path, &size, 1);
+    if(data == NULL) {
+        return NULL;
+    }
+
+    struct json_ndjson_batch *batch = json_ndjson_parse(data, size, threads, flags, max_depth);
+    if(batch == NULL || !(flags & JSON_PARSE_ZERO_COPY)) {
+        munmap(data, size);
+    } else {
+        batch->map = data;
+        batch->map_len = size;
+    }
+
+    return batch;
+}
+
+int release_json_ndjson_batch(struct json_ndjson_batch *batch)
+{
+    if(batch == NULL) {
+        return JSON_FAILURE;
+    }
+
+    size_t k;
+    if(batch->arenas != NULL) {
+        for(k = 0; k < batch->threads; k++) {
+            if(batch->arenas[k] != NULL) {
+                release_json_arena(batch->arenas[k]);
+            }
+        }
+        json_free(batch->arenas);
+    }
+    release_keys(batch->keys, batch->threads);
+    if(batch->map != NULL) {
+        munmap(batch->map, batch->map_len);
+    }
+    json_free(batch->roots);
+    json_free(batch);
+
+    return JSON_SUCCEED;
+}
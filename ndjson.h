@@ -0,0 +1,36 @@
+#ifndef _NDJSON_H_
+#define _NDJSON_H_
+
+#include "json.h"
+
+/*
+ * Called from a worker thread for every record as soon as it is parsed, so it
+ * must be thread safe. offset is where the record starts in the input; root is
+ * NULL for a malformed record and is only valid until the callback returns.
+ * Returning JSON_FAILURE stops the batch.
+ */
+typedef int (*json_ndjson_callback)(void *ctx, size_t offset, struct json_root *root);
+
+/* one root per non-blank line, in input order; a malformed line leaves a NULL */
+typedef struct json_ndjson_batch {
+    struct json_root **roots;
+    size_t count;
+    size_t failures;
+    struct json_arena **arenas;
+    /* one per worker with JSON_PARSE_INTERN_KEYS, otherwise NULL */
+    struct json_keys **keys;
+    size_t threads;
+    void *map;
+    size_t map_len;
+}json_ndjson_batch;
+
+/*
+ * threads <= 0 uses one worker per online cpu; flags are the JSON_PARSE_* flags;
+ * a record nested deeper than max_depth fails, 0 meaning JSON_PARSE_DEPTH_MAX
+ */
+struct json_ndjson_batch *json_ndjson_parse(char *data, size_t len, int threads, int flags, size_t max_depth);
+struct json_ndjson_batch *json_ndjson_parse_file(const char *path, int threads, int flags, size_t max_depth);
+int json_ndjson_parse_each(char *data, size_t len, int threads, int flags, size_t max_depth, json_ndjson_callback callback, void *ctx);
+int release_json_ndjson_batch(struct json_ndjson_batch *batch);
+
+#endif
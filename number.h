@@ -0,0 +1,16 @@
+#ifndef _NUMBER_H_
+#define _NUMBER_H_
+
+#include <stddef.h>
+
+typedef struct json_number {
+    /* 1 when the text had no fraction or exponent and fits a long long */
+    int integer;
+    long long number;
+    double decimal;
+}json_number;
+
+/* parses one JSON number at data; returns the bytes consumed, or 0 if there is none */
+size_t json_parse_number(const char *data, size_t len, struct json_number *number);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "json.h"
+#include "stats.h"
+
+typedef struct parallel_pool {
+    json_parallel_task task;
+    void *ctx;
+    size_t count;
+    size_t next;
+    /* set by the first failing task; read and written only through __atomic builtins */
+    int stop;
+}parallel_pool;
+
+typedef struct parallel_worker {
+    struct parallel_pool *pool;
+    size_t id;
+    pthread_t thread;
+#ifdef JSON_STATS
+    /* the worker thread's counters, handed back when it is joined */
+    struct json_stats stats;
+#endif
+}parallel_worker;
+
+/* workers a run keeps on the stack; only wider pools allocate */
+#define PARALLEL_INLINE_WORKERS 32
+
+static void *parallel_worker_run(void *arg)
+{
+    struct parallel_worker *worker = (struct parallel_worker *)arg;
+    struct parallel_pool *pool = worker->pool;
+
+    /* tasks are handed out one at a time, so a slow one doesn't hold up the rest */
+    for(;;) {
+        size_t k = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if(k >= pool->count || __atomic_load_n(&pool->stop, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if(pool->task(pool->ctx, worker->id, k) != JSON_SUCCEED) {
+            __atomic_store_n(&pool->stop, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+#ifdef JSON_STATS
+    worker->stats = *json_stats_get();
+#endif
+
+    return NULL;
+}
+
+size_t json_parallel_threads(int threads)
+{
+    if(threads > 0) {
+        return (size_t)threads;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cpus > 0 ? (size_t)cpus : 1;
+}
+
+int json_parallel_run(size_t threads, size_t count, json_parallel_task task, void *ctx,
+                      const struct json_allocator *allocator)
+{
+    if(task == NULL || threads == 0) {
+        return JSON_FAILURE;
+    }
+
+    struct parallel_pool pool = { task, ctx, count, 0, 0 };
+    if(threads > count) {
+        threads = count;
+    }
+
+    /* a single worker runs on the calling thread */
+    if(threads <= 1) {
+        struct parallel_worker worker = { &pool, 0, 0 };
+        parallel_worker_run(&worker);
+        return __atomic_load_n(&pool.stop, __ATOMIC_RELAXED) ? JSON_FAILURE : JSON_SUCCEED;
+    }
+
+    struct parallel_worker inline_workers[PARALLEL_INLINE_WORKERS];
+    struct parallel_worker *workers = inline_workers;
+    if(threads > PARALLEL_INLINE_WORKERS) {
+        workers = (struct parallel_worker *)json_allocator_alloc(allocator, threads * sizeof(*workers));
+        if(workers == NULL) {
+            return JSON_FAILURE;
+        }
+    }
+
+    size_t k, started = 0;
+    for(k = 0; k < threads; k++) {
+        workers[k].pool = &pool;
+        workers[k].id = k;
+        if(pthread_create(&workers[k].thread, NULL, parallel_worker_run, &workers[k]) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    /* whatever could not be started is picked up by the threads that were */
+    if(started == 0) {
+        parallel_worker_run(&workers[0]);
+    }
+    for(k = 0; k < started; k++) {
+        pthread_join(workers[k].thread, NULL);
+#ifdef JSON_STATS
+        json_stats_add(json_stats_get(), &workers[k].stats);
+#endif
+    }
+    if(workers != inline_workers) {
+        json_allocator_free(allocator, workers);
+    }
+
+    return __atomic_load_n(&pool.stop, __ATOMIC_RELAXED) ? JSON_FAILURE : JSON_SUCCEED;
+}
@@ -0,0 +1,21 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stddef.h>
+
+struct json_allocator;
+
+/* runs one task on some worker; JSON_FAILURE stops the tasks not yet started */
+typedef int (*json_parallel_task)(void *ctx, size_t worker, size_t task);
+
+/* threads <= 0 means one per online cpu */
+size_t json_parallel_threads(int threads);
+/*
+ * runs tasks 0..count-1 on up to threads workers, numbered 0..threads-1, and
+ * waits for them; a pool too wide for the stack comes from allocator, NULL
+ * meaning the global one
+ */
+int json_parallel_run(size_t threads, size_t count, json_parallel_task task, void *ctx,
+                      const struct json_allocator *allocator);
+
+#endif
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include "path.h"
+#include "index.h"
+#include "json_internal.h"
+
+static long long parse_index(const char *name, size_t len)
+{
+    long long index = 0;
+    size_t i;
+
+    if(len < 3 || name[0] != '[' || name[len - 1] != ']' || len > 20) {
+        return -1;
+    }
+
+    for(i = 1; i < len - 1; i++) {
+        if(name[i] < '0' || name[i] > '9') {
+            return -1;
+        }
+        index = index * 10 + (name[i] - '0');
+    }
+
+    return index;
+}
+
+/* fills in the segment at the start of path and returns how far to advance, separator included */
+size_t json_path_lex_segment(const char *path, size_t len, struct json_path_segment *segment)
+{
+    const char *end = memchr(path, '>', len);
+    size_t name_len = end == NULL ? len : (size_t)(end - path);
+
+    segment->name = path;
+    segment->name_len = name_len;
+    segment->hash = json_index_hash(path, name_len);
+    segment->index = parse_index(path, name_len);
+
+    return end == NULL ? len : name_len + 1;
+}
+
+/* an index segment on an object still matches a member literally named "[n]" */
+struct json_value *json_path_step(struct json_root *root, struct json_value *parent, const struct json_path_segment *segment, int flags)
+{
+    if(parent != NULL && parent->type == ARRAY && segment->index >= 0) {
+        return json_value_child_at(parent, (size_t)segment->index);
+    }
+
+    return json_find_member(root, parent, segment->name, segment->name_len, segment->hash, flags);
+}
+
+struct json_path *create_json_path(const char *path, int flags)
+{
+    if(path == NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(path);
+    size_t count = 0, i = 0;
+    struct json_path_segment segment;
+
+    while(i < len) {
+        i += json_path_lex_segment(path + i, len - i, &segment);
+        count++;
+    }
+
+    /* header, segments and the name bytes they point at share one allocation */
+    struct json_path *compiled = (struct json_path *)json_malloc(sizeof(*compiled) + count * sizeof(segment) + len + 1);
+    if(compiled == NULL) {
+        return NULL;
+    }
+
+    char *names = (char *)(compiled + 1) + count * sizeof(segment);
+    memcpy(names, path, len + 1);
+
+    compiled->flags = flags;
+    compiled->count = count;
+    compiled->segments = (struct json_path_segment *)(compiled + 1);
+
+    for(i = 0, count = 0; i < len; count++) {
+        i += json_path_lex_segment(names + i, len - i, &compiled->segments[count]);
+    }
+
+    return compiled;
+}
+
+static struct json_value *path_find(struct json_root *root, const struct json_path *path)
+{
+    struct json_value *target = NULL;
+    size_t i;
+
+    for(i = 0; i < path->count; i++) {
+        target = json_path_step(root, target, &path->segments[i], path->flags);
+        if(target == NULL) {
+            return NULL;
+        }
+    }
+
+    return target;
+}
+
+struct json_value *json_path_find(struct json_root *root, const struct json_path *path)
+{
+    if(root == NULL || path == NULL || path->count == 0) {
+        return NULL;
+    }
+
+    JSON_STAT_START(start);
+    struct json_value *target = path_find(root, path);
+    JSON_STAT_STOP(finds, find_ns, start);
+
+    return target;
+}
+
+int release_json_path(struct json_path *path)
+{
+    if(path != NULL) {
+        json_free(path);
+
+        return JSON_SUCCEED;
+    }
+
+    return JSON_FAILURE;
+}
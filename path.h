@@ -0,0 +1,30 @@
+#ifndef _PATH_H_
+#define _PATH_H_
+
+#include <stdint.h>
+#include "json.h"
+
+/* one '>'-separated step; "[n]" also selects the n-th element of an array */
+typedef struct json_path_segment {
+    const char *name;
+    size_t name_len;
+    uint64_t hash;
+    long long index;
+}json_path_segment;
+
+/* a path split and hashed once, then evaluated against any number of documents */
+typedef struct json_path {
+    int flags;
+    size_t count;
+    struct json_path_segment *segments;
+}json_path;
+
+struct json_path *create_json_path(const char *path, int flags);
+struct json_value *json_path_find(struct json_root *root, const struct json_path *path);
+int release_json_path(struct json_path *path);
+struct json_value *json_document_find_path(struct json_document *doc, const struct json_path *path);
+
+size_t json_path_lex_segment(const char *path, size_t len, struct json_path_segment *segment);
+struct json_value *json_path_step(struct json_root *root, struct json_value *parent, const struct json_path_segment *segment, int flags);
+
+#endif
@@ -0,0 +1,374 @@
+#include <stdlib.h>
+#include <string.h>
+#include "push.h"
+#include "scan.h"
+#include "json_internal.h"
+
+typedef enum {
+    PUSH_START,
+    PUSH_MEMBER_FIRST,
+    PUSH_MEMBER,
+    PUSH_KEY,
+    PUSH_COLON,
+    PUSH_VALUE_FIRST,
+    PUSH_VALUE,
+    PUSH_STRING,
+    PUSH_SCALAR,
+    PUSH_AFTER_VALUE,
+    PUSH_DONE,
+    PUSH_FAILED
+}PUSH_STATE;
+
+typedef struct push_frame {
+    struct json_value *node;
+    struct json_value *last;
+    char close;
+}push_frame;
+
+struct json_push_parser {
+    struct json_parser parser;
+    struct json_root *root;
+    PUSH_STATE state;
+    int escaped;
+
+    /* bytes of the string or scalar in progress, which may span chunks */
+    struct varstr *token;
+    char *key;
+    size_t key_len;
+
+    push_frame *frames;
+    size_t depth;
+    size_t cap;
+};
+
+struct json_push_parser *create_json_push_parser(struct json_root *root)
+{
+    if(root == NULL) {
+        return NULL;
+    }
+
+    /* the parser and its scratch come from the allocator the root's arena uses */
+    const struct json_allocator *allocator = root->arena != NULL ? root->arena->allocator : NULL;
+    struct json_push_parser *parser = (struct json_push_parser *)json_allocator_alloc(allocator, sizeof(*parser));
+    if(parser == NULL) {
+        return NULL;
+    }
+
+    parser->token = create_varstr_allocator(allocator);
+    if(parser->token == NULL) {
+        json_allocator_free(allocator, parser);
+        return NULL;
+    }
+
+    parser->parser.arena = root->arena;
+    parser->parser.flags = 0;
+    parser->parser.keys = json_root_keys(root);
+    parser->parser.structurals = NULL;
+    parser->parser.max_depth = json_root_max_depth(root);
+    parser->root = root;
+    parser->state = PUSH_START;
+    parser->escaped = 0;
+    parser->key = NULL;
+    parser->key_len = 0;
+    parser->frames = NULL;
+    parser->depth = 0;
+    parser->cap = 0;
+
+    return parser;
+}
+
+int release_json_push_parser(struct json_push_parser *parser)
+{
+    if(parser == NULL) {
+        return 0;
+    }
+
+    discard_json_string(&parser->parser, parser->key);
+    const struct json_allocator *allocator = json_parser_allocator(&parser->parser);
+    release_varstr(parser->token);
+    json_allocator_free(allocator, parser->frames);
+    json_allocator_free(allocator, parser);
+
+    return 1;
+}
+
+static int push_frame_open(struct json_push_parser *parser, struct json_value *node, char close)
+{
+    if(parser->depth == parser->cap) {
+        size_t cap = parser->cap == 0 ? 16 : parser->cap * 2;
+        push_frame *frames = (push_frame *)json_allocator_realloc(json_parser_allocator(&parser->parser), parser->frames, cap * sizeof(push_frame));
+        if(frames == NULL) {
+            return 0;
+        }
+        parser->frames = frames;
+        parser->cap = cap;
+    }
+
+    parser->frames[parser->depth].node = node;
+    parser->frames[parser->depth].last = NULL;
+    parser->frames[parser->depth].close = close;
+    parser->depth++;
+    JSON_STAT_DEPTH(parser->depth);
+
+    return 1;
+}
+
+/* the node is attached as soon as it exists so a failed parse leaves nothing orphaned */
+static int push_attach(struct json_push_parser *parser, JSON_TYPE type, void *value, size_t value_len, struct json_value **out)
+{
+    struct json_value *node = init_json_value(&parser->parser, type, parser->key, parser->key_len, value, value_len);
+    if(node == NULL) {
+        return 0;
+    }
+    parser->key = NULL;
+    parser->key_len = 0;
+
+    push_frame *top = &parser->frames[parser->depth - 1];
+    if(top->node == NULL) {
+        json_root_insert_value(parser->root, node);
+    } else {
+        json_value_link(top->node, node, &top->last);
+    }
+
+    if(out != NULL) {
+        *out = node;
+    }
+
+    return 1;
+}
+
+static PUSH_STATE push_close(struct json_push_parser *parser, char c)
+{
+    if(parser->frames[parser->depth - 1].close != c) {
+        return PUSH_FAILED;
+    }
+
+    struct json_value *node = parser->frames[--parser->depth].node;
+    if(node != NULL && json_value_collect(&parser->parser, node) != JSON_SUCCEED) {
+        return PUSH_FAILED;
+    }
+
+    return parser->depth == 0 ? PUSH_DONE : PUSH_AFTER_VALUE;
+}
+
+static PUSH_STATE push_value(struct json_push_parser *parser, char c)
+{
+    struct json_value *node = NULL;
+
+    switch(c) {
+    case '{':
+    case '[':
+        if(parser->depth == parser->parser.max_depth) {
+            return PUSH_FAILED;
+        }
+        if(!push_attach(parser, c == '{' ? OBJECT : ARRAY, NULL, 0, &node)) {
+            return PUSH_FAILED;
+        }
+        if(!push_frame_open(parser, node, c == '{' ? '}' : ']')) {
+            return PUSH_FAILED;
+        }
+        return c == '{' ? PUSH_MEMBER_FIRST : PUSH_VALUE_FIRST;
+    case '\"':
+        parser->token->len = 0;
+        parser->escaped = 0;
+        return PUSH_STRING;
+    case ',':
+    case ':':
+    case '}':
+    case ']':
+        return PUSH_FAILED;
+    default:
+        parser->token->len = 0;
+        if(!append_varstr_char(parser->token, c)) {
+            return PUSH_FAILED;
+        }
+        return PUSH_SCALAR;
+    }
+}
+
+static PUSH_STATE push_scalar_done(struct json_push_parser *parser)
+{
+    struct json_value *node = NULL;
+    size_t len = json_parse_scalar(&parser->parser, &node, parser->token->data, parser->token->len, parser->key, parser->key_len);
+    if(len == 0) {
+        return PUSH_FAILED;
+    }
+
+    /* the node owns the key from here on */
+    parser->key = NULL;
+    parser->key_len = 0;
+    if(len != parser->token->len) {
+        discard_json_value(&parser->parser, node);
+        return PUSH_FAILED;
+    }
+
+    push_frame *top = &parser->frames[parser->depth - 1];
+    if(top->node == NULL) {
+        json_root_insert_value(parser->root, node);
+    } else {
+        json_value_link(top->node, node, &top->last);
+    }
+
+    return PUSH_AFTER_VALUE;
+}
+
+/* consumes string bytes up to the closing quote; returns how many bytes were used, or -1 on error */
+static long push_string(struct json_push_parser *parser, const char *data, size_t len, int *done)
+{
+    size_t i = 0;
+
+    *done = 0;
+    while(i < len) {
+        if(parser->escaped) {
+            parser->escaped = 0;
+            i++;
+            continue;
+        }
+
+        i += json_scan_string(data + i, len - i);
+        if(i >= len) {
+            break;
+        }
+
+        if(data[i] == '\\') {
+            parser->escaped = 1;
+            i++;
+            continue;
+        }
+
+        if(data[i] == '\"') {
+            *done = 1;
+            break;
+        }
+
+        if(data[i] == '\n' || data[i] == '\r' || data[i] == '\t' || data[i] == '\b') {
+            return -1;
+        }
+
+        i++;
+    }
+
+    if(!append_varstr(parser->token, data, i)) {
+        return -1;
+    }
+
+    return *done ? (long)i + 1 : (long)i;
+}
+
+JSON_PUSH_STATUS json_push_parser_feed(struct json_push_parser *parser, const char *data, size_t len)
+{
+    if(parser == NULL || (data == NULL && len != 0)) {
+        return JSON_PUSH_ERROR;
+    }
+    JSON_STAT_ADD(bytes_parsed, len);
+
+    size_t i = 0;
+    int done = 0;
+    long used = 0;
+    char c;
+
+    while(i < len && parser->state != PUSH_FAILED) {
+        switch(parser->state) {
+        case PUSH_KEY:
+        case PUSH_STRING:
+            used = push_string(parser, data + i, len - i, &done);
+            if(used < 0) {
+                parser->state = PUSH_FAILED;
+                break;
+            }
+            i += used;
+            if(!done) {
+                break;
+            }
+
+            if(parser->state == PUSH_KEY) {
+                parser->key = json_parser_key(&parser->parser, parser->token->data, parser->token->len);
+                parser->key_len = parser->token->len;
+                parser->state = parser->key == NULL ? PUSH_FAILED : PUSH_COLON;
+            } else {
+                char *value = json_parser_strndup(&parser->parser, parser->token->data, parser->token->len);
+                if(value == NULL || !push_attach(parser, STRING, value, parser->token->len, NULL)) {
+                    discard_json_string(&parser->parser, value);
+                    parser->state = PUSH_FAILED;
+                    break;
+                }
+                parser->state = PUSH_AFTER_VALUE;
+            }
+            break;
+        case PUSH_SCALAR:
+            c = data[i];
+            if(c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' || c == '}' || c == ']') {
+                parser->state = push_scalar_done(parser);
+                break;
+            }
+            if(!append_varstr_char(parser->token, c)) {
+                parser->state = PUSH_FAILED;
+                break;
+            }
+            i++;
+            break;
+        default:
+            i += json_skip_whitespace(data + i, len - i);
+            if(i >= len) {
+                break;
+            }
+
+            c = data[i++];
+            switch(parser->state) {
+            case PUSH_START:
+                if(c != '{' || !push_frame_open(parser, NULL, '}')) {
+                    parser->state = PUSH_FAILED;
+                    break;
+                }
+                parser->state = PUSH_MEMBER_FIRST;
+                break;
+            case PUSH_MEMBER_FIRST:
+                if(c == '}') {
+                    parser->state = push_close(parser, c);
+                    break;
+                }
+                /* fall through */
+            case PUSH_MEMBER:
+                if(c != '\"') {
+                    parser->state = PUSH_FAILED;
+                    break;
+                }
+                parser->token->len = 0;
+                parser->escaped = 0;
+                parser->state = PUSH_KEY;
+                break;
+            case PUSH_COLON:
+                parser->state = c == ':' ? PUSH_VALUE : PUSH_FAILED;
+                break;
+            case PUSH_VALUE_FIRST:
+                if(c == ']') {
+                    parser->state = push_close(parser, c);
+                    break;
+                }
+                /* fall through */
+            case PUSH_VALUE:
+                parser->state = push_value(parser, c);
+                break;
+            case PUSH_AFTER_VALUE:
+                if(c == ',') {
+                    parser->state = parser->frames[parser->depth - 1].close == '}' ? PUSH_MEMBER : PUSH_VALUE;
+                } else if(c == '}' || c == ']') {
+                    parser->state = push_close(parser, c);
+                } else {
+                    parser->state = PUSH_FAILED;
+                }
+                break;
+            default:
+                /* only whitespace may follow the closing brace */
+                parser->state = PUSH_FAILED;
+                break;
+            }
+        }
+    }
+
+    if(parser->state == PUSH_FAILED) {
+        return JSON_PUSH_ERROR;
+    }
+
+    return parser->state == PUSH_DONE ? JSON_PUSH_DONE : JSON_PUSH_NEED_MORE;
+}
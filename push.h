@@ -0,0 +1,20 @@
+#ifndef _PUSH_H_
+#define _PUSH_H_
+
+#include <stddef.h>
+#include "json.h"
+
+typedef enum {
+    JSON_PUSH_NEED_MORE,
+    JSON_PUSH_DONE,
+    JSON_PUSH_ERROR
+}JSON_PUSH_STATUS;
+
+struct json_push_parser;
+
+/* members are inserted into root as they complete; an arena-owned root keeps using its arena */
+struct json_push_parser *create_json_push_parser(struct json_root *root);
+JSON_PUSH_STATUS json_push_parser_feed(struct json_push_parser *parser, const char *data, size_t len);
+int release_json_push_parser(struct json_push_parser *parser);
+
+#endif
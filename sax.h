@@ -0,0 +1,28 @@
+#ifndef _SAX_H_
+#define _SAX_H_
+
+#include <stddef.h>
+
+/*
+ * Callbacks for json_sax_parse. Any of them may be NULL; returning 0 stops
+ * the parse. Keys and strings are views into the input, still escaped.
+ * Containers nested deeper than the depth limit, JSON_PARSE_DEPTH_MAX unless
+ * json_sax_parse_depth is given another, fail the parse.
+ */
+typedef struct json_sax_handler {
+    int (*start_object)(void *ctx);
+    int (*end_object)(void *ctx);
+    int (*start_array)(void *ctx);
+    int (*end_array)(void *ctx);
+    int (*key)(void *ctx, const char *key, size_t len);
+    int (*string)(void *ctx, const char *value, size_t len);
+    int (*number)(void *ctx, long long value);
+    int (*decimal)(void *ctx, double value);
+    int (*boolean)(void *ctx, int value);
+}json_sax_handler;
+
+int json_sax_parse(const char *data, size_t len, const struct json_sax_handler *handler, void *ctx);
+/* max_depth 0 means JSON_PARSE_DEPTH_MAX; the walk keeps one byte per open container, not C stack */
+int json_sax_parse_depth(const char *data, size_t len, const struct json_sax_handler *handler, void *ctx, size_t max_depth);
+
+#endif
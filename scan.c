@@ -0,0 +1,162 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_SCAN_X86 1
+#endif
+
+#define IS_WHITESPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+#define IS_STRING_STOP(c) ((c) == '\"' || (c) == '\\' || (unsigned char)(c) < 0x20)
+
+size_t json_skip_whitespace_scalar(const char *data, size_t len)
+{
+    size_t i = 0;
+    while(i < len && IS_WHITESPACE(data[i])) {
+        i++;
+    }
+
+    return i;
+}
+
+size_t json_scan_string_scalar(const char *data, size_t len)
+{
+    size_t i = 0;
+    while(i < len && !IS_STRING_STOP(data[i])) {
+        i++;
+    }
+
+    return i;
+}
+
+#if defined(JSON_SCAN_X86) && defined(__SSE2__)
+static size_t json_skip_whitespace_sse2(const char *data, size_t len)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i carriage = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+    size_t i = 0;
+
+    while(i + 16 <= len) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, newline)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage), _mm_cmpeq_epi8(chunk, tab)));
+        unsigned int mask = ~_mm_movemask_epi8(ws) & 0xffff;
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+
+    return i + json_skip_whitespace_scalar(data + i, len - i);
+}
+
+static size_t json_scan_string_sse2(const char *data, size_t len)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    size_t i = 0;
+
+    while(i + 16 <= len) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i stop = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                    _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        unsigned int mask = _mm_movemask_epi8(stop);
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+
+    return i + json_scan_string_scalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t json_skip_whitespace_avx2(const char *data, size_t len)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    size_t i = 0;
+
+    while(i + 32 <= len) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, newline)),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(chunk, carriage), _mm256_cmpeq_epi8(chunk, tab)));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 32;
+    }
+
+    /* the fallback is legacy SSE; entering it with dirty upper halves stalls every call */
+    _mm256_zeroupper();
+
+    return i + json_skip_whitespace_sse2(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t json_scan_string_avx2(const char *data, size_t len)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    size_t i = 0;
+
+    while(i + 32 <= len) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i stop = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                                       _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control));
+        unsigned int mask = _mm256_movemask_epi8(stop);
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 32;
+    }
+
+    _mm256_zeroupper();
+
+    return i + json_scan_string_sse2(data + i, len - i);
+}
+#endif
+
+/*
+ * The SIMD variant is picked once, before main, so the pointers are never
+ * written while another thread may be scanning. Until then they hold the
+ * baseline every build of this target can run.
+ */
+#if defined(JSON_SCAN_X86) && defined(__SSE2__)
+static size_t (*skip_whitespace_impl)(const char *, size_t) = json_skip_whitespace_sse2;
+static size_t (*scan_string_impl)(const char *, size_t) = json_scan_string_sse2;
+
+__attribute__((constructor))
+static void json_scan_select()
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        skip_whitespace_impl = json_skip_whitespace_avx2;
+        scan_string_impl = json_scan_string_avx2;
+    }
+}
+#else
+static size_t (*skip_whitespace_impl)(const char *, size_t) = json_skip_whitespace_scalar;
+static size_t (*scan_string_impl)(const char *, size_t) = json_scan_string_scalar;
+#endif
+
+size_t json_skip_whitespace(const char *data, size_t len)
+{
+    /* most runs between tokens are a byte or two; don't pay for a vector load */
+    if(len == 0 || !IS_WHITESPACE(data[0])) {
+        return 0;
+    }
+
+    return skip_whitespace_impl(data, len);
+}
+
+size_t json_scan_string(const char *data, size_t len)
+{
+    return scan_string_impl(data, len);
+}
@@ -0,0 +1,14 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h>
+
+/* index of the first byte that is not ' ', '\n', '\r' or '\t', or len */
+size_t json_skip_whitespace(const char *data, size_t len);
+/* index of the first '"', '\\' or control byte, or len */
+size_t json_scan_string(const char *data, size_t len);
+
+size_t json_skip_whitespace_scalar(const char *data, size_t len);
+size_t json_scan_string_scalar(const char *data, size_t len);
+
+#endif
@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "serialize.h"
+#include "json_internal.h"
+#include "parallel.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* no group is smaller than this, however many threads there are */
+#define SERIAL_GROUP_MIN 256
+/* containers nested deeper are written whole by json_value_serialize, which keeps its stack off the C stack */
+#define SERIAL_PLAN_DEPTH 64
+
+/* a run of text written while planning, or a group of siblings a worker writes */
+typedef struct serial_piece {
+    struct varstr *text;
+    struct json_value *first;
+    size_t count;
+    int leading_comma;
+}serial_piece;
+
+typedef struct serial_plan {
+    struct serial_piece *pieces;
+    size_t count;
+    size_t cap;
+    size_t tasks;
+    size_t *task_pieces;
+    size_t threads;
+}serial_plan;
+
+static struct serial_piece *plan_piece(struct serial_plan *plan)
+{
+    if(plan->count == plan->cap) {
+        size_t cap = plan->cap == 0 ? 64 : plan->cap * 2;
+        struct serial_piece *pieces = (struct serial_piece *)json_realloc(plan->pieces, cap * sizeof(*pieces));
+        if(pieces == NULL) {
+            return NULL;
+        }
+        plan->pieces = pieces;
+        plan->cap = cap;
+    }
+
+    struct serial_piece *piece = &plan->pieces[plan->count];
+    piece->text = create_varstr();
+    if(piece->text == NULL) {
+        return NULL;
+    }
+    piece->first = NULL;
+    piece->count = 0;
+    piece->leading_comma = 0;
+    plan->count++;
+
+    return piece;
+}
+
+static struct varstr *plan_glue(struct serial_plan *plan)
+{
+    if(plan->count > 0 && plan->pieces[plan->count - 1].first == NULL) {
+        return plan->pieces[plan->count - 1].text;
+    }
+
+    struct serial_piece *piece = plan_piece(plan);
+
+    return piece == NULL ? NULL : piece->text;
+}
+
+static int plan_value(struct serial_plan *plan, struct json_value *value, size_t depth);
+
+/* mirrors the member and element loops of json_value_serialize and json_serialize */
+static int plan_children(struct serial_plan *plan, struct json_value *first, size_t depth)
+{
+    struct json_value *child = NULL;
+    size_t count = 0, k;
+
+    for(child = first; child != NULL; child = child->next) {
+        count++;
+    }
+
+    if(count >= JSON_PARALLEL_CHILDREN) {
+        size_t group = count / (plan->threads * 8);
+        if(group < SERIAL_GROUP_MIN) {
+            group = SERIAL_GROUP_MIN;
+        }
+
+        for(child = first, k = 0; child != NULL; ) {
+            struct serial_piece *piece = plan_piece(plan);
+            if(piece == NULL) {
+                return JSON_FAILURE;
+            }
+            piece->first = child;
+            piece->count = count - k < group ? count - k : group;
+            piece->leading_comma = k > 0;
+            plan->tasks++;
+
+            size_t n;
+            for(n = 0; n < piece->count; n++) {
+                child = child->next;
+            }
+            k += piece->count;
+        }
+
+        return JSON_SUCCEED;
+    }
+
+    for(child = first; child != NULL; child = child->next) {
+        if(child != first) {
+            struct varstr *glue = plan_glue(plan);
+            if(glue == NULL) {
+                return JSON_FAILURE;
+            }
+            append_varstr_char(glue, ',');
+        }
+        if(plan_value(plan, child, depth) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+    }
+
+    return JSON_SUCCEED;
+}
+
+static int plan_value(struct serial_plan *plan, struct json_value *value, size_t depth)
+{
+    struct varstr *glue = plan_glue(plan);
+    if(glue == NULL) {
+        return JSON_FAILURE;
+    }
+
+    if((value->type != OBJECT && value->type != ARRAY) || depth == SERIAL_PLAN_DEPTH) {
+        return json_value_serialize(value, glue);
+    }
+
+    if(value->anonymous != 1) {
+        append_varstr_char(glue, '\"');
+        append_varstr(glue, value->name, value->name_len);
+        append_varstr_literal(glue, "\":");
+    }
+    append_varstr_char(glue, value->type == OBJECT ? '{' : '[');
+
+    if(plan_children(plan, value->value.children, depth + 1) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    glue = plan_glue(plan);
+    if(glue == NULL) {
+        return JSON_FAILURE;
+    }
+    append_varstr_char(glue, value->type == OBJECT ? '}' : ']');
+
+    return JSON_SUCCEED;
+}
+
+static int serial_task(void *ctx, size_t worker, size_t task)
+{
+    struct serial_plan *plan = (struct serial_plan *)ctx;
+    struct serial_piece *piece = &plan->pieces[plan->task_pieces[task]];
+    size_t k;
+
+    struct json_value *child = piece->first;
+    for(k = 0; k < piece->count; k++) {
+        if(k > 0 || piece->leading_comma) {
+            append_varstr_char(piece->text, ',');
+        }
+        if(json_value_serialize(child, piece->text) != JSON_SUCCEED) {
+            return JSON_FAILURE;
+        }
+        child = child->next;
+    }
+
+    return JSON_SUCCEED;
+}
+
+static void release_plan(struct serial_plan *plan)
+{
+    size_t k;
+    for(k = 0; k < plan->count; k++) {
+        release_varstr(plan->pieces[k].text);
+    }
+    json_free(plan->pieces);
+    json_free(plan->task_pieces);
+}
+
+static int run_plan(struct serial_plan *plan, struct json_root *root, int threads)
+{
+    memset(plan, 0, sizeof(*plan));
+    plan->threads = json_parallel_threads(threads);
+
+    struct varstr *glue = plan_glue(plan);
+    if(glue == NULL) {
+        return JSON_FAILURE;
+    }
+    append_varstr_char(glue, '{');
+
+    if(plan_children(plan, root->elems, 1) != JSON_SUCCEED) {
+        return JSON_FAILURE;
+    }
+
+    glue = plan_glue(plan);
+    if(glue == NULL) {
+        return JSON_FAILURE;
+    }
+    append_varstr_char(glue, '}');
+
+    if(plan->tasks == 0) {
+        return JSON_SUCCEED;
+    }
+
+    /* the pieces array only stops moving once planning is done */
+    plan->task_pieces = (size_t *)json_malloc(plan->tasks * sizeof(size_t));
+    if(plan->task_pieces == NULL) {
+        return JSON_FAILURE;
+    }
+    size_t k, n = 0;
+    for(k = 0; k < plan->count; k++) {
+        if(plan->pieces[k].first != NULL) {
+            plan->task_pieces[n++] = k;
+        }
+    }
+
+    return json_parallel_run(plan->threads, plan->tasks, serial_task, plan, NULL);
+}
+
+int json_serialize_parallel(struct json_root *root, struct varstr *str, int threads)
+{
+    if(root == NULL || str == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* with one worker the pieces would only add a copy */
+    if(json_parallel_threads(threads) == 1) {
+        return json_serialize(root, str);
+    }
+
+    JSON_STAT_START(start);
+    struct serial_plan plan;
+    int res = run_plan(&plan, root, threads);
+    if(res == JSON_SUCCEED) {
+        size_t total = str->len, k;
+        for(k = 0; k < plan.count; k++) {
+            total += plan.pieces[k].text->len;
+        }
+        reserve_varstr(str, total);
+        for(k = 0; k < plan.count; k++) {
+            append_varstr(str, plan.pieces[k].text->data, plan.pieces[k].text->len);
+        }
+    }
+    release_plan(&plan);
+    JSON_STAT_STOP(serializes, serialize_ns, start);
+
+    return res;
+}
+
+static int write_pieces(int fd, struct serial_piece *pieces, size_t count)
+{
+    struct iovec iov[IOV_MAX];
+    size_t next = 0, k;
+
+    while(next < count) {
+        size_t n = 0;
+        for(k = next; k < count && n < IOV_MAX; k++) {
+            if(pieces[k].text->len > 0) {
+                iov[n].iov_base = pieces[k].text->data;
+                iov[n].iov_len = pieces[k].text->len;
+                n++;
+            }
+        }
+        next = k;
+
+        /* short writes leave the front of the batch partly written */
+        struct iovec *cur = iov;
+        while(n > 0) {
+            ssize_t written = writev(fd, cur, (int)n);
+            if(written < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return JSON_FAILURE;
+            }
+            while(n > 0 && (size_t)written >= cur->iov_len) {
+                written -= cur->iov_len;
+                cur++;
+                n--;
+            }
+            if(n > 0) {
+                cur->iov_base = (char *)cur->iov_base + written;
+                cur->iov_len -= written;
+            }
+        }
+    }
+
+    return JSON_SUCCEED;
+}
+
+int json_serialize_fd(struct json_root *root, int fd, int threads)
+{
+    if(root == NULL || fd < 0) {
+        return JSON_FAILURE;
+    }
+
+    JSON_STAT_START(start);
+    struct serial_plan plan;
+    int res = run_plan(&plan, root, threads);
+    if(res == JSON_SUCCEED) {
+        res = write_pieces(fd, plan.pieces, plan.count);
+    }
+    release_plan(&plan);
+    JSON_STAT_STOP(serializes, serialize_ns, start);
+
+    return res;
+}
@@ -0,0 +1,14 @@
+#ifndef _SERIALIZE_H_
+#define _SERIALIZE_H_
+
+#include "json.h"
+
+/* containers with at least this many children have them serialized in groups on the worker pool */
+#define JSON_PARALLEL_CHILDREN 1024
+
+/* byte-identical to json_serialize; threads <= 0 means one per online cpu */
+int json_serialize_parallel(struct json_root *root, struct varstr *str, int threads);
+/* as above, but the per-thread buffers go straight to fd through writev */
+int json_serialize_fd(struct json_root *root, int fd, int threads);
+
+#endif
@@ -0,0 +1,617 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "snapshot.h"
+#include "json_internal.h"
+#include "index.h"
+
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+#define SNAPSHOT_ALIGN(size) (((size) + 7) & ~(uint64_t)7)
+
+/*
+ * A cell is one value. Scalars keep it in n; strings and containers keep the
+ * offset of their body there:
+ *   string  length, bytes, NUL
+ *   array   count, then a cell per element
+ *   object  count, slot count, a member per key, the slots, then the names
+ */
+typedef struct snapshot_cell {
+    /* a member's name length; unused elsewhere */
+    uint32_t aux;
+    uint32_t type;
+    uint64_t n;
+}snapshot_cell;
+
+typedef struct snapshot_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint64_t size;
+    struct snapshot_cell root;
+}snapshot_header;
+
+typedef struct snapshot_object {
+    uint64_t count;
+    uint64_t cap;
+}snapshot_object;
+
+typedef struct snapshot_member {
+    uint64_t name;
+    struct snapshot_cell cell;
+}snapshot_member;
+
+/* member is 1-based so that a zeroed slot is empty */
+typedef struct snapshot_slot {
+    uint64_t hash;
+    uint64_t member;
+}snapshot_slot;
+
+/* reserves size zeroed bytes at the next 8-byte boundary and returns their offset */
+static uint64_t snapshot_reserve(struct varstr *str, uint64_t size)
+{
+    uint64_t at = SNAPSHOT_ALIGN(str->len);
+    if(reserve_varstr(str, at - str->len + size) == 0) {
+        return 0;
+    }
+
+    memset(str->data + str->len, 0, at - str->len + size);
+    str->len = at + size;
+    str->data[str->len] = '\0';
+
+    return at;
+}
+
+/* a container whose cells are being filled in: the child to write next, its cell, and the distance to the one after */
+struct snapshot_frame {
+    struct json_value *next;
+    uint64_t cell;
+    size_t stride;
+};
+
+/*
+ * Writes a container's body with its cells still blank, and fills frame in
+ * for them. Returns the offset of the body, which is never 0 since the
+ * header comes first.
+ */
+static uint64_t write_members(struct varstr *str, JSON_TYPE type, struct json_value *children, struct snapshot_frame *frame)
+{
+    size_t count = 0, cap = 0, i;
+    struct json_value *child = NULL;
+    for(child = children; child != NULL; child = child->next) {
+        count++;
+    }
+
+    if(type == ARRAY) {
+        uint64_t at = snapshot_reserve(str, sizeof(uint64_t) + count * sizeof(struct snapshot_cell));
+        if(at == 0) {
+            return 0;
+        }
+        uint64_t n = count;
+        memcpy(str->data + at, &n, sizeof(n));
+
+        frame->next = children;
+        frame->cell = at + sizeof(uint64_t);
+        frame->stride = sizeof(struct snapshot_cell);
+
+        return at;
+    }
+
+    if(count >= JSON_INDEX_THRESHOLD) {
+        cap = 16;
+        while(cap < count * 2) {
+            cap *= 2;
+        }
+    }
+
+    uint64_t at = snapshot_reserve(str, sizeof(struct snapshot_object) + count * sizeof(struct snapshot_member) + cap * sizeof(struct snapshot_slot));
+    if(at == 0) {
+        return 0;
+    }
+    struct snapshot_object object = { count, cap };
+    memcpy(str->data + at, &object, sizeof(object));
+
+    uint64_t members = at + sizeof(object);
+    uint64_t slots = members + count * sizeof(struct snapshot_member);
+    for(child = children, i = 0; child != NULL; child = child->next, i++) {
+        if(child->name_len > UINT32_MAX) {
+            return 0;
+        }
+        struct snapshot_member member = { str->len, { (uint32_t)child->name_len, 0, 0 } };
+        if(append_varstr(str, child->name == NULL ? "" : child->name, child->name_len) == 0 || append_varstr_char(str, '\0') == 0) {
+            return 0;
+        }
+        memcpy(str->data + members + i * sizeof(member), &member, sizeof(member));
+
+        /* placed in list order, so the first of equal keys is met first, as in index.c */
+        if(cap != 0) {
+            uint64_t hash = json_index_hash(child->name, child->name_len);
+            size_t slot = (size_t)hash & (cap - 1);
+            struct snapshot_slot entry;
+            for(;;) {
+                memcpy(&entry, str->data + slots + slot * sizeof(entry), sizeof(entry));
+                if(entry.member == 0) {
+                    break;
+                }
+                slot = (slot + 1) & (cap - 1);
+            }
+            entry.hash = hash;
+            entry.member = i + 1;
+            memcpy(str->data + slots + slot * sizeof(entry), &entry, sizeof(entry));
+        }
+    }
+
+    frame->next = children;
+    frame->cell = members + offsetof(struct snapshot_member, cell);
+    frame->stride = sizeof(struct snapshot_member);
+
+    return at;
+}
+
+/*
+ * Fills in the type and n of the cell at offset cell, writing the body first
+ * if there is one. A container's own cells are left to the caller, in frame.
+ */
+static int write_cell(struct varstr *str, uint64_t cell, struct json_value *value, struct snapshot_frame *frame)
+{
+    uint64_t n = 0;
+    uint32_t type = value->type;
+    union {
+        float f;
+        uint32_t u;
+    }single;
+    union {
+        double d;
+        uint64_t u;
+    }wide;
+
+    switch(value->type) {
+    case NUMBER:
+        n = (uint64_t)value->value.number;
+        break;
+    case BOOLEAN:
+        n = value->value.boolean != 0;
+        break;
+    case FLOAT:
+        single.f = value->value.float_decimal;
+        n = single.u;
+        break;
+    case DOUBLE:
+        wide.d = value->value.double_decimal;
+        n = wide.u;
+        break;
+    case STRING: {
+        uint64_t len = value->value.string == NULL ? 0 : value->string_len;
+        n = snapshot_reserve(str, sizeof(len) + len + 1);
+        if(n == 0) {
+            return JSON_FAILURE;
+        }
+        memcpy(str->data + n, &len, sizeof(len));
+        if(len != 0) {
+            memcpy(str->data + n + sizeof(len), value->value.string, len);
+        }
+        break;
+    }
+    case ARRAY:
+    case OBJECT:
+        n = write_members(str, value->type, value->value.children, frame);
+        if(n == 0) {
+            return JSON_FAILURE;
+        }
+        break;
+    }
+
+    memcpy(str->data + cell + offsetof(struct snapshot_cell, type), &type, sizeof(type));
+    memcpy(str->data + cell + offsetof(struct snapshot_cell, n), &n, sizeof(n));
+
+    return JSON_SUCCEED;
+}
+
+/*
+ * The root object and everything under it, depth first so every body comes
+ * out in the order a recursive walk would write it, with the containers
+ * still being filled in on an explicit stack. Returns the root body's offset.
+ */
+static uint64_t write_tree(struct varstr *str, struct json_value *elems)
+{
+    struct snapshot_frame inline_frames[JSON_WALK_INLINE_DEPTH];
+    struct snapshot_frame *frames = inline_frames, *grown = NULL;
+    size_t depth = 1, cap = JSON_WALK_INLINE_DEPTH;
+
+    uint64_t body = write_members(str, OBJECT, elems, &frames[0]);
+    while(body != 0 && depth > 0) {
+        struct snapshot_frame *frame = &frames[depth - 1];
+        struct json_value *child = frame->next;
+        if(child == NULL) {
+            depth--;
+            continue;
+        }
+        uint64_t cell = frame->cell;
+        frame->next = child->next;
+        frame->cell += frame->stride;
+
+        if(depth == cap) {
+            grown = (struct snapshot_frame *)json_stack_grow(frames, inline_frames, &cap, sizeof(*frames), NULL);
+            if(grown == NULL) {
+                body = 0;
+                break;
+            }
+            frames = grown;
+        }
+        /* a container fills in the next frame, which then goes on the stack */
+        frames[depth].next = NULL;
+        if(write_cell(str, cell, child, &frames[depth]) != JSON_SUCCEED) {
+            body = 0;
+        } else if(child->type == ARRAY || child->type == OBJECT) {
+            depth++;
+        }
+    }
+
+    if(frames != inline_frames) {
+        json_free(frames);
+    }
+
+    return body;
+}
+
+int json_snapshot_write(struct json_root *root, struct varstr *str)
+{
+    if(root == NULL || str == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* offsets count from str->data, which malloc aligns, so the image starts there */
+    str->len = 0;
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    if(append_varstr(str, (char *)&header, sizeof(header)) == 0) {
+        return JSON_FAILURE;
+    }
+
+    uint64_t body = write_tree(str, root->elems);
+    if(body == 0 || snapshot_reserve(str, 0) == 0) {
+        return JSON_FAILURE;
+    }
+
+    memcpy(header.magic, JSON_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.version = JSON_SNAPSHOT_VERSION;
+    header.size = str->len;
+    header.root.type = OBJECT;
+    header.root.n = body;
+    memcpy(str->data, &header, sizeof(header));
+
+    return JSON_SUCCEED;
+}
+
+int json_snapshot_save(struct json_root *root, const char *path)
+{
+    if(path == NULL) {
+        return JSON_FAILURE;
+    }
+
+    struct varstr *image = create_varstr();
+    if(image == NULL) {
+        return JSON_FAILURE;
+    }
+    if(json_snapshot_write(root, image) != JSON_SUCCEED) {
+        release_varstr(image);
+        return JSON_FAILURE;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        release_varstr(image);
+        return JSON_FAILURE;
+    }
+
+    size_t done = 0;
+    while(done < image->len) {
+        ssize_t n = write(fd, image->data + done, image->len - done);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+
+    int res = close(fd) == 0 && done == image->len;
+    release_varstr(image);
+
+    return res ? JSON_SUCCEED : JSON_FAILURE;
+}
+
+struct json_snapshot *json_snapshot_from_memory(const char *data, size_t len)
+{
+    struct snapshot_header header;
+    if(data == NULL || len < sizeof(header) || ((uintptr_t)data & 7) != 0) {
+        return NULL;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, JSON_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.byte_order != SNAPSHOT_BYTE_ORDER
+            || header.version != JSON_SNAPSHOT_VERSION || header.size > len || header.root.type != OBJECT
+            || header.root.n < sizeof(header) || header.root.n + sizeof(struct snapshot_object) > header.size) {
+        return NULL;
+    }
+
+    struct json_snapshot *snap = (struct json_snapshot *)json_malloc(sizeof(*snap));
+    if(snap == NULL) {
+        return NULL;
+    }
+
+    snap->base = data;
+    snap->len = (size_t)header.size;
+    snap->map = NULL;
+    snap->map_len = 0;
+
+    return snap;
+}
+
+/* mapped without read-ahead: a lookup touches a few pages, wherever they are */
+struct json_snapshot *json_snapshot_open(const char *path)
+{
+    if(path == NULL) {
+        return NULL;
+    }
+
+    size_t size = 0;
+    char *data = json_map_file(path, &size, 0);
+    if(data == NULL) {
+        return NULL;
+    }
+
+    struct json_snapshot *snap = json_snapshot_from_memory(data, size);
+    if(snap == NULL) {
+        munmap(data, size);
+        return NULL;
+    }
+    snap->map = data;
+    snap->map_len = size;
+
+    return snap;
+}
+
+int json_snapshot_close(struct json_snapshot *snap)
+{
+    if(snap == NULL) {
+        return JSON_FAILURE;
+    }
+
+    if(snap->map != NULL) {
+        munmap(snap->map, snap->map_len);
+    }
+    json_free(snap);
+
+    return JSON_SUCCEED;
+}
+
+static const struct snapshot_cell *view_cell(struct json_view view)
+{
+    return (const struct snapshot_cell *)(view.base + view.offset);
+}
+
+static const char *view_body(struct json_view view)
+{
+    return view.base + view_cell(view)->n;
+}
+
+static struct json_view view_at(const char *base, uint64_t offset)
+{
+    struct json_view view = { base, offset };
+
+    return view;
+}
+
+struct json_view json_snapshot_root(struct json_snapshot *snap)
+{
+    if(snap == NULL) {
+        return view_at(NULL, 0);
+    }
+
+    return view_at(snap->base, offsetof(struct snapshot_header, root));
+}
+
+int json_view_valid(struct json_view view)
+{
+    return view.base != NULL && view.offset != 0;
+}
+
+JSON_TYPE json_view_type(struct json_view view)
+{
+    return (JSON_TYPE)view_cell(view)->type;
+}
+
+size_t json_view_count(struct json_view view)
+{
+    if(!json_view_valid(view)) {
+        return 0;
+    }
+
+    uint32_t type = view_cell(view)->type;
+    if(type != ARRAY && type != OBJECT) {
+        return 0;
+    }
+
+    return (size_t)*(const uint64_t *)view_body(view);
+}
+
+static int name_matches(struct json_view object, const struct snapshot_member *member, const char *name, size_t name_len, int flags)
+{
+    if(member->cell.aux != name_len) {
+        return 0;
+    }
+
+    if(flags & JSON_FIND_CASE_SENSITIVE) {
+        return !memcmp(object.base + member->name, name, name_len);
+    }
+
+    return !strncasecmp(object.base + member->name, name, name_len);
+}
+
+static struct json_view member_view(struct json_view object, const struct snapshot_member *member)
+{
+    return view_at(object.base, (uint64_t)((const char *)&member->cell - object.base));
+}
+
+/* the small-object scan and the key table answer exactly as find_member and json_index_find do */
+static struct json_view view_member(struct json_view object, const char *name, size_t name_len, uint64_t hash, int flags)
+{
+    const struct snapshot_object *header = (const struct snapshot_object *)view_body(object);
+    const struct snapshot_member *members = (const struct snapshot_member *)(header + 1);
+    size_t i;
+
+    if(header->cap == 0) {
+        for(i = 0; i < header->count; i++) {
+            if(name_matches(object, &members[i], name, name_len, flags)) {
+                return member_view(object, &members[i]);
+            }
+        }
+        return view_at(object.base, 0);
+    }
+
+    const struct snapshot_slot *slots = (const struct snapshot_slot *)(members + header->count);
+    size_t mask = (size_t)header->cap - 1;
+    for(i = (size_t)hash & mask; slots[i].member != 0; i = (i + 1) & mask) {
+        const struct snapshot_member *member = &members[slots[i].member - 1];
+        if(slots[i].hash == hash && name_matches(object, member, name, name_len, flags)) {
+            return member_view(object, member);
+        }
+    }
+
+    return view_at(object.base, 0);
+}
+
+struct json_view json_view_member(struct json_view object, const char *name, size_t name_len, int flags)
+{
+    if(!json_view_valid(object) || name == NULL || view_cell(object)->type != OBJECT) {
+        return view_at(object.base, 0);
+    }
+
+    return view_member(object, name, name_len, json_index_hash(name, name_len), flags);
+}
+
+struct json_view json_view_at(struct json_view container, size_t n)
+{
+    if(n >= json_view_count(container)) {
+        return view_at(container.base, 0);
+    }
+
+    const char *body = view_body(container);
+    if(view_cell(container)->type == ARRAY) {
+        return view_at(container.base, (uint64_t)(body - container.base) + sizeof(uint64_t) + n * sizeof(struct snapshot_cell));
+    }
+
+    return member_view(container, (const struct snapshot_member *)((const struct snapshot_object *)body + 1) + n);
+}
+
+const char *json_view_name_at(struct json_view object, size_t n, size_t *name_len)
+{
+    if(n >= json_view_count(object) || view_cell(object)->type != OBJECT) {
+        return NULL;
+    }
+
+    const struct snapshot_member *member = (const struct snapshot_member *)((const struct snapshot_object *)view_body(object) + 1) + n;
+    if(name_len != NULL) {
+        *name_len = member->cell.aux;
+    }
+
+    return object.base + member->name;
+}
+
+static struct json_view view_step(struct json_view parent, const struct json_path_segment *segment, int flags)
+{
+    JSON_TYPE type = json_view_type(parent);
+    if(type == ARRAY && segment->index >= 0) {
+        return json_view_at(parent, (size_t)segment->index);
+    }
+    if(type != OBJECT) {
+        return view_at(parent.base, 0);
+    }
+
+    return view_member(parent, segment->name, segment->name_len, segment->hash, flags);
+}
+
+struct json_view json_snapshot_find(struct json_snapshot *snap, const char *path, int flags)
+{
+    struct json_view view = json_snapshot_root(snap);
+    if(path == NULL || !json_view_valid(view)) {
+        return view_at(NULL, 0);
+    }
+
+    struct json_path_segment segment;
+    size_t len = strlen(path);
+    size_t i = 0;
+
+    while(i < len && json_view_valid(view)) {
+        i += json_path_lex_segment(path + i, len - i, &segment);
+        view = view_step(view, &segment, flags);
+    }
+
+    return len == 0 ? view_at(snap->base, 0) : view;
+}
+
+struct json_view json_snapshot_find_path(struct json_snapshot *snap, const struct json_path *path)
+{
+    struct json_view view = json_snapshot_root(snap);
+    if(path == NULL || path->count == 0 || !json_view_valid(view)) {
+        return view_at(NULL, 0);
+    }
+
+    size_t i;
+    for(i = 0; i < path->count && json_view_valid(view); i++) {
+        view = view_step(view, &path->segments[i], path->flags);
+    }
+
+    return view;
+}
+
+long long json_view_number(struct json_view view)
+{
+    return (long long)view_cell(view)->n;
+}
+
+int json_view_boolean(struct json_view view)
+{
+    return (int)view_cell(view)->n;
+}
+
+float json_view_float(struct json_view view)
+{
+    union {
+        float f;
+        uint32_t u;
+    }single;
+    single.u = (uint32_t)view_cell(view)->n;
+
+    return single.f;
+}
+
+double json_view_double(struct json_view view)
+{
+    union {
+        double d;
+        uint64_t u;
+    }wide;
+    wide.u = view_cell(view)->n;
+
+    return wide.d;
+}
+
+/* still escaped, as json_value keeps it, and NUL-terminated */
+const char *json_view_string(struct json_view view, size_t *len)
+{
+    const char *body = view_body(view);
+    if(len != NULL) {
+        *len = (size_t)*(const uint64_t *)body;
+    }
+
+    return body + sizeof(uint64_t);
+}
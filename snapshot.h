@@ -0,0 +1,64 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+#include "json.h"
+#include "path.h"
+
+#define JSON_SNAPSHOT_MAGIC "cjsnap01"
+#define JSON_SNAPSHOT_VERSION 1
+
+/*
+ * A json_root flattened into one position-independent image: every reference
+ * is an offset from the start, so the image can be mapped anywhere and shared
+ * read-only between processes. Scalars sit directly in their array or member
+ * table, strings inline and still escaped, and objects with
+ * JSON_INDEX_THRESHOLD members or more carry an open-addressed key table hashed
+ * with json_index_hash. Lookups read the image in place and never allocate.
+ * Beyond the header check the image is trusted, so only open files that
+ * json_snapshot_write produced.
+ */
+typedef struct json_snapshot {
+    const char *base;
+    size_t len;
+    void *map;
+    size_t map_len;
+}json_snapshot;
+
+/* a value inside a snapshot; offset 0 is the header, so it doubles as "not found" */
+typedef struct json_view {
+    const char *base;
+    uint64_t offset;
+}json_view;
+
+/* replaces str's contents with the image; malloc alignment is what the reader needs */
+int json_snapshot_write(struct json_root *root, struct varstr *str);
+int json_snapshot_save(struct json_root *root, const char *path);
+
+/* data must be 8-byte aligned and outlive the snapshot */
+struct json_snapshot *json_snapshot_from_memory(const char *data, size_t len);
+struct json_snapshot *json_snapshot_open(const char *path);
+int json_snapshot_close(struct json_snapshot *snap);
+
+struct json_view json_snapshot_root(struct json_snapshot *snap);
+/* the '>'-separated paths and flags of json_find_value_flags */
+struct json_view json_snapshot_find(struct json_snapshot *snap, const char *path, int flags);
+struct json_view json_snapshot_find_path(struct json_snapshot *snap, const struct json_path *path);
+
+int json_view_valid(struct json_view view);
+/* the type and the scalar accessors expect a valid view, of the matching type for the latter */
+JSON_TYPE json_view_type(struct json_view view);
+/* members of an object, elements of an array, 0 otherwise */
+size_t json_view_count(struct json_view view);
+struct json_view json_view_member(struct json_view object, const char *name, size_t name_len, int flags);
+/* the n-th element of an array, or the value of the n-th member of an object */
+struct json_view json_view_at(struct json_view container, size_t n);
+const char *json_view_name_at(struct json_view object, size_t n, size_t *name_len);
+
+long long json_view_number(struct json_view view);
+int json_view_boolean(struct json_view view);
+float json_view_float(struct json_view view);
+double json_view_double(struct json_view view);
+const char *json_view_string(struct json_view view, size_t *len);
+
+#endif
@@ -0,0 +1,45 @@
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+__thread struct json_stats json_thread_stats;
+
+struct json_stats *json_stats_get()
+{
+    return &json_thread_stats;
+}
+
+void json_stats_reset()
+{
+    memset(&json_thread_stats, 0, sizeof(json_thread_stats));
+}
+
+void json_stats_add(struct json_stats *dst, const struct json_stats *src)
+{
+    size_t k;
+
+    dst->bytes_parsed += src->bytes_parsed;
+    for(k = 0; k < JSON_STATS_TYPES; k++) {
+        dst->nodes[k] += src->nodes[k];
+    }
+    if(src->max_depth > dst->max_depth) {
+        dst->max_depth = src->max_depth;
+    }
+    dst->allocs += src->allocs;
+    dst->alloc_bytes += src->alloc_bytes;
+    dst->varstr_grows += src->varstr_grows;
+    dst->parses += src->parses;
+    dst->serializes += src->serializes;
+    dst->finds += src->finds;
+    dst->parse_ns += src->parse_ns;
+    dst->serialize_ns += src->serialize_ns;
+    dst->find_ns += src->find_ns;
+}
+
+uint64_t json_stats_clock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,63 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+#include "json.h"
+
+#define JSON_STATS_TYPES (OBJECT + 1)
+
+/*
+ * What the library did on one thread. Counters are only kept in builds with
+ * JSON_STATS defined (make STATS=1); otherwise the hooks below compile to
+ * nothing and the counters stay zero. Each thread counts into its own copy,
+ * so nothing is locked, and the workers of a parallel parse or serialize add
+ * theirs to the thread that ran it when they finish. Node counts and depth
+ * cover every parser that builds json_values, depth counting the outermost
+ * object as 1. bytes_parsed counts the text given to the text parsers, push
+ * feeds included; parses time each root parsed whole, so an NDJSON batch
+ * adds one per record. finds time json_find_value and json_path_find.
+ */
+typedef struct json_stats {
+    size_t bytes_parsed;
+    size_t nodes[JSON_STATS_TYPES];
+    size_t max_depth;
+    size_t allocs;
+    size_t alloc_bytes;
+    size_t varstr_grows;
+    size_t parses;
+    size_t serializes;
+    size_t finds;
+    uint64_t parse_ns;
+    uint64_t serialize_ns;
+    uint64_t find_ns;
+}json_stats;
+
+/* the calling thread's counters */
+struct json_stats *json_stats_get();
+void json_stats_reset();
+/* adds src's counters to dst's, keeping the larger max_depth */
+void json_stats_add(struct json_stats *dst, const struct json_stats *src);
+uint64_t json_stats_clock();
+
+#ifdef JSON_STATS
+extern __thread struct json_stats json_thread_stats;
+
+#define JSON_STAT_ADD(field, n) (json_thread_stats.field += (n))
+#define JSON_STAT_DEPTH(depth) do { \
+    if((size_t)(depth) > json_thread_stats.max_depth) { \
+        json_thread_stats.max_depth = (size_t)(depth); \
+    } \
+} while(0)
+#define JSON_STAT_START(start) uint64_t start = json_stats_clock()
+#define JSON_STAT_STOP(count, field, start) do { \
+    json_thread_stats.count++; \
+    json_thread_stats.field += json_stats_clock() - (start); \
+} while(0)
+#else
+#define JSON_STAT_ADD(field, n) ((void)0)
+#define JSON_STAT_DEPTH(depth) ((void)0)
+#define JSON_STAT_START(start) ((void)0)
+#define JSON_STAT_STOP(count, field, start) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,429 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "structural.h"
+#include "alloc.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_STRUCTURAL_SSE2 1
+#endif
+
+typedef struct block_masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;
+    uint64_t whitespace;
+}block_masks;
+
+typedef struct nesting_masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t open;
+    uint64_t close;
+    uint64_t comma;
+}nesting_masks;
+
+typedef struct stage1_state {
+    int prev_escaped;
+    uint64_t prev_in_string;
+    uint64_t prev_scalar;
+}stage1_state;
+
+struct json_structurals *create_json_structurals()
+{
+    return create_json_structurals_allocator(NULL);
+}
+
+struct json_structurals *create_json_structurals_allocator(const struct json_allocator *allocator)
+{
+    struct json_structurals *index = (struct json_structurals *)json_allocator_alloc(allocator, sizeof(*index));
+    if(index == NULL) {
+        return NULL;
+    }
+
+    index->positions = NULL;
+    index->count = 0;
+    index->cap = 0;
+    index->allocator = allocator;
+
+    return index;
+}
+
+int release_json_structurals(struct json_structurals *index)
+{
+    if(index == NULL) {
+        return 0;
+    }
+
+    json_allocator_free(index->allocator, index->positions);
+    json_allocator_free(index->allocator, index);
+
+    return 1;
+}
+
+#ifdef JSON_STRUCTURAL_SSE2
+static uint64_t sse2_mask(const __m128i lanes[4])
+{
+    uint64_t m0 = (uint16_t)_mm_movemask_epi8(lanes[0]);
+    uint64_t m1 = (uint16_t)_mm_movemask_epi8(lanes[1]);
+    uint64_t m2 = (uint16_t)_mm_movemask_epi8(lanes[2]);
+    uint64_t m3 = (uint16_t)_mm_movemask_epi8(lanes[3]);
+
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+
+static void classify_block(const char *block, block_masks *masks)
+{
+    __m128i quote[4], backslash[4], op[4], whitespace[4];
+    int k;
+
+    for(k = 0; k < 4; k++) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + 16 * k));
+        quote[k] = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\"'));
+        backslash[k] = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+        op[k] = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')),
+                                                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}'))),
+                                          _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')),
+                                                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')))),
+                             _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')),
+                                          _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))));
+        whitespace[k] = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                                     _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')),
+                                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+    }
+
+    masks->quote = sse2_mask(quote);
+    masks->backslash = sse2_mask(backslash);
+    masks->op = sse2_mask(op);
+    masks->whitespace = sse2_mask(whitespace);
+}
+
+/* '[' and ']' are '{' and '}' with bit 0x20 cleared */
+static void classify_nesting(const char *block, nesting_masks *masks)
+{
+    __m128i quote[4], backslash[4], open[4], close[4], comma[4];
+    int k;
+
+    for(k = 0; k < 4; k++) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(block + 16 * k));
+        __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        quote[k] = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\"'));
+        backslash[k] = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'));
+        open[k] = _mm_cmpeq_epi8(folded, _mm_set1_epi8('{'));
+        close[k] = _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'));
+        comma[k] = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','));
+    }
+
+    masks->quote = sse2_mask(quote);
+    masks->backslash = sse2_mask(backslash);
+    masks->open = sse2_mask(open);
+    masks->close = sse2_mask(close);
+    masks->comma = sse2_mask(comma);
+}
+#else
+static void classify_block(const char *block, block_masks *masks)
+{
+    int k;
+    memset(masks, 0, sizeof(*masks));
+    for(k = 0; k < 64; k++) {
+        uint64_t bit = 1ULL << k;
+        switch(block[k]) {
+        case '\"':
+            masks->quote |= bit;
+            break;
+        case '\\':
+            masks->backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            masks->op |= bit;
+            break;
+        case ' ':
+        case '\n':
+        case '\r':
+        case '\t':
+            masks->whitespace |= bit;
+            break;
+        }
+    }
+}
+
+static void classify_nesting(const char *block, nesting_masks *masks)
+{
+    int k;
+    memset(masks, 0, sizeof(*masks));
+    for(k = 0; k < 64; k++) {
+        uint64_t bit = 1ULL << k;
+        switch(block[k]) {
+        case '\"':
+            masks->quote |= bit;
+            break;
+        case '\\':
+            masks->backslash |= bit;
+            break;
+        case '{':
+        case '[':
+            masks->open |= bit;
+            break;
+        case '}':
+        case ']':
+            masks->close |= bit;
+            break;
+        case ',':
+            masks->comma |= bit;
+            break;
+        }
+    }
+}
+#endif
+
+static uint64_t prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+
+    return bits;
+}
+
+/* a backslash escapes the byte after it, whatever that byte is */
+static uint64_t escaped_bits(uint64_t backslash, stage1_state *state)
+{
+    uint64_t escaped = 0;
+
+    if(state->prev_escaped) {
+        escaped = 1;
+        backslash &= ~1ULL;
+    }
+    state->prev_escaped = 0;
+
+    while(backslash != 0) {
+        int bit = __builtin_ctzll(backslash);
+        if(bit == 63) {
+            state->prev_escaped = 1;
+            break;
+        }
+        escaped |= 1ULL << (bit + 1);
+        backslash &= ~(1ULL << (bit + 1));
+        backslash &= backslash - 1;
+    }
+
+    return escaped;
+}
+
+static int reserve_positions(struct json_structurals *index, size_t need)
+{
+    if(need <= index->cap) {
+        return 1;
+    }
+
+    size_t cap = index->cap == 0 ? 1024 : index->cap;
+    while(cap < need) {
+        cap *= 2;
+    }
+
+    size_t *positions = (size_t *)json_allocator_realloc(index->allocator, index->positions, cap * sizeof(size_t));
+    if(positions == NULL) {
+        return 0;
+    }
+    index->positions = positions;
+    index->cap = cap;
+
+    return 1;
+}
+
+/* ctz of zero is undefined; the high guard bit only shows up in the unused slots */
+#define LOWEST_BIT(bits) __builtin_ctzll((bits) | (1ULL << 63))
+
+static int push_positions(struct json_structurals *index, uint64_t bits, size_t base)
+{
+    if(!reserve_positions(index, index->count + 64)) {
+        return 0;
+    }
+
+    /* write eight slots per step whether or not they are all used; count only moves by the real ones */
+    size_t *out = index->positions + index->count;
+    size_t count = __builtin_popcountll(bits);
+    size_t k;
+    for(k = 0; k < count; k += 8) {
+        out[k] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 1] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 2] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 3] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 4] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 5] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 6] = base + LOWEST_BIT(bits); bits &= bits - 1;
+        out[k + 7] = base + LOWEST_BIT(bits); bits &= bits - 1;
+    }
+    index->count += count;
+
+    return 1;
+}
+
+static int stage1_block(struct json_structurals *index, const char *block, size_t base, stage1_state *state)
+{
+    block_masks masks;
+    classify_block(block, &masks);
+
+    uint64_t quote = masks.quote & ~escaped_bits(masks.backslash, state);
+    uint64_t in_string = prefix_xor(quote) ^ state->prev_in_string;
+    state->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    uint64_t scalar = ~(masks.op | masks.whitespace | quote | in_string);
+    uint64_t scalar_start = scalar & ~((scalar << 1) | state->prev_scalar);
+    state->prev_scalar = scalar >> 63;
+
+    return push_positions(index, (masks.op & ~in_string) | (quote & in_string) | scalar_start, base);
+}
+
+int json_structurals_build(struct json_structurals *index, const char *data, size_t len)
+{
+    if(index == NULL || data == NULL) {
+        return 0;
+    }
+
+    stage1_state state = { 0, 0, 0 };
+    size_t i = 0;
+
+    index->count = 0;
+    if(!reserve_positions(index, len / 8 + 64)) {
+        return 0;
+    }
+
+    for(; i + 64 <= len; i += 64) {
+        if(!stage1_block(index, data + i, i, &state)) {
+            return 0;
+        }
+    }
+
+    if(i < len) {
+        char tail[64];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, data + i, len - i);
+        if(!stage1_block(index, tail, i, &state)) {
+            return 0;
+        }
+    }
+
+    /* an unterminated string swallows the rest of the input */
+    return state.prev_in_string == 0;
+}
+
+size_t json_structurals_skip(const char *data, size_t len)
+{
+    if(data == NULL || len == 0 || (data[0] != '{' && data[0] != '[')) {
+        return 0;
+    }
+
+    stage1_state state = { 0, 0, 0 };
+    nesting_masks masks;
+    size_t depth = 0, i;
+    char tail[64];
+
+    for(i = 0; i < len; i += 64) {
+        const char *block = data + i;
+        if(i + 64 > len) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, data + i, len - i);
+            block = tail;
+        }
+        classify_nesting(block, &masks);
+
+        uint64_t quote = masks.quote & ~escaped_bits(masks.backslash, &state);
+        uint64_t in_string = prefix_xor(quote) ^ state.prev_in_string;
+        state.prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+        uint64_t open = masks.open & ~in_string;
+        uint64_t close = masks.close & ~in_string;
+        size_t closes = __builtin_popcountll(close);
+
+        /* the depth cannot reach zero inside this block; just carry the balance */
+        if(depth > closes) {
+            depth += __builtin_popcountll(open) - closes;
+            continue;
+        }
+
+        uint64_t bits = open | close;
+        while(bits != 0) {
+            int bit = __builtin_ctzll(bits);
+            if(open & (1ULL << bit)) {
+                depth++;
+            } else if(--depth == 0) {
+                return i + bit + 1;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t json_structurals_split(const char *data, size_t len, size_t step, struct json_structurals *cuts)
+{
+    if(data == NULL || len == 0 || data[0] != '[' || cuts == NULL) {
+        return 0;
+    }
+
+    stage1_state state = { 0, 0, 0 };
+    nesting_masks masks;
+    size_t depth = 0, target = step, i;
+    char tail[64];
+
+    cuts->count = 0;
+
+    for(i = 0; i < len; i += 64) {
+        const char *block = data + i;
+        if(i + 64 > len) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, data + i, len - i);
+            block = tail;
+        }
+        classify_nesting(block, &masks);
+
+        uint64_t quote = masks.quote & ~escaped_bits(masks.backslash, &state);
+        uint64_t in_string = prefix_xor(quote) ^ state.prev_in_string;
+        state.prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+        uint64_t open = masks.open & ~in_string;
+        uint64_t close = masks.close & ~in_string;
+        uint64_t comma = masks.comma & ~in_string;
+        size_t closes = __builtin_popcountll(close);
+
+        /* neither the end nor a wanted cut can be in this block */
+        if(depth > closes && (target >= i + 64 || comma == 0)) {
+            depth += __builtin_popcountll(open) - closes;
+            continue;
+        }
+
+        uint64_t bits = open | close | comma;
+        while(bits != 0) {
+            int bit = __builtin_ctzll(bits);
+            uint64_t mask = 1ULL << bit;
+            if(open & mask) {
+                depth++;
+            } else if(close & mask) {
+                if(--depth == 0) {
+                    return i + bit + 1;
+                }
+            } else if(depth == 1 && i + bit >= target) {
+                if(!reserve_positions(cuts, cuts->count + 1)) {
+                    return 0;
+                }
+                cuts->positions[cuts->count++] = i + bit;
+                target = i + bit + step;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    return 0;
+}
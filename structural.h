@@ -0,0 +1,33 @@
+#ifndef _STRUCTURAL_H_
+#define _STRUCTURAL_H_
+
+#include <stddef.h>
+#include "alloc.h"
+
+/*
+ * Offsets of every structural character ({ } [ ] : ,), every opening quote
+ * and the first byte of every number or literal, in input order.
+ */
+typedef struct json_structurals {
+    size_t *positions;
+    size_t count;
+    size_t cap;
+    /* where the index and its positions come from; NULL means the global allocator */
+    const struct json_allocator *allocator;
+}json_structurals;
+
+struct json_structurals *create_json_structurals();
+struct json_structurals *create_json_structurals_allocator(const struct json_allocator *allocator);
+int json_structurals_build(struct json_structurals *index, const char *data, size_t len);
+int release_json_structurals(struct json_structurals *index);
+
+/* data[0] is '{' or '['; index just past the bracket that balances it, or 0 */
+size_t json_structurals_skip(const char *data, size_t len);
+/*
+ * data[0] is '['; like json_structurals_skip, and also refills cuts with the
+ * offsets of element-separating commas, the first comma at least step bytes
+ * in and each next one at least step bytes after the last.
+ */
+size_t json_structurals_split(const char *data, size_t len, size_t step, struct json_structurals *cuts);
+
+#endif
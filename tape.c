@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "tape.h"
+#include "sax.h"
+#include "format.h"
+#include "path.h"
+#include "json_internal.h"
+
+/* a sax client that appends entries; stack holds the indices of the open containers */
+struct tape_builder {
+    struct json_tape *tape;
+    const char *data;
+    size_t *stack;
+    size_t depth;
+    size_t cap;
+};
+
+static struct json_tape_entry *tape_append(struct tape_builder *builder, uint32_t type, int child)
+{
+    struct json_tape *tape = builder->tape;
+    if(tape->count == tape->cap) {
+        size_t cap = tape->cap == 0 ? 256 : tape->cap * 2;
+        struct json_tape_entry *entries = (struct json_tape_entry *)json_allocator_realloc(tape->allocator, tape->entries, cap * sizeof(*entries));
+        if(entries == NULL) {
+            return NULL;
+        }
+        tape->entries = entries;
+        tape->cap = cap;
+    }
+
+    /* anything but a key is one more child of the innermost container */
+    if(child && builder->depth > 0) {
+        tape->entries[builder->stack[builder->depth - 1]].len++;
+    }
+
+    struct json_tape_entry *entry = &tape->entries[tape->count++];
+    entry->type = type;
+    entry->len = 0;
+    entry->value.skip = 0;
+
+    return entry;
+}
+
+static int tape_text(struct tape_builder *builder, uint32_t type, const char *text, size_t len)
+{
+    if(len > UINT32_MAX) {
+        return JSON_FAILURE;
+    }
+
+    struct json_tape_entry *entry = tape_append(builder, type, type != JSON_TAPE_KEY);
+    if(entry == NULL) {
+        return JSON_FAILURE;
+    }
+    entry->len = (uint32_t)len;
+
+    struct json_tape *tape = builder->tape;
+    if(tape->flags & JSON_PARSE_ZERO_COPY) {
+        entry->value.offset = (size_t)(text - builder->data);
+        return JSON_SUCCEED;
+    }
+
+    entry->value.offset = tape->strings->len;
+    if(append_varstr(tape->strings, text, len) == 0 || append_varstr_char(tape->strings, '\0') == 0) {
+        return JSON_FAILURE;
+    }
+
+    return JSON_SUCCEED;
+}
+
+static int tape_start(struct tape_builder *builder, JSON_TYPE type)
+{
+    if(builder->depth == builder->cap) {
+        size_t cap = builder->cap == 0 ? 16 : builder->cap * 2;
+        size_t *stack = (size_t *)json_allocator_realloc(builder->tape->allocator, builder->stack, cap * sizeof(*stack));
+        if(stack == NULL) {
+            return JSON_FAILURE;
+        }
+        builder->stack = stack;
+        builder->cap = cap;
+    }
+
+    if(tape_append(builder, type, 1) == NULL) {
+        return JSON_FAILURE;
+    }
+    builder->stack[builder->depth++] = builder->tape->count - 1;
+
+    return JSON_SUCCEED;
+}
+
+static int tape_start_object(void *ctx)
+{
+    return tape_start((struct tape_builder *)ctx, OBJECT);
+}
+
+static int tape_start_array(void *ctx)
+{
+    return tape_start((struct tape_builder *)ctx, ARRAY);
+}
+
+static int tape_end(void *ctx)
+{
+    struct tape_builder *builder = (struct tape_builder *)ctx;
+    struct json_tape *tape = builder->tape;
+
+    tape->entries[builder->stack[--builder->depth]].value.skip = tape->count;
+
+    return JSON_SUCCEED;
+}
+
+static int tape_key(void *ctx, const char *key, size_t len)
+{
+    return tape_text((struct tape_builder *)ctx, JSON_TAPE_KEY, key, len);
+}
+
+static int tape_string(void *ctx, const char *value, size_t len)
+{
+    return tape_text((struct tape_builder *)ctx, STRING, value, len);
+}
+
+static int tape_number(void *ctx, long long value)
+{
+    struct json_tape_entry *entry = tape_append((struct tape_builder *)ctx, NUMBER, 1);
+    if(entry == NULL) {
+        return JSON_FAILURE;
+    }
+    entry->value.number = value;
+
+    return JSON_SUCCEED;
+}
+
+static int tape_decimal(void *ctx, double value)
+{
+    struct json_tape_entry *entry = tape_append((struct tape_builder *)ctx, DOUBLE, 1);
+    if(entry == NULL) {
+        return JSON_FAILURE;
+    }
+    entry->value.double_decimal = value;
+
+    return JSON_SUCCEED;
+}
+
+static int tape_boolean(void *ctx, int value)
+{
+    struct json_tape_entry *entry = tape_append((struct tape_builder *)ctx, BOOLEAN, 1);
+    if(entry == NULL) {
+        return JSON_FAILURE;
+    }
+    entry->value.boolean = value;
+
+    return JSON_SUCCEED;
+}
+
+static const struct json_sax_handler json_tape_handler = {
+    tape_start_object,
+    tape_end,
+    tape_start_array,
+    tape_end,
+    tape_key,
+    tape_string,
+    tape_number,
+    tape_decimal,
+    tape_boolean
+};
+
+struct json_tape *create_json_tape()
+{
+    return create_json_tape_allocator(NULL);
+}
+
+struct json_tape *create_json_tape_allocator(const struct json_allocator *allocator)
+{
+    struct json_tape *tape = (struct json_tape *)json_allocator_alloc(allocator, sizeof(*tape));
+    if(tape == NULL) {
+        return NULL;
+    }
+
+    tape->strings = create_varstr_allocator(allocator);
+    if(tape->strings == NULL) {
+        json_allocator_free(allocator, tape);
+        return NULL;
+    }
+    tape->entries = NULL;
+    tape->count = 0;
+    tape->cap = 0;
+    tape->text = NULL;
+    tape->flags = 0;
+    tape->max_depth = 0;
+    tape->allocator = allocator;
+
+    return tape;
+}
+
+int json_tape_deserialize(struct json_tape *tape, struct varstr *str, int flags)
+{
+    if(tape == NULL || str == NULL || str->data == NULL) {
+        return JSON_FAILURE;
+    }
+
+    /* like json_deserialize, the text has to be one object */
+    if(str->len < 2 || str->data[0] != '{' || str->data[str->len - 1] != '}') {
+        return JSON_FAILURE;
+    }
+
+    tape->count = 0;
+    tape->strings->len = 0;
+    tape->flags = flags;
+
+    struct tape_builder builder = { tape, str->data, NULL, 0, 0 };
+    int res = json_sax_parse_allocator(str->data, str->len, &json_tape_handler, &builder, tape->max_depth, tape->allocator);
+    json_allocator_free(tape->allocator, builder.stack);
+
+    tape->text = (flags & JSON_PARSE_ZERO_COPY) ? str->data : tape->strings->data;
+    if(res != JSON_SUCCEED) {
+        tape->count = 0;
+    }
+
+    return res;
+}
+
+/* an open container being written: children still to come, and whether one came before */
+struct tape_frame {
+    size_t left;
+    uint32_t type;
+    int started;
+};
+
+/* a scalar, or the opening bracket of a container */
+static void serialize_head(const struct json_tape *tape, const struct json_tape_entry *e, struct varstr *str)
+{
+    char buffer[JSON_NUMBER_BUFFER_SIZE];
+
+    switch(e->type) {
+    case NUMBER:
+        append_varstr(str, buffer, json_format_integer(e->value.number, buffer));
+        break;
+    case DOUBLE:
+        append_varstr(str, buffer, json_format_double(e->value.double_decimal, buffer));
+        break;
+    case FLOAT:
+        append_varstr(str, buffer, json_format_float(e->value.float_decimal, buffer));
+        break;
+    case BOOLEAN:
+        if(e->value.boolean == 0) {
+            append_varstr_literal(str, "false");
+        } else {
+            append_varstr_literal(str, "true");
+        }
+        break;
+    case STRING:
+        append_varstr_char(str, '\"');
+        append_varstr(str, tape->text + e->value.offset, e->len);
+        append_varstr_char(str, '\"');
+        break;
+    case OBJECT:
+        append_varstr_char(str, '{');
+        break;
+    case ARRAY:
+        append_varstr_char(str, '[');
+        break;
+    }
+}
+
+/* one forward pass over the entries, with the open containers on an explicit stack */
+int json_tape_serialize(struct json_tape *tape, struct varstr *str)
+{
+    if(tape == NULL || str == NULL || tape->count == 0) {
+        return JSON_FAILURE;
+    }
+
+    struct tape_frame inline_frames[JSON_WALK_INLINE_DEPTH];
+    struct tape_frame *frames = inline_frames, *grown = NULL;
+    size_t depth = 0, cap = JSON_WALK_INLINE_DEPTH, next = 0;
+    int res = JSON_FAILURE;
+
+    for(;;) {
+        const struct json_tape_entry *e = &tape->entries[next++];
+        serialize_head(tape, e, str);
+        if(e->type == OBJECT || e->type == ARRAY) {
+            if(depth == cap) {
+                grown = (struct tape_frame *)json_stack_grow(frames, inline_frames, &cap, sizeof(*frames), tape->allocator);
+                if(grown == NULL) {
+                    goto done;
+                }
+                frames = grown;
+            }
+            frames[depth].left = e->len;
+            frames[depth].type = e->type;
+            frames[depth].started = 0;
+            depth++;
+        }
+
+        while(depth > 0 && frames[depth - 1].left == 0) {
+            append_varstr_char(str, frames[depth - 1].type == OBJECT ? '}' : ']');
+            depth--;
+        }
+        if(depth == 0) {
+            break;
+        }
+
+        struct tape_frame *frame = &frames[depth - 1];
+        if(frame->started) {
+            append_varstr_char(str, ',');
+        }
+        frame->started = 1;
+        frame->left--;
+        if(frame->type == OBJECT) {
+            const struct json_tape_entry *key = &tape->entries[next++];
+            append_varstr_char(str, '\"');
+            append_varstr(str, tape->text + key->value.offset, key->len);
+            append_varstr_literal(str, "\":");
+        }
+    }
+    res = JSON_SUCCEED;
+
+done:
+    if(frames != inline_frames) {
+        json_allocator_free(tape->allocator, frames);
+    }
+
+    return res;
+}
+
+int release_json_tape(struct json_tape *tape)
+{
+    if(tape == NULL) {
+        return JSON_FAILURE;
+    }
+
+    json_allocator_free(tape->allocator, tape->entries);
+    release_varstr(tape->strings);
+    json_allocator_free(tape->allocator, tape);
+
+    return JSON_SUCCEED;
+}
+
+JSON_TYPE json_tape_type(const struct json_tape *tape, size_t entry)
+{
+    return (JSON_TYPE)tape->entries[entry].type;
+}
+
+size_t json_tape_count(const struct json_tape *tape, size_t entry)
+{
+    if(entry >= tape->count || (tape->entries[entry].type != OBJECT && tape->entries[entry].type != ARRAY)) {
+        return 0;
+    }
+
+    return tape->entries[entry].len;
+}
+
+long long json_tape_number(const struct json_tape *tape, size_t entry)
+{
+    return tape->entries[entry].value.number;
+}
+
+int json_tape_boolean(const struct json_tape *tape, size_t entry)
+{
+    return tape->entries[entry].value.boolean;
+}
+
+double json_tape_double(const struct json_tape *tape, size_t entry)
+{
+    return tape->entries[entry].value.double_decimal;
+}
+
+const char *json_tape_string(const struct json_tape *tape, size_t entry, size_t *len)
+{
+    const struct json_tape_entry *e = &tape->entries[entry];
+    if(len != NULL) {
+        *len = e->len;
+    }
+
+    return tape->text + e->value.offset;
+}
+
+size_t json_tape_skip(const struct json_tape *tape, size_t entry)
+{
+    const struct json_tape_entry *e = &tape->entries[entry];
+    if(e->type == OBJECT || e->type == ARRAY) {
+        return e->value.skip;
+    }
+
+    return entry + 1;
+}
+
+struct json_tape_iter json_tape_iterate(const struct json_tape *tape, size_t container)
+{
+    struct json_tape_iter iter = { tape, container + 1, json_tape_count(tape, container), 0 };
+    if(iter.left != 0) {
+        iter.object = tape->entries[container].type == OBJECT;
+    }
+
+    return iter;
+}
+
+int json_tape_next(struct json_tape_iter *iter, size_t *entry, const char **name, size_t *name_len)
+{
+    if(iter->left == 0) {
+        return 0;
+    }
+
+    const struct json_tape *tape = iter->tape;
+    if(iter->object) {
+        const struct json_tape_entry *key = &tape->entries[iter->next++];
+        if(name != NULL) {
+            *name = tape->text + key->value.offset;
+        }
+        if(name_len != NULL) {
+            *name_len = key->len;
+        }
+    } else if(name != NULL) {
+        *name = NULL;
+    }
+
+    *entry = iter->next;
+    iter->next = json_tape_skip(tape, iter->next);
+    iter->left--;
+
+    return 1;
+}
+
+size_t json_tape_find_member(const struct json_tape *tape, size_t object, const char *name, size_t name_len, int flags)
+{
+    if(tape == NULL || name == NULL || object >= tape->count || tape->entries[object].type != OBJECT) {
+        return JSON_TAPE_NONE;
+    }
+
+    struct json_tape_iter iter = json_tape_iterate(tape, object);
+    const char *key = NULL;
+    size_t key_len = 0, entry = 0;
+    while(json_tape_next(&iter, &entry, &key, &key_len)) {
+        if(key_len != name_len) {
+            continue;
+        }
+        if((flags & JSON_FIND_CASE_SENSITIVE) ? !memcmp(key, name, name_len) : !strncasecmp(key, name, name_len)) {
+            return entry;
+        }
+    }
+
+    return JSON_TAPE_NONE;
+}
+
+size_t json_tape_child_at(const struct json_tape *tape, size_t container, size_t n)
+{
+    if(tape == NULL || container >= tape->count || n >= json_tape_count(tape, container)) {
+        return JSON_TAPE_NONE;
+    }
+
+    struct json_tape_iter iter = json_tape_iterate(tape, container);
+    size_t entry = 0;
+    do {
+        json_tape_next(&iter, &entry, NULL, NULL);
+    } while(n-- > 0);
+
+    return entry;
+}
+
+size_t json_tape_find_value(const struct json_tape *tape, const char *path, int flags)
+{
+    if(tape == NULL || path == NULL || tape->count == 0) {
+        return JSON_TAPE_NONE;
+    }
+
+    struct json_path_segment segment;
+    size_t len = strlen(path);
+    size_t i = 0, entry = 0;
+
+    if(len == 0) {
+        return JSON_TAPE_NONE;
+    }
+
+    while(i < len && entry != JSON_TAPE_NONE) {
+        i += json_path_lex_segment(path + i, len - i, &segment);
+        if(tape->entries[entry].type == ARRAY && segment.index >= 0) {
+            entry = json_tape_child_at(tape, entry, (size_t)segment.index);
+        } else {
+            entry = json_tape_find_member(tape, entry, segment.name, segment.name_len, flags);
+        }
+    }
+
+    return entry;
+}
@@ -0,0 +1,82 @@
+#ifndef _TAPE_H_
+#define _TAPE_H_
+
+#include <stdint.h>
+#include "json.h"
+
+/* a member name; it precedes the entry of the member's value */
+#define JSON_TAPE_KEY (OBJECT + 1)
+/* what lookups return when nothing matches */
+#define JSON_TAPE_NONE ((size_t)-1)
+
+typedef struct json_tape_entry {
+    uint32_t type;
+    /* strings and keys: byte length; containers: number of children */
+    uint32_t len;
+    union {
+        long long number;
+        int boolean;
+        float float_decimal;
+        double double_decimal;
+        /* strings and keys: where the bytes start in the tape's text */
+        size_t offset;
+        /* containers: index of the first entry past the subtree */
+        size_t skip;
+    }value;
+}json_tape_entry;
+
+/*
+ * A document as one array of 16-byte entries in text order, starting with the
+ * top-level object at index 0. A container is followed by its subtree and
+ * knows where that ends, so any subtree is stepped over in O(1) and a walk of
+ * the whole document is one forward scan. Entries are handed out by index.
+ * Strings and keys stay escaped; with JSON_PARSE_ZERO_COPY they are read out
+ * of the input, which must outlive the tape, otherwise out of a copy the tape
+ * keeps. Parsing again reuses the tape's buffers.
+ */
+typedef struct json_tape {
+    struct json_tape_entry *entries;
+    size_t count;
+    size_t cap;
+    const char *text;
+    struct varstr *strings;
+    int flags;
+    /* set before parsing to refuse deeper nesting; 0 means JSON_PARSE_DEPTH_MAX */
+    size_t max_depth;
+    /* where the tape and all its buffers come from; NULL means the global allocator */
+    const struct json_allocator *allocator;
+}json_tape;
+
+typedef struct json_tape_iter {
+    const struct json_tape *tape;
+    size_t next;
+    size_t left;
+    int object;
+}json_tape_iter;
+
+struct json_tape *create_json_tape();
+struct json_tape *create_json_tape_allocator(const struct json_allocator *allocator);
+int json_tape_deserialize(struct json_tape *tape, struct varstr *str, int flags);
+int json_tape_serialize(struct json_tape *tape, struct varstr *str);
+int release_json_tape(struct json_tape *tape);
+
+JSON_TYPE json_tape_type(const struct json_tape *tape, size_t entry);
+/* children of a container, 0 for anything else */
+size_t json_tape_count(const struct json_tape *tape, size_t entry);
+long long json_tape_number(const struct json_tape *tape, size_t entry);
+int json_tape_boolean(const struct json_tape *tape, size_t entry);
+double json_tape_double(const struct json_tape *tape, size_t entry);
+const char *json_tape_string(const struct json_tape *tape, size_t entry, size_t *len);
+
+/* the entry just past entry and its subtree */
+size_t json_tape_skip(const struct json_tape *tape, size_t entry);
+struct json_tape_iter json_tape_iterate(const struct json_tape *tape, size_t container);
+/* yields the next child's entry, and for objects its name; returns 0 when done */
+int json_tape_next(struct json_tape_iter *iter, size_t *entry, const char **name, size_t *name_len);
+
+size_t json_tape_find_member(const struct json_tape *tape, size_t object, const char *name, size_t name_len, int flags);
+size_t json_tape_child_at(const struct json_tape *tape, size_t container, size_t n);
+/* the '>'-separated paths and flags of json_find_value_flags */
+size_t json_tape_find_value(const struct json_tape *tape, const char *path, int flags);
+
+#endif
@@ -1,8 +1,26 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "varstr.h"
 #include "json.h"
+#include "scan.h"
+#include "structural.h"
+#include "push.h"
+#include "sax.h"
+#include "number.h"
+#include "format.h"
+#include "index.h"
+#include "path.h"
+#include "ndjson.h"
+#include "serialize.h"
+#include "binary.h"
+#include "snapshot.h"
+#include "tape.h"
+#include "keys.h"
+#include "alloc.h"
+#include "stats.h"
 
 void varstr_test()
 {
@@ -30,6 +48,27 @@ void varstr_test()
 
     release_varstr(str);
     release_varstr(dst);
+
+    str = create_varstr();
+    res = reserve_varstr(str, 1000);
+    assert(res == 1);
+    assert(str->cap > 1000 && str->len == 0);
+    char *reserved = str->data;
+    int i;
+    for(i = 0; i < 1000; i++) {
+        append_varstr_char(str, 'a' + i % 26);
+    }
+    assert(str->data == reserved);
+    assert(str->len == 1000 && str->data[1000] == '\0');
+    assert(str->data[27] == 'b');
+
+    for(i = 0; i < 100000; i++) {
+        append_varstr_literal(str, "xy");
+    }
+    assert(str->len == 201000);
+    assert(str->cap <= 2 * (str->len + 1));
+    assert(strncmp(str->data + 200998, "xy", 3) == 0);
+    release_varstr(str);
 }
 
 void json_test()
@@ -69,8 +108,8 @@ void json_test()
     json_value_insert_child(object, string);
     json_value_insert_child(array, object);
 
-    struct json_value *root = create_json_object("node");
-    json_value_insert_child(root, array);
+    struct json_root *root = create_json_root();
+    json_root_insert_value(root, array);
 
     struct varstr *str = create_varstr();
     json_serialize(root, str);
@@ -80,12 +119,12 @@ void json_test()
     assert(strcmp(target->name, array->name) == 0);
     assert(target->value.children == array->value.children);
 
-    target = json_find_value(array, "number");
+    target = json_find_value(root, "array>number");
     assert(target != NULL);
     assert(strcmp(target->name, number->name) == 0);
     assert(target->value.number == number->value.number);
 
-    release_json_value(root);
+    release_json_root(root);
     release_varstr(str);
     str = NULL;
     root = NULL;
@@ -93,22 +132,1793 @@ void json_test()
     char *json_data = "{\"object\":\r\n{\"\\\"\\\\\\\t\\\rstring\\\"\\\\\\\r\\\t\":\"\\\\\\\r\\\tstring\\\\\\\r\\\t\\\b\\\\\",\r\n\"number\":100},\r\n\"array\":[2,1]\r\n}";
     struct varstr *src = create_varstr();
     append_varstr(src, json_data, strlen(json_data));
-    root = create_json_object("node");
-    json_deserialize(root, src);
+    root = create_json_root();
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
 
     struct varstr *dst = create_varstr();
     json_serialize(root, dst);
     assert(dst->len + 8 == strlen(json_data));
 
-    release_json_value(root);
+    release_json_root(root);
+    release_varstr(src);
+    release_varstr(dst);
+}
+
+void document_test()
+{
+    char *json_data = "{\"object\":{\"name\":\"value\",\"flag\":true,\"off\":false},\"array\":[3,2,1],\"number\":100}";
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, strlen(json_data));
+
+    struct json_root *root = create_json_root();
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
+    struct varstr *expected = create_varstr();
+    json_serialize(root, expected);
+
+    struct json_document *doc = create_json_document(0);
+    assert(doc != NULL);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    assert(doc->root.arena != NULL);
+    assert(release_json_root(&doc->root) == JSON_FAILURE);
+
+    struct varstr *dst = create_varstr();
+    json_serialize(&doc->root, dst);
+    assert(dst->len == expected->len);
+    assert(memcmp(dst->data, expected->data, dst->len) == 0);
+
+    struct json_value *target = json_find_value(&doc->root, "object>name");
+    assert(target != NULL && target->type == STRING);
+    assert(strcmp(target->value.string, "value") == 0);
+    target = json_find_value(&doc->root, "object>off");
+    assert(target != NULL && target->type == BOOLEAN && target->value.boolean == 0);
+
+    release_json_document(doc);
+    release_json_root(root);
+    release_varstr(src);
+    release_varstr(expected);
+    release_varstr(dst);
+}
+
+void zero_copy_test()
+{
+    char *json_data = "{\"long\":\"\\u00e9t\\u00e9 \\\"quoted\\\" \\ud83d\\ude00\",\"key\":\"value\",\"pad\":\"%s\"}";
+    char padding[2048];
+    memset(padding, 'x', sizeof(padding) - 1);
+    padding[sizeof(padding) - 1] = '\0';
+
+    struct varstr *src = create_varstr();
+    char *buffer = malloc(strlen(json_data) + sizeof(padding));
+    sprintf(buffer, json_data, padding);
+    append_varstr(src, buffer, strlen(buffer));
+    free(buffer);
+
+    struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+
+    struct json_value *target = json_find_value(&doc->root, "key");
+    assert(target != NULL);
+    assert(target->name >= src->data && target->name < src->data + src->len);
+    assert(target->value.string >= src->data && target->value.string < src->data + src->len);
+    assert(target->string_len == 5 && strncmp(target->value.string, "value", 5) == 0);
+
+    target = json_find_value(&doc->root, "pad");
+    assert(target != NULL && target->string_len == sizeof(padding) - 1);
+
+    target = json_find_value(&doc->root, "long");
+    assert(target != NULL);
+    char *text = json_value_unescape_string(target);
+    assert(strcmp(text, "\xc3\xa9t\xc3\xa9 \"quoted\" \xf0\x9f\x98\x80") == 0);
+    free(text);
+    text = json_value_unescape_name(target);
+    assert(strcmp(text, "long") == 0);
+    free(text);
+
+    struct varstr *dst = create_varstr();
+    json_serialize(&doc->root, dst);
+    assert(dst->len == src->len);
+
+    release_json_document(doc);
     release_varstr(src);
     release_varstr(dst);
 }
 
+void scan_test()
+{
+    const char alphabet[] = " \n\r\tab\"\\\x01\x1f\x80\xff{}:,";
+    char buffer[256];
+    int round, offset;
+
+    srand(1);
+    for(round = 0; round < 2000; round++) {
+        int len = rand() % sizeof(buffer);
+        int k;
+        for(k = 0; k < len; k++) {
+            /* long runs of one class so the vector loops get exercised */
+            int pick = round % 3 == 0 ? rand() % 4 : (round % 3 == 1 ? 4 + rand() % 2 : rand() % (sizeof(alphabet) - 1));
+            buffer[k] = (k * 7 + round) % 61 == 0 ? alphabet[rand() % (sizeof(alphabet) - 1)] : alphabet[pick];
+        }
+
+        for(offset = 0; offset < len; offset += 1 + offset / 4) {
+            assert(json_skip_whitespace(buffer + offset, len - offset) == json_skip_whitespace_scalar(buffer + offset, len - offset));
+            assert(json_scan_string(buffer + offset, len - offset) == json_scan_string_scalar(buffer + offset, len - offset));
+        }
+    }
+}
+
+static void assert_engines_agree(char *json_data)
+{
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, strlen(json_data));
+
+    struct json_root *recursive = create_json_root();
+    struct json_root *structural = create_json_root();
+    assert(json_deserialize(recursive, src) == JSON_SUCCEED);
+    assert(json_deserialize_flags(structural, src, JSON_PARSE_STRUCTURAL) == JSON_SUCCEED);
+
+    struct varstr *expected = create_varstr();
+    struct varstr *actual = create_varstr();
+    json_serialize(recursive, expected);
+    json_serialize(structural, actual);
+    assert(expected->len == actual->len);
+    assert(memcmp(expected->data, actual->data, actual->len) == 0);
+
+    release_json_root(recursive);
+    release_json_root(structural);
+    release_varstr(src);
+    release_varstr(expected);
+    release_varstr(actual);
+}
+
+void structural_test()
+{
+    assert_engines_agree("{}");
+    assert_engines_agree("{\"object\":\r\n{\"\\\"\\\\\\\t\\\rstring\\\"\\\\\\\r\\\t\":\"\\\\\\\r\\\tstring\\\\\\\r\\\t\\\b\\\\\",\r\n\"number\":100},\r\n\"array\":[2,1]\r\n}");
+    assert_engines_agree("{\n  \"a\": {\n    \"b\": [\n      1,\n      {\"c\": true},\n      [],\n      {}\n    ],\n    \"d\": false\n  },\n  \"e\": \"{[:,]}\"\n}");
+
+    /* escapes and quotes straddling the 64-byte blocks of stage 1 */
+    char buffer[1024];
+    int shift;
+    for(shift = 0; shift < 70; shift++) {
+        int k = 0, n;
+        k += sprintf(buffer + k, "{\"pad\":\"");
+        for(n = 0; n < shift; n++) {
+            buffer[k++] = 'x';
+        }
+        k += sprintf(buffer + k, "\\\\\\\"\\\\\",\"list\":[\"\\\"\",true,\"\\\\\"],\"n\":%d}", shift);
+        buffer[k] = '\0';
+        assert_engines_agree(buffer);
+        assert(json_structurals_skip(buffer, k + 5) == (size_t)k);
+        assert(json_structurals_skip(buffer + 1, k - 1) == 0);
+    }
+
+    struct varstr *src = create_varstr();
+    struct json_root *root = create_json_root();
+    char *broken[] = { "{\"a\":\"unterminated}", "{\"a\":1,}", "{\"a\" 1}", "{\"a\":truex}", "{\"a\":[1}" };
+    for(shift = 0; shift < (int)(sizeof(broken) / sizeof(broken[0])); shift++) {
+        src->len = 0;
+        append_varstr(src, broken[shift], strlen(broken[shift]));
+        assert(json_deserialize_flags(root, src, JSON_PARSE_STRUCTURAL) == JSON_FAILURE);
+    }
+    release_json_root(root);
+    release_varstr(src);
+}
+
+void push_test()
+{
+    char *json_data = "{\n  \"a\": {\n    \"b\": [\n      12345,\n      {\"c\": true},\n      [],\n      {}\n    ],\n    \"d\": false\n  },\n  \"e\": \"{[:,]} \\\" \\\\\",\n  \"f\": [\"x\", 7, \"\"]\n}";
+    size_t len = strlen(json_data);
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, len);
+
+    struct json_root *root = create_json_root();
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
+    struct varstr *expected = create_varstr();
+    json_serialize(root, expected);
+    release_json_root(root);
+
+    size_t chunk, i;
+    for(chunk = 1; chunk <= len; chunk++) {
+        struct json_document *doc = create_json_document(0);
+        struct json_push_parser *parser = create_json_push_parser(&doc->root);
+        JSON_PUSH_STATUS status = JSON_PUSH_NEED_MORE;
+        for(i = 0; i < len; i += chunk) {
+            assert(status == JSON_PUSH_NEED_MORE);
+            status = json_push_parser_feed(parser, json_data + i, i + chunk > len ? len - i : chunk);
+        }
+        assert(status == JSON_PUSH_DONE);
+        assert(json_push_parser_feed(parser, " \n", 2) == JSON_PUSH_DONE);
+
+        struct varstr *dst = create_varstr();
+        json_serialize(&doc->root, dst);
+        assert(dst->len == expected->len);
+        assert(memcmp(dst->data, expected->data, dst->len) == 0);
+
+        release_varstr(dst);
+        release_json_push_parser(parser);
+        release_json_document(doc);
+    }
+
+    char *broken[] = { "{\"a\":1]", "{\"a\" 1}", "{\"a\":tru }", "{\"a\":\"x\ty\"}", "{} x", "[]" };
+    for(i = 0; i < sizeof(broken) / sizeof(broken[0]); i++) {
+        root = create_json_root();
+        struct json_push_parser *parser = create_json_push_parser(root);
+        assert(json_push_parser_feed(parser, broken[i], strlen(broken[i])) == JSON_PUSH_ERROR);
+        release_json_push_parser(parser);
+        release_json_root(root);
+    }
+
+    release_varstr(src);
+    release_varstr(expected);
+}
+
+typedef struct sax_counter {
+    int objects;
+    int arrays;
+    int depth;
+    int keys;
+    int strings;
+    long long sum;
+    int booleans;
+}sax_counter;
+
+static int count_object(void *ctx)
+{
+    ((sax_counter *)ctx)->objects++;
+    ((sax_counter *)ctx)->depth++;
+    return 1;
+}
+
+static int count_array(void *ctx)
+{
+    ((sax_counter *)ctx)->arrays++;
+    ((sax_counter *)ctx)->depth++;
+    return 1;
+}
+
+static int count_end(void *ctx)
+{
+    ((sax_counter *)ctx)->depth--;
+    return 1;
+}
+
+static int count_key(void *ctx, const char *key, size_t len)
+{
+    ((sax_counter *)ctx)->keys++;
+    return strncmp(key, "stop", len) != 0;
+}
+
+static int count_string(void *ctx, const char *value, size_t len)
+{
+    ((sax_counter *)ctx)->strings++;
+    return 1;
+}
+
+static int count_number(void *ctx, long long value)
+{
+    ((sax_counter *)ctx)->sum += value;
+    return 1;
+}
+
+static int count_boolean(void *ctx, int value)
+{
+    ((sax_counter *)ctx)->booleans++;
+    return 1;
+}
+
+void sax_test()
+{
+    struct json_sax_handler handler = { count_object, count_end, count_array, count_end, count_key, count_string, count_number, NULL, count_boolean };
+    sax_counter counter;
+    char *json_data = "{\"a\": {\"b\": [1, {\"c\": true}, [], {}], \"d\": false}, \"e\": \"x\\\"y\", \"f\": [20, \"z\", 300]}";
+
+    memset(&counter, 0, sizeof(counter));
+    assert(json_sax_parse(json_data, strlen(json_data), &handler, &counter) == JSON_SUCCEED);
+    assert(counter.objects == 4);
+    assert(counter.arrays == 3);
+    assert(counter.depth == 0);
+    assert(counter.keys == 6);
+    assert(counter.strings == 2);
+    assert(counter.sum == 321);
+    assert(counter.booleans == 2);
+
+    char *stopped = "{\"a\": 1, \"stop\": 2, \"b\": 3}";
+    memset(&counter, 0, sizeof(counter));
+    assert(json_sax_parse(stopped, strlen(stopped), &handler, &counter) == JSON_FAILURE);
+    assert(counter.keys == 2 && counter.sum == 1);
+
+    char *broken = "{\"a\": [1 2]}";
+    memset(&counter, 0, sizeof(counter));
+    assert(json_sax_parse(broken, strlen(broken), &handler, &counter) == JSON_FAILURE);
+}
+
+void number_test()
+{
+    char *texts[] = { "0", "-12", "9223372036854775807", "-9223372036854775808", "9223372036854775808",
+                      "0.1", "-2.5e-3", "1E+2", "2.2250738585072011e-308", "4.9406564584124654e-324",
+                      "1.7976931348623157e308", "9007199254740993.0", "123456789012345678901234567890",
+                      "0.000000000000000000000000000000000123456789012345678901234567890e-300" };
+    int k;
+    for(k = 0; k < (int)(sizeof(texts) / sizeof(texts[0])); k++) {
+        struct json_number number;
+        size_t len = strlen(texts[k]);
+        assert(json_parse_number(texts[k], len, &number) == len);
+        if(number.integer) {
+            assert(number.number == strtoll(texts[k], NULL, 10));
+        } else {
+            double expected = strtod(texts[k], NULL);
+            assert(memcmp(&number.decimal, &expected, sizeof(double)) == 0);
+        }
+    }
+
+    struct json_number number;
+    assert(json_parse_number("-", 1, &number) == 0);
+    assert(json_parse_number("1.", 2, &number) == 0);
+    assert(json_parse_number("1e", 2, &number) == 0);
+    assert(json_parse_number("01", 2, &number) == 1);
+    assert(json_parse_number("12,", 3, &number) == 2 && number.integer && number.number == 12);
+
+    char *json_data = "{\"i\":-7,\"d\":-1.5e3,\"e\":1e2,\"a\":[0.5,-0]}";
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, strlen(json_data));
+    struct json_root *root = create_json_root();
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
+
+    struct json_value *target = json_find_value(root, "i");
+    assert(target->type == NUMBER && target->value.number == -7);
+    target = json_find_value(root, "d");
+    assert(target->type == DOUBLE && target->value.double_decimal == -1500.0);
+    target = json_find_value(root, "e");
+    assert(target->type == DOUBLE && target->value.double_decimal == 100.0);
+    target = json_find_value(root, "a");
+    assert(target->value.children->type == DOUBLE);
+    assert(target->value.children->next->type == NUMBER);
+
+    release_json_root(root);
+    release_varstr(src);
+}
+
+void format_test()
+{
+    char buffer[JSON_NUMBER_BUFFER_SIZE + 1];
+    size_t len;
+
+    double doubles[] = { 0.0, -0.0, 1.0, 0.1, -2.5, 1e21, 1e22, 123456789.0, 1e-7, 0.000001,
+                         5e-324, 1.7976931348623157e308, 1e23, 4.67923, 0.000649 };
+    char *double_texts[] = { "0.0", "-0.0", "1.0", "0.1", "-2.5", "1e21", "1e22", "123456789.0", "1e-7",
+                             "0.000001", "5e-324", "1.7976931348623157e308", "1e23", "4.67923", "0.000649" };
+    int k;
+    for(k = 0; k < (int)(sizeof(doubles) / sizeof(doubles[0])); k++) {
+        len = json_format_double(doubles[k], buffer);
+        buffer[len] = '\0';
+        assert(strcmp(buffer, double_texts[k]) == 0);
+    }
+
+    len = json_format_float(0.1f, buffer);
+    buffer[len] = '\0';
+    assert(strcmp(buffer, "0.1") == 0);
+    len = json_format_float(3.4028235e38f, buffer);
+    buffer[len] = '\0';
+    assert(strcmp(buffer, "3.4028235e38") == 0);
+
+    unsigned long long seed = 88172645463325252ULL;
+    for(k = 0; k < 100000; k++) {
+        double value;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        memcpy(&value, &seed, sizeof(value));
+        if(value != value || value - value != 0) {
+            continue;
+        }
+        len = json_format_double(value, buffer);
+        buffer[len] = '\0';
+        assert(strtod(buffer, NULL) == value);
+
+        /* and no shorter text would do */
+        char shorter[40];
+        int digits = 0, zeros = 0;
+        char *c;
+        for(c = buffer; *c != '\0' && *c != 'e'; c++) {
+            if(*c == '0' && digits == 0) {
+                continue;
+            }
+            if(*c >= '0' && *c <= '9') {
+                zeros = *c == '0' ? zeros + 1 : 0;
+                digits++;
+            }
+        }
+        digits -= zeros;
+        if(digits > 1) {
+            snprintf(shorter, sizeof(shorter), "%.*e", digits - 2, value);
+            assert(strtod(shorter, NULL) != value);
+        }
+
+        float single = (float)value;
+        if(single - single == 0) {
+            len = json_format_float(single, buffer);
+            buffer[len] = '\0';
+            assert(strtof(buffer, NULL) == single);
+        }
+    }
+
+    long long integers[] = { 0, -1, 99, 100, 1234567, 9223372036854775807LL, -9223372036854775807LL - 1 };
+    char *integer_texts[] = { "0", "-1", "99", "100", "1234567", "9223372036854775807", "-9223372036854775808" };
+    for(k = 0; k < (int)(sizeof(integers) / sizeof(integers[0])); k++) {
+        len = json_format_integer(integers[k], buffer);
+        buffer[len] = '\0';
+        assert(strcmp(buffer, integer_texts[k]) == 0);
+    }
+
+    char *json_data = "{\"d\":0.1,\"e\":1e300,\"i\":-42}";
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, strlen(json_data));
+    struct json_root *root = create_json_root();
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
+    struct varstr *dst = create_varstr();
+    json_serialize(root, dst);
+    assert(strstr(dst->data, "\"d\":0.1") != NULL);
+    assert(strstr(dst->data, "\"e\":1e300") != NULL);
+    assert(strstr(dst->data, "\"i\":-42") != NULL);
+
+    release_json_root(root);
+    release_varstr(src);
+    release_varstr(dst);
+}
+
+void index_test()
+{
+    struct varstr *src = create_varstr();
+    char key[32];
+    int k;
+
+    append_varstr_literal(src, "{\"Map\":{");
+    for(k = 0; k < 1000; k++) {
+        int len = snprintf(key, sizeof(key), "%s\"Key%d\":%d", k ? "," : "", k, k);
+        append_varstr(src, key, len);
+    }
+    append_varstr_literal(src, "}}");
+
+    struct json_document *doc = create_json_document(0);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    for(k = 0; k < 1000; k += 7) {
+        snprintf(key, sizeof(key), "map>KEY%d", k);
+        struct json_value *target = json_find_value(&doc->root, key);
+        assert(target != NULL && target->value.number == k);
+        assert(json_find_value_flags(&doc->root, key, JSON_FIND_CASE_SENSITIVE) == NULL);
+        snprintf(key, sizeof(key), "Map>Key%d", k);
+        assert(json_find_value_flags(&doc->root, key, JSON_FIND_CASE_SENSITIVE) == target);
+    }
+    assert(json_find_value(&doc->root, "Map>Key1000") == NULL);
+    assert(json_find_value(&doc->root, "Map>Key1>deeper") == NULL);
+
+    struct json_value *map = json_find_value(&doc->root, "Map");
+    assert(map->index != NULL && map->index->count == 1000);
+    assert(json_value_find_member(map, "key5", 4, 0)->value.number == 5);
+    release_json_document(doc);
+
+    struct json_root *root = create_json_root();
+    struct json_value *object = create_json_object("obj");
+    json_root_insert_value(root, object);
+    for(k = 0; k < 40; k++) {
+        snprintf(key, sizeof(key), "k%d", k);
+        json_value_insert_child(object, create_json_number(key, k));
+    }
+    assert(json_find_value(root, "obj>k3")->value.number == 3);
+    assert(object->index == NULL);
+    assert(json_find_value(root, "obj>k30")->value.number == 30);
+    assert(object->index != NULL);
+
+    json_value_insert_child(object, create_json_number("k40", 40));
+    assert(object->index != NULL && json_find_value(root, "obj>k40")->value.number == 40);
+
+    json_value_insert_child(object, create_json_number("K3", 300));
+    assert(object->index != NULL && json_find_value(root, "obj>k3")->value.number == 3);
+    assert(json_find_value_flags(root, "obj>K3", JSON_FIND_CASE_SENSITIVE)->value.number == 300);
+
+    release_json_root(root);
+    release_varstr(src);
+}
+
+void path_test()
+{
+    char *documents[] = { "{\"a\":{\"b\":[{\"c\":1},{\"c\":2},{\"c\":3}]}}",
+                          "{\"a\":{\"b\":[{\"c\":4},{\"c\":5}],\"[1]\":6}}",
+                          "{\"a\":{\"b\":[{\"c\":7}]}}" };
+    struct json_path *path = create_json_path("a>b>[1]>c", 0);
+    struct json_path *literal = create_json_path("a>[1]", 0);
+    assert(path != NULL && path->count == 4);
+    assert(path->segments[2].index == 1 && path->segments[0].index == -1);
+
+    int k;
+    for(k = 0; k < 3; k++) {
+        struct varstr *src = create_varstr();
+        append_varstr(src, documents[k], strlen(documents[k]));
+        struct json_document *doc = create_json_document(0);
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+
+        struct json_value *array = json_find_value(&doc->root, "a>b");
+        struct json_value *second = json_value_child_at(array, 1);
+        if(second == NULL) {
+            assert(json_path_find(&doc->root, path) == NULL);
+        } else {
+            assert(json_path_find(&doc->root, path) == second->value.children);
+            assert(json_find_value(&doc->root, "a>b>[1]>c") == second->value.children);
+        }
+        struct json_value *member = json_path_find(&doc->root, literal);
+        assert(k == 1 ? member != NULL && member->value.number == 6 : member == NULL);
+
+        release_json_document(doc);
+        release_varstr(src);
+    }
+
+    release_json_path(path);
+    release_json_path(literal);
+
+    char long_key[200];
+    memset(long_key, 'k', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = '\0';
+    struct json_root *root = create_json_root();
+    struct json_value *object = create_json_object("outer");
+    json_value_insert_child(object, create_json_number(long_key, 9));
+    json_root_insert_value(root, object);
+
+    struct varstr *query = create_varstr();
+    append_varstr_literal(query, "outer>");
+    append_varstr(query, long_key, strlen(long_key));
+    assert(json_find_value(root, query->data)->value.number == 9);
+
+    release_varstr(query);
+    release_json_root(root);
+}
+
+void array_test()
+{
+    char *json_data = "{\"a\":[1,[],{\"x\":true,\"x\":false},\"s\"],\"b\":{}}";
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, strlen(json_data));
+
+    int flags[] = { 0, JSON_PARSE_ZERO_COPY };
+    int k;
+    for(k = 0; k < 2; k++) {
+        struct json_document *doc = create_json_document(flags[k]);
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+
+        struct varstr *dst = create_varstr();
+        json_serialize(&doc->root, dst);
+        assert(dst->len == src->len && !memcmp(dst->data, src->data, src->len));
+
+        struct json_value *array = json_find_value(&doc->root, "a");
+        assert(json_value_count(array) == 4 && json_value_child_at(array, 4) == NULL);
+        assert(json_value_child_at(array, 0)->value.number == 1);
+        assert(json_value_count(json_value_child_at(array, 1)) == 0);
+        assert(json_value_child_at(array, 3)->type == STRING);
+        assert(json_find_value(&doc->root, "a>[2]>x")->value.boolean == 1);
+        assert(json_value_count(json_find_value(&doc->root, "b")) == 0 && json_value_count(json_value_child_at(array, 2)) == 0);
+
+        /* appended vectors come from the document's arena, so only the appended values outlive it */
+        struct json_value *added[43];
+        int n;
+        for(n = 0; n < 20; n++) {
+            added[n] = create_json_number("n", n);
+            added[20 + n] = create_json_number("n", n);
+            assert(json_value_insert_child(array, added[n]) == JSON_SUCCEED);
+            assert(json_value_insert_child(json_value_child_at(array, 1), added[20 + n]) == JSON_SUCCEED);
+        }
+        assert(json_value_count(array) == 24 && json_value_child_at(array, 23)->value.number == 19);
+        assert(json_value_count(json_value_child_at(array, 1)) == 20);
+        assert(json_value_child_at(array, 3)->next == json_value_child_at(array, 4));
+
+        added[40] = create_json_number("y", 1);
+        added[41] = create_json_number("z", 2);
+        added[42] = create_json_number("c", 3);
+        assert(json_value_insert_child(json_value_child_at(array, 2), added[40]) == JSON_SUCCEED);
+        assert(json_value_insert_child(json_value_child_at(array, 2), added[41]) == JSON_SUCCEED);
+        assert(json_value_insert_child(json_find_value(&doc->root, "b"), added[42]) == JSON_SUCCEED);
+        release_varstr(dst);
+        dst = create_varstr();
+        json_serialize(&doc->root, dst);
+        assert(!strncmp(dst->data, "{\"a\":[1,[0,1,", 13));
+        assert(json_value_child_at(array, 2)->value.children->next->next->next == added[41]);
+        assert(dst->len > 12 && !memcmp(dst->data + dst->len - 12, "\"b\":{\"c\":3}}", 12));
+
+        release_varstr(dst);
+        release_json_document(doc);
+        for(n = 0; n < 43; n++) {
+            release_json_value(added[n]);
+        }
+    }
+
+    struct json_root *root = create_json_root();
+    struct json_value *array = create_json_array("list");
+    json_root_insert_value(root, array);
+    json_root_insert_value(root, create_json_number("after", 1));
+    for(k = 0; k < 1000; k++) {
+        json_value_insert_child(array, create_json_number("n", k));
+    }
+    assert(json_value_count(array) == 1000);
+    for(k = 0; k < 1000; k += 37) {
+        assert(json_value_child_at(array, k)->value.number == k);
+    }
+    assert(json_value_count(json_find_value(root, "after")) == 0);
+
+    struct varstr *dst = create_varstr();
+    json_serialize(root, dst);
+    assert(!strncmp(dst->data, "{\"list\":[0,1,2,", 15));
+    assert(dst->len > 12 && !memcmp(dst->data + dst->len - 12, "],\"after\":1}", 12));
+
+    release_varstr(dst);
+    release_json_root(root);
+    release_varstr(src);
+}
+
+void lazy_test()
+{
+    char *json_data = "{\"skip\": {\"x\": [1, {\"y\": \"}]\\\"[{\"}], \"z\": \"{\"}, "
+                      "\"Name\" : \"router\", \"list\": [10, [20, 21], {\"deep\": true}, -4.5], "
+                      "\"obj\": {\"a\": 1, \"b\": {\"c\": \"d\"}}, \"name\": \"second\"}";
+    struct varstr *src = create_varstr();
+    append_varstr(src, json_data, strlen(json_data));
+
+    struct json_document *doc = create_json_document(JSON_PARSE_LAZY | JSON_PARSE_ZERO_COPY);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    assert(doc->root.elems == NULL);
+
+    struct json_value *value = json_document_find(doc, "name");
+    assert(value->type == STRING && value->string_len == 6 && !strncmp(value->value.string, "router", 6));
+    assert(value->name_len == 4 && !strncmp(value->name, "Name", 4));
+    assert(json_document_find(doc, "skip>z")->type == STRING);
+    assert(json_document_find(doc, "list>[1]>[1]")->value.number == 21);
+    assert(json_document_find(doc, "list>[2]>deep")->value.boolean == 1);
+    assert(json_document_find(doc, "list>[3]")->value.double_decimal == -4.5);
+    assert(json_document_find(doc, "list>[3]")->anonymous == 1);
+    assert(json_document_find(doc, "list>[4]") == NULL);
+    assert(json_document_find(doc, "obj>missing") == NULL);
+    assert(json_document_find(doc, "name>deeper") == NULL);
+
+    value = json_document_find(doc, "obj");
+    assert(value->type == OBJECT && value->value.children != NULL);
+    assert(json_value_find_member(value, "b", 1, 0)->type == OBJECT);
+
+    struct json_path *path = create_json_path("name", JSON_FIND_CASE_SENSITIVE);
+    value = json_document_find_path(doc, path);
+    assert(value->type == STRING && !strncmp(value->value.string, "second", 6));
+    release_json_path(path);
+    release_json_document(doc);
+
+    char *broken = "[1, 2]";
+    struct varstr *array = create_varstr();
+    append_varstr(array, broken, strlen(broken));
+    doc = create_json_document(JSON_PARSE_LAZY);
+    assert(json_document_deserialize(doc, array) == JSON_FAILURE);
+    release_json_document(doc);
+
+    doc = create_json_document(0);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    assert(json_document_find(doc, "obj>b>c")->type == STRING);
+    release_json_document(doc);
+
+    /* a lookup that ends where an earlier one did gets the same node, built once */
+    doc = create_json_document(JSON_PARSE_LAZY);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    value = json_document_find(doc, "obj");
+    assert(json_document_find(doc, "list>[1]") != NULL && json_document_find(doc, "skip>x>[1]>y") != NULL);
+    size_t used = doc->root.arena->blocks->used;
+    int k;
+    for(k = 0; k < 1000; k++) {
+        assert(json_document_find(doc, "obj") == value);
+        assert(json_document_find(doc, "list>[1]")->value.children->next->value.number == 21);
+        assert(json_document_find(doc, "skip>x>[1]>y")->type == STRING);
+    }
+    assert(doc->root.arena->blocks->used == used);
+    json_document_reset(doc);
+    assert(json_document_deserialize(doc, array) == JSON_FAILURE);
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    assert(json_document_find(doc, "obj>a")->value.number == 1);
+    release_json_document(doc);
+
+    /* lazy lookups answer every path the way the eager tree does */
+    char *paths[] = { "list>deep", "list>>", "m>>k", "m>>k>z", "m>x", "m>[1]>k", "o>[0]", "o>[1]", "m>[2]", "e>" };
+    struct varstr *text = create_varstr();
+    append_varstr_literal(text, "{\"m\": [{\"k\": 1}, {\"k\": 2}], \"o\": {\"[1]\": 3}, \"e\": []}");
+    struct json_document *eager = create_json_document(0);
+    doc = create_json_document(JSON_PARSE_LAZY);
+    assert(json_document_deserialize(eager, text) == JSON_SUCCEED && json_document_deserialize(doc, text) == JSON_SUCCEED);
+    for(k = 0; k < (int)(sizeof(paths) / sizeof(paths[0])); k++) {
+        struct json_value *want = json_document_find(eager, paths[k]);
+        value = json_document_find(doc, paths[k]);
+        assert((want == NULL) == (value == NULL));
+        if(want != NULL) {
+            assert(want->type == value->type && json_value_count(want) == json_value_count(value));
+            assert(want->type != NUMBER || want->value.number == value->value.number);
+        }
+    }
+    assert(json_document_find(doc, "m>>k")->value.number == 1 && json_document_find(doc, "o>[1]")->value.number == 3);
+    release_json_document(eager);
+    release_json_document(doc);
+    release_varstr(text);
+
+    release_varstr(array);
+    release_varstr(src);
+}
+
+void file_test()
+{
+    char *json_data = "\n  {\"name\": \"dump\", \"rows\": [1, 2, 3], \"meta\": {\"ok\": true}}\n\n";
+    char path[] = "/tmp/cjson_file_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, json_data, strlen(json_data)) == (ssize_t)strlen(json_data));
+    close(fd);
+
+    int modes[] = { 0, JSON_PARSE_ZERO_COPY, JSON_PARSE_ZERO_COPY | JSON_PARSE_STRUCTURAL, JSON_PARSE_LAZY };
+    int k;
+    for(k = 0; k < (int)(sizeof(modes) / sizeof(modes[0])); k++) {
+        struct json_document *doc = create_json_document(modes[k]);
+        assert(json_parse_file(doc, path) == JSON_SUCCEED);
+        assert((doc->map != NULL) == ((modes[k] & (JSON_PARSE_ZERO_COPY | JSON_PARSE_LAZY)) != 0));
+        assert(json_parse_file(doc, path) == JSON_FAILURE || doc->map == NULL);
+
+        struct json_value *value = json_document_find(doc, "name");
+        assert(value != NULL && value->string_len == 4 && !strncmp(value->value.string, "dump", 4));
+        assert(json_document_find(doc, "meta>ok")->value.boolean == 1);
+        release_json_document(doc);
+    }
+
+    struct json_document *doc = create_json_document(0);
+    assert(json_parse_file(doc, "/nonexistent/cjson.json") == JSON_FAILURE);
+    release_json_document(doc);
+
+    unlink(path);
+}
+
+struct ndjson_counter {
+    size_t records;
+    size_t failures;
+    long long sum;
+};
+
+static int count_record(void *ctx, size_t offset, struct json_root *root)
+{
+    struct ndjson_counter *counter = (struct ndjson_counter *)ctx;
+
+    if(root == NULL) {
+        __sync_fetch_and_add(&counter->failures, 1);
+        return JSON_SUCCEED;
+    }
+
+    __sync_fetch_and_add(&counter->records, 1);
+    __sync_fetch_and_add(&counter->sum, json_find_value(root, "id")->value.number);
+
+    return JSON_SUCCEED;
+}
+
+void ndjson_test()
+{
+    struct varstr *src = create_varstr();
+    char line[128];
+    int k;
+
+    for(k = 0; k < 20000; k++) {
+        int len = snprintf(line, sizeof(line), "{\"id\": %d, \"tags\": [\"a\", \"b\"], \"ok\": %s}\r\n%s",
+                           k, k % 2 ? "true" : "false", k % 1000 == 0 ? "\n   \n" : "");
+        append_varstr(src, line, len);
+    }
+    append_varstr_literal(src, "{\"id\": 20000, broken}\n{\"id\": 20001}");
+
+    int threads[] = { 1, 3, 0 };
+    int t;
+    for(t = 0; t < 3; t++) {
+        struct json_ndjson_batch *batch = json_ndjson_parse(src->data, src->len, threads[t], JSON_PARSE_ZERO_COPY, 0);
+        assert(batch != NULL && batch->count == 20002 && batch->failures == 1);
+        for(k = 0; k < 20000; k += 997) {
+            assert(json_find_value(batch->roots[k], "id")->value.number == k);
+        }
+        assert(batch->roots[20000] == NULL);
+        assert(json_find_value(batch->roots[20001], "id")->value.number == 20001);
+        release_json_ndjson_batch(batch);
+
+        struct ndjson_counter counter = { 0, 0, 0 };
+        assert(json_ndjson_parse_each(src->data, src->len, threads[t], 0, 0, count_record, &counter) == JSON_SUCCEED);
+        assert(counter.records == 20001 && counter.failures == 1);
+        assert(counter.sum == 19999LL * 20000 / 2 + 20001);
+    }
+
+    /* a depth limit applies per record: only the last one has no array inside */
+    struct json_ndjson_batch *batch = json_ndjson_parse(src->data, src->len, 3, 0, 1);
+    assert(batch != NULL && batch->count == 20002 && batch->failures == 20001);
+    assert(batch->roots[0] == NULL && json_find_value(batch->roots[20001], "id")->value.number == 20001);
+    release_json_ndjson_batch(batch);
+    struct ndjson_counter counter = { 0, 0, 0 };
+    assert(json_ndjson_parse_each(src->data, src->len, 3, 0, 1, count_record, &counter) == JSON_SUCCEED);
+    assert(counter.records == 1 && counter.failures == 20001 && counter.sum == 20001);
+
+    release_varstr(src);
+}
+
+void parallel_test()
+{
+    struct varstr *src = create_varstr();
+    char element[128];
+    int k;
+
+    append_varstr_literal(src, "{\"before\": {\"x\": [1, 2]}, \"records\": [");
+    for(k = 0; k < 60000; k++) {
+        int len = snprintf(element, sizeof(element), "%s{\"id\": %d, \"s\": \"a,]\\\"[\", \"v\": [%d, []]}",
+                           k ? (k % 5 ? ", " : ",\n ") : "", k, k % 7);
+        append_varstr(src, element, len);
+    }
+    append_varstr_literal(src, "], \"small\": [3, 4], \"after\": \"end\"}");
+
+    struct json_document *serial = create_json_document(0);
+    assert(json_document_deserialize(serial, src) == JSON_SUCCEED);
+    struct varstr *expected = create_varstr();
+    json_serialize(&serial->root, expected);
+
+    int threads[] = { 1, 4 };
+    int t;
+    for(t = 0; t < 2; t++) {
+        struct json_document *doc = create_json_document(JSON_PARSE_PARALLEL | JSON_PARSE_ZERO_COPY);
+        doc->threads = threads[t];
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+
+        struct varstr *actual = create_varstr();
+        json_serialize(&doc->root, actual);
+        assert(actual->len == expected->len && !memcmp(actual->data, expected->data, actual->len));
+        assert(json_find_value(&doc->root, "after")->type == STRING);
+        struct json_value *records = json_find_value(&doc->root, "records");
+        assert(json_value_count(records) == 60000);
+        assert(json_value_child_at(records, 12345)->value.children->value.number == 12345);
+
+        release_varstr(actual);
+        release_json_document(doc);
+    }
+
+    src->len -= 1;
+    append_varstr_literal(src, ",}");
+    struct json_document *doc = create_json_document(JSON_PARSE_PARALLEL);
+    assert(json_document_deserialize(doc, src) == JSON_FAILURE);
+    release_json_document(doc);
+
+    struct json_structurals *cuts = create_json_structurals();
+    char *array = "[1, \"a,b\", [2, 3], {\"c\": [4, 5]}, 6]";
+    assert(json_structurals_split(array, strlen(array), 1, cuts) == strlen(array));
+    assert(cuts->count == 4 && cuts->positions[0] == 2 && array[cuts->positions[1]] == ',' && cuts->positions[1] == 9);
+    release_json_structurals(cuts);
+
+    release_varstr(expected);
+    release_json_document(serial);
+    release_varstr(src);
+}
+
+void serialize_test()
+{
+    struct json_root *root = create_json_root();
+    struct json_value *big = create_json_array("big");
+    struct json_value *wide = create_json_object("wide");
+    struct json_value *nested = create_json_object("nested");
+    char key[32];
+    int k;
+
+    for(k = 0; k < 5000; k++) {
+        struct json_value *item = create_json_object("item");
+        json_value_insert_child(item, create_json_number("id", k));
+        json_value_insert_child(item, create_json_string("s", "x\"y"));
+        json_value_insert_child(big, item);
+
+        snprintf(key, sizeof(key), "k%d", k);
+        json_value_insert_child(wide, create_json_double(key, k / 8.0));
+    }
+    json_value_insert_child(nested, create_json_array("empty"));
+    json_value_insert_child(nested, wide);
+    json_root_insert_value(root, create_json_boolean("flag", 1));
+    json_root_insert_value(root, big);
+    json_root_insert_value(root, nested);
+
+    struct varstr *expected = create_varstr();
+    json_serialize(root, expected);
+
+    int threads[] = { 1, 3, 0 };
+    for(k = 0; k < 3; k++) {
+        struct varstr *actual = create_varstr();
+        append_varstr_literal(actual, ">");
+        assert(json_serialize_parallel(root, actual, threads[k]) == JSON_SUCCEED);
+        assert(actual->len == expected->len + 1 && !memcmp(actual->data + 1, expected->data, expected->len));
+        release_varstr(actual);
+    }
+
+    char path[] = "/tmp/cjson_serialize_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(json_serialize_fd(root, fd, 2) == JSON_SUCCEED);
+    close(fd);
+
+    struct json_document *doc = create_json_document(0);
+    assert(json_parse_file(doc, path) == JSON_SUCCEED);
+    struct varstr *reparsed = create_varstr();
+    json_serialize(&doc->root, reparsed);
+    assert(reparsed->len == expected->len);
+    release_varstr(reparsed);
+    release_json_document(doc);
+    unlink(path);
+
+    struct json_root *empty = create_json_root();
+    struct varstr *actual = create_varstr();
+    assert(json_serialize_parallel(empty, actual, 2) == JSON_SUCCEED && !strcmp(actual->data, "{}"));
+    release_varstr(actual);
+    release_json_root(empty);
+
+    release_varstr(expected);
+    release_json_root(root);
+}
+
+static void binary_round_trip(struct json_root *root, int (*encode)(struct json_root *, struct varstr *),
+        int (*decode)(struct json_root *, struct varstr *, int))
+{
+    struct varstr *expected = create_varstr();
+    struct varstr *packed = create_varstr();
+    json_serialize(root, expected);
+    assert(encode(root, packed) == JSON_SUCCEED);
+
+    struct json_root *copy = create_json_root();
+    assert(decode(copy, packed, JSON_PARSE_ZERO_COPY) == JSON_FAILURE);
+    assert(decode(copy, packed, 0) == JSON_SUCCEED);
+    struct varstr *actual = create_varstr();
+    json_serialize(copy, actual);
+    assert(!strcmp(actual->data, expected->data));
+    release_varstr(actual);
+    release_json_root(copy);
+
+    struct json_document *doc = create_json_document(JSON_PARSE_ZERO_COPY);
+    assert(decode(&doc->root, packed, JSON_PARSE_ZERO_COPY) == JSON_SUCCEED);
+    actual = create_varstr();
+    json_serialize(&doc->root, actual);
+    assert(!strcmp(actual->data, expected->data));
+    release_varstr(actual);
+    release_json_document(doc);
+
+    /* every prefix is cut inside some item */
+    size_t full = packed->len;
+    for(packed->len = 0; packed->len < full; packed->len++) {
+        copy = create_json_root();
+        assert(decode(copy, packed, 0) == JSON_FAILURE);
+        release_json_root(copy);
+    }
+
+    release_varstr(packed);
+    release_varstr(expected);
+}
+
+void binary_test()
+{
+    struct varstr *str = create_varstr();
+    int k;
+    append_varstr_literal(str, "{\"s\":\"tab\\there \\\"q\\\" \xc3\xa9\\u0001\",\"n\":[0,-1,-33,127,128,-129,70000,-70000,5000000000,-5000000000],"
+            "\"d\":[0.5,-2.25e10],\"b\":[true,false],\"o\":{\"\":{},\"k\\\\\":[[]]},\"long\":\"0123456789012345678901234567890123456789\"}");
+    struct json_root *root = create_json_root();
+    assert(json_deserialize(root, str) == JSON_SUCCEED);
+    json_root_insert_value(root, create_json_float("f", 1.5f));
+
+    binary_round_trip(root, json_msgpack_encode, json_msgpack_decode);
+    binary_round_trip(root, json_cbor_encode, json_cbor_decode);
+
+    struct json_value *f = NULL;
+    struct varstr *packed = create_varstr();
+    struct json_root *copy = create_json_root();
+    assert(json_cbor_encode(root, packed) == JSON_SUCCEED);
+    assert(json_cbor_decode(copy, packed, 0) == JSON_SUCCEED);
+    f = json_find_value(copy, "f");
+    assert(f != NULL && f->type == FLOAT && f->value.float_decimal == 1.5f);
+    f = json_find_value(copy, "s");
+    char *s = json_value_unescape_string(f);
+    assert(!strcmp(s, "tab\there \"q\" \xc3\xa9\x01"));
+    free(s);
+    release_json_root(copy);
+    release_varstr(packed);
+    release_json_root(root);
+
+    root = create_json_root();
+    json_root_insert_value(root, create_json_number("a", 1));
+    packed = create_varstr();
+    json_msgpack_encode(root, packed);
+    assert(packed->len == 4 && !memcmp(packed->data, "\x81\xa1" "a\x01", 4));
+    packed->len = 0;
+    json_cbor_encode(root, packed);
+    assert(packed->len == 4 && !memcmp(packed->data, "\xa1\x61" "a\x01", 4));
+    release_varstr(packed);
+    release_json_root(root);
+
+    /* a uint64 past LLONG_MAX, a half float; nil and CBOR indefinite lengths have no JSON form */
+    struct varstr *raw = create_varstr();
+    append_varstr(raw, "\x82\xa1u\xcf\xff\xff\xff\xff\xff\xff\xff\xff\xa1h\xc2", 15);
+    copy = create_json_root();
+    assert(json_msgpack_decode(copy, raw, 0) == JSON_SUCCEED);
+    f = json_find_value(copy, "u");
+    assert(f->type == DOUBLE && f->value.double_decimal == 18446744073709551615.0);
+    release_json_root(copy);
+    raw->len = 0;
+    append_varstr(raw, "\xa1\x61h\xf9\x3e\x00", 6);
+    copy = create_json_root();
+    assert(json_cbor_decode(copy, raw, 0) == JSON_SUCCEED);
+    f = json_find_value(copy, "h");
+    assert(f->type == FLOAT && f->value.float_decimal == 1.5f);
+    release_json_root(copy);
+    const char *bad[] = { "\x81\xa1n\xc0", "\xbf\x61k\x01\xff", "\xa1\x01\x01", "\x82\xa1" "a\x01" };
+    size_t bad_len[] = { 4, 5, 3, 4 };
+    for(k = 0; k < 4; k++) {
+        raw->len = 0;
+        append_varstr(raw, bad[k], bad_len[k]);
+        copy = create_json_root();
+        assert(json_msgpack_decode(copy, raw, 0) == JSON_FAILURE && json_cbor_decode(copy, raw, 0) == JSON_FAILURE);
+        release_json_root(copy);
+    }
+
+    /* nesting past JSON_BINARY_DEPTH_MAX is refused rather than recursed into */
+    raw->len = 0;
+    append_varstr(raw, "\x81\xa1" "a", 3);
+    for(k = 0; k < 2 * JSON_BINARY_DEPTH_MAX; k++) {
+        append_varstr_char(raw, '\x91');
+    }
+    append_varstr_char(raw, '\x01');
+    copy = create_json_root();
+    assert(json_msgpack_decode(copy, raw, 0) == JSON_FAILURE);
+    release_json_root(copy);
+    release_varstr(raw);
+
+    release_varstr(str);
+}
+
+void snapshot_test()
+{
+    struct varstr *src = create_varstr();
+    append_varstr_literal(src, "{\"name\":\"cfg \\\"x\\\"\",\"On\":true,\"ratio\":0.25,\"nums\":[1,-2],\"list\":[{\"deep\":[\"a\",\"b\"]}],\"empty\":{},\"wide\":{");
+    char key[32];
+    int k;
+    for(k = 0; k < 40; k++) {
+        snprintf(key, sizeof(key), "%s\"Key%d\":%d", k ? "," : "", k, k);
+        append_varstr(src, key, strlen(key));
+    }
+    append_varstr_literal(src, ",\"key7\":-7}}");
+    struct json_root *root = create_json_root();
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
+    json_root_insert_value(root, create_json_float("f", 2.5f));
+
+    struct varstr *image = create_varstr();
+    append_varstr_literal(image, "stale");
+    assert(json_snapshot_write(root, image) == JSON_SUCCEED);
+    assert(image->len % 8 == 0 && !memcmp(image->data, JSON_SNAPSHOT_MAGIC, 8));
+
+    char *queries[] = { "name", "on", "ratio", "nums>[1]", "list>[0]>deep>[1]", "wide>key7", "wide>KEY39", "f", "empty" };
+    struct json_snapshot *snap = json_snapshot_from_memory(image->data, image->len);
+    assert(snap != NULL);
+    for(k = 0; k < 9; k++) {
+        int flags;
+        for(flags = 0; flags <= JSON_FIND_CASE_SENSITIVE; flags++) {
+            struct json_value *value = json_find_value_flags(root, queries[k], flags);
+            struct json_view view = json_snapshot_find(snap, queries[k], flags);
+            assert(json_view_valid(view) == (value != NULL));
+            if(value == NULL) {
+                continue;
+            }
+            assert(json_view_type(view) == value->type);
+            size_t len = 0;
+            switch(value->type) {
+            case NUMBER:
+                assert(json_view_number(view) == value->value.number);
+                break;
+            case BOOLEAN:
+                assert(json_view_boolean(view) == value->value.boolean);
+                break;
+            case FLOAT:
+                assert(json_view_float(view) == value->value.float_decimal);
+                break;
+            case DOUBLE:
+                assert(json_view_double(view) == value->value.double_decimal);
+                break;
+            case STRING:
+                assert(!strcmp(json_view_string(view, &len), value->value.string) && len == value->string_len);
+                break;
+            case ARRAY:
+            case OBJECT:
+                len = 0;
+                for(struct json_value *child = value->value.children; child != NULL; child = child->next) {
+                    len++;
+                }
+                assert(json_view_count(view) == len);
+                break;
+            }
+        }
+    }
+
+    struct json_view wide = json_snapshot_find(snap, "wide", 0);
+    size_t name_len = 0;
+    assert(json_view_count(wide) == 41);
+    struct json_value *first = json_find_value(root, "wide")->value.children;
+    assert(!strncmp(json_view_name_at(wide, 0, &name_len), first->name, first->name_len) && name_len == first->name_len);
+    assert(json_view_number(json_view_at(wide, 0)) == first->value.number);
+    assert(json_view_number(json_view_member(wide, "Key7", 4, JSON_FIND_CASE_SENSITIVE)) == 7);
+    assert(!json_view_valid(json_view_member(wide, "key40", 5, 0)));
+    assert(!json_view_valid(json_view_at(wide, 41)));
+    assert(!json_view_valid(json_snapshot_find(snap, "name>x", 0)));
+
+    struct json_path *path = create_json_path("list>[0]>deep>[0]", 0);
+    assert(!strcmp(json_view_string(json_snapshot_find_path(snap, path), NULL), json_find_value(root, "list>[0]>deep>[0]")->value.string));
+    release_json_path(path);
+    json_snapshot_close(snap);
+
+    char file[] = "/tmp/cjson_snapshot_test_XXXXXX";
+    int fd = mkstemp(file);
+    assert(fd >= 0);
+    close(fd);
+    assert(json_snapshot_save(root, file) == JSON_SUCCEED);
+    snap = json_snapshot_open(file);
+    assert(snap != NULL && snap->map != NULL && snap->len == image->len && !memcmp(snap->base, image->data, image->len));
+    assert(json_view_number(json_snapshot_find(snap, "wide>key12", 0)) == 12);
+    json_snapshot_close(snap);
+    unlink(file);
+
+    assert(json_snapshot_from_memory(image->data, image->len - 8) == NULL);
+    image->data[0] = 'x';
+    assert(json_snapshot_from_memory(image->data, image->len) == NULL);
+
+    struct json_root *empty = create_json_root();
+    assert(json_snapshot_write(empty, image) == JSON_SUCCEED);
+    snap = json_snapshot_from_memory(image->data, image->len);
+    assert(snap != NULL && json_view_count(json_snapshot_root(snap)) == 0 && !json_view_valid(json_snapshot_find(snap, "a", 0)));
+    json_snapshot_close(snap);
+    release_json_root(empty);
+
+    release_varstr(image);
+    release_json_root(root);
+    release_varstr(src);
+}
+
+void tape_test()
+{
+    struct varstr *src = create_varstr();
+    append_varstr_literal(src, "{\"id\":7,\"Name\":\"a\\\"b\",\"ok\":false,\"ratio\":-0.5,\"list\":[1,[2,3],{\"x\":[]},\"s\"],\"empty\":{},\"tail\":true}");
+    struct json_tape *tape = create_json_tape();
+    int flags;
+
+    for(flags = 0; flags <= JSON_PARSE_ZERO_COPY; flags++) {
+        assert(json_tape_deserialize(tape, src, flags) == JSON_SUCCEED);
+        assert(tape->count == 23 && json_tape_type(tape, 0) == OBJECT && json_tape_count(tape, 0) == 7);
+        assert(json_tape_skip(tape, 0) == tape->count);
+
+        /* members come back in text order */
+        struct varstr *out = create_varstr();
+        assert(json_tape_serialize(tape, out) == JSON_SUCCEED);
+        assert(!strcmp(out->data, "{\"id\":7,\"Name\":\"a\\\"b\",\"ok\":false,\"ratio\":-0.5,\"list\":[1,[2,3],{\"x\":[]},\"s\"],\"empty\":{},\"tail\":true}"));
+        release_varstr(out);
+
+        size_t entry = 0, len = 0;
+        assert(json_tape_number(tape, json_tape_find_value(tape, "ID", 0)) == 7);
+        assert(json_tape_find_value(tape, "name", JSON_FIND_CASE_SENSITIVE) == JSON_TAPE_NONE);
+        const char *str = json_tape_string(tape, json_tape_find_value(tape, "Name", JSON_FIND_CASE_SENSITIVE), &len);
+        assert(len == 4 && !strncmp(str, "a\\\"b", 4));
+        assert(json_tape_double(tape, json_tape_find_value(tape, "ratio", 0)) == -0.5);
+        assert(json_tape_boolean(tape, json_tape_find_value(tape, "tail", 0)) == 1);
+        assert(json_tape_number(tape, json_tape_find_value(tape, "list>[1]>[1]", 0)) == 3);
+        assert(json_tape_type(tape, json_tape_find_value(tape, "list>[2]>x", 0)) == ARRAY);
+        assert(json_tape_find_value(tape, "list>[4]", 0) == JSON_TAPE_NONE);
+        assert(json_tape_find_value(tape, "id>x", 0) == JSON_TAPE_NONE);
+        assert(json_tape_count(tape, json_tape_find_value(tape, "empty", 0)) == 0);
+
+        /* iteration steps over whole subtrees */
+        struct json_tape_iter iter = json_tape_iterate(tape, json_tape_find_value(tape, "list", 0));
+        JSON_TYPE types[] = { NUMBER, ARRAY, OBJECT, STRING };
+        const char *name = "unset";
+        int k = 0;
+        while(json_tape_next(&iter, &entry, &name, NULL)) {
+            assert(name == NULL && json_tape_type(tape, entry) == types[k++]);
+        }
+        assert(k == 4);
+
+        iter = json_tape_iterate(tape, 0);
+        k = 0;
+        while(json_tape_next(&iter, &entry, &name, &len)) {
+            k++;
+        }
+        assert(k == 7 && len == 4 && !strncmp(name, "tail", 4));
+    }
+
+    /* the tape is reused; a failed parse leaves it empty */
+    src->len = 0;
+    append_varstr_literal(src, "{\"a\":[1,}");
+    assert(json_tape_deserialize(tape, src, 0) == JSON_FAILURE && tape->count == 0);
+    src->len = 0;
+    append_varstr_literal(src, "[1]");
+    assert(json_tape_deserialize(tape, src, 0) == JSON_FAILURE);
+
+    release_json_tape(tape);
+    release_varstr(src);
+}
+
+void keys_test()
+{
+    struct json_keys *keys = create_json_keys();
+    char *id = json_keys_intern(keys, "id", 2);
+    assert(id != NULL && strcmp(id, "id") == 0 && json_keys_intern(keys, "id", 2) == id);
+    assert(json_keys_intern(keys, "ID", 2) != id && keys->count == 2);
+    assert(json_keys_find(keys, "Id", 2, json_index_hash("Id", 2), 0) == id);
+    assert(json_keys_find(keys, "Id", 2, json_index_hash("Id", 2), JSON_FIND_CASE_SENSITIVE) == NULL);
+
+    char name[16];
+    int k;
+    for(k = 0; k < 1000; k++) {
+        int len = snprintf(name, sizeof(name), "k%d", k);
+        assert(json_keys_intern(keys, name, len) != NULL);
+    }
+    assert(keys->count == 1002 && json_keys_intern(keys, "k500", 4) == json_keys_find(keys, "k500", 4, json_index_hash("k500", 4), 0));
+
+    struct json_document *doc = NULL;
+    char *texts[] = { "{\"id\":1,\"user\":{\"name\":\"a\",\"id\":2},\"list\":[{\"id\":3}]}",
+                      "{\"list\":[{\"id\":4},{\"Id\":5}],\"id\":6}" };
+    /* interning keeps a parse on one thread, so JSON_PARSE_PARALLEL has nothing to add here */
+    int flags[] = { 0, JSON_PARSE_STRUCTURAL, JSON_PARSE_ZERO_COPY };
+    int f;
+    for(f = 0; f < 3; f++) {
+        struct json_document *docs[2];
+        struct varstr *srcs[2];
+        for(k = 0; k < 2; k++) {
+            srcs[k] = create_varstr();
+            append_varstr(srcs[k], texts[k], strlen(texts[k]));
+            docs[k] = create_json_document(flags[f]);
+            docs[k]->root.keys = keys;
+            assert(json_document_deserialize(docs[k], srcs[k]) == JSON_SUCCEED);
+        }
+
+        struct json_value *first = json_find_value(&docs[0]->root, "user>id");
+        struct json_value *second = json_find_value(&docs[1]->root, "list>[0]>id");
+        assert(first->value.number == 2 && second->value.number == 4 && first->name == second->name && first->name == id);
+        assert(json_find_value(&docs[1]->root, "list>[1]>id")->value.number == 5);
+        assert(json_find_value_flags(&docs[1]->root, "list>[1]>id", JSON_FIND_CASE_SENSITIVE) == NULL);
+        assert(json_find_value_flags(&docs[1]->root, "list>[1]>Id", JSON_FIND_CASE_SENSITIVE)->value.number == 5);
+        assert(json_find_value(&docs[0]->root, "user>missing") == NULL);
+        assert(json_find_value(&docs[0]->root, "ID")->value.number == 1);
+
+        struct varstr *dst = create_varstr();
+        json_serialize(&docs[0]->root, dst);
+        assert(dst->len == strlen(texts[0]) && !memcmp(dst->data, texts[0], dst->len));
+        release_varstr(dst);
+
+        release_json_document(docs[0]);
+        release_json_document(docs[1]);
+        release_varstr(srcs[0]);
+        release_varstr(srcs[1]);
+    }
+    assert(keys->count == 1006);
+
+    /* only member names go into the table; string values stay the document's own */
+    doc = create_json_document(0);
+    doc->root.keys = keys;
+    struct json_push_parser *push = create_json_push_parser(&doc->root);
+    assert(json_push_parser_feed(push, "{\"k\":\"v1\"}", 10) == JSON_PUSH_DONE);
+    assert(keys->count == 1007 && json_find_value(&doc->root, "k")->string_len == 2);
+    release_json_push_parser(push);
+    json_document_reset(doc);
+    push = create_json_push_parser(&doc->root);
+    assert(json_push_parser_feed(push, "{\"k\":\"v2\"}", 10) == JSON_PUSH_DONE);
+    assert(keys->count == 1007);
+    release_json_push_parser(push);
+    release_json_document(doc);
+
+    /* members inserted after an interned parse keep their own names and are still found */
+    struct varstr *src = create_varstr();
+    append_varstr(src, texts[0], strlen(texts[0]));
+    doc = create_json_document(0);
+    doc->root.keys = keys;
+    assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+    struct json_value added[2];
+    memset(added, 0, sizeof(added));
+    char fresh[] = "fresh", known[] = "name";
+    added[0].type = NUMBER;
+    added[0].name = fresh;
+    added[0].name_len = 5;
+    added[0].value.number = 7;
+    added[1].type = NUMBER;
+    added[1].name = known;
+    added[1].name_len = 4;
+    added[1].value.number = 8;
+    assert(json_value_insert_child(json_find_value(&doc->root, "user"), &added[0]) == JSON_SUCCEED);
+    assert(json_root_insert_value(&doc->root, &added[1]) == JSON_SUCCEED);
+    assert(json_find_value(&doc->root, "user>fresh") == &added[0]);
+    assert(json_find_value_flags(&doc->root, "user>fresh", JSON_FIND_CASE_SENSITIVE) == &added[0]);
+    assert(json_find_value(&doc->root, "NAME") == &added[1]);
+    assert(json_find_value_flags(&doc->root, "name", JSON_FIND_CASE_SENSITIVE) == &added[1]);
+    assert(json_find_value_flags(&doc->root, "user>name", JSON_FIND_CASE_SENSITIVE)->name != known);
+    release_json_document(doc);
+    src->len = 0;
+    struct varstr *packed = create_varstr();
+    append_varstr(src, texts[0], strlen(texts[0]));
+    struct json_root *root = create_json_root();
+    root->keys = keys;
+    assert(json_deserialize(root, src) == JSON_SUCCEED);
+    assert(json_find_value(root, "user>id")->name != id);
+    assert(json_msgpack_encode(root, packed) == JSON_SUCCEED);
+    release_json_root(root);
+
+    doc = create_json_document(0);
+    doc->root.keys = keys;
+    assert(json_msgpack_decode(&doc->root, packed, 0) == JSON_SUCCEED);
+    assert(json_find_value(&doc->root, "list>[0]>id")->name == id);
+    release_json_document(doc);
+    release_varstr(packed);
+
+    src->len = 0;
+    for(k = 0; k < 5000; k++) {
+        int len = snprintf(name, sizeof(name), "{\"id\":%d}\n", k);
+        append_varstr(src, name, len);
+    }
+    struct json_ndjson_batch *batch = json_ndjson_parse(src->data, src->len, 2, JSON_PARSE_INTERN_KEYS, 0);
+    assert(batch != NULL && batch->count == 5000 && batch->keys != NULL);
+    for(k = 0; k < 5000; k += 499) {
+        assert(json_find_value(batch->roots[k], "ID")->value.number == k);
+        assert(json_find_value(batch->roots[k], "name") == NULL);
+    }
+    assert(batch->roots[0]->elems->name == batch->roots[1]->elems->name);
+    release_json_ndjson_batch(batch);
+
+    release_varstr(src);
+    release_json_keys(keys);
+}
+
+static size_t count_blocks(struct json_arena_block *block)
+{
+    size_t count = 0;
+    for(; block != NULL; block = block->next) {
+        count++;
+    }
+
+    return count;
+}
+
+/* counts what is still out, so a test can tell everything came back; parallel workers call it too */
+struct counting_allocator {
+    size_t calls;
+    long live;
+};
+
+static void *counting_alloc(void *ctx, size_t size)
+{
+    struct counting_allocator *counter = (struct counting_allocator *)ctx;
+    void *ptr = malloc(size);
+    if(ptr != NULL) {
+        __atomic_add_fetch(&counter->calls, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&counter->live, 1, __ATOMIC_RELAXED);
+    }
+
+    return ptr;
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size)
+{
+    struct counting_allocator *counter = (struct counting_allocator *)ctx;
+    void *res = realloc(ptr, size);
+    if(res != NULL) {
+        __atomic_add_fetch(&counter->calls, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&counter->live, ptr == NULL, __ATOMIC_RELAXED);
+    }
+
+    return res;
+}
+
+static void counting_free(void *ctx, void *ptr)
+{
+    __atomic_sub_fetch(&((struct counting_allocator *)ctx)->live, 1, __ATOMIC_RELAXED);
+    free(ptr);
+}
+
+void reset_test()
+{
+    struct json_arena *arena = create_json_arena(64);
+    char *first = (char *)json_arena_alloc(arena, 48);
+    json_arena_alloc(arena, 100);
+    json_arena_alloc(arena, 300);
+    assert(count_blocks(arena->blocks) == 3);
+    json_arena_reset(arena);
+    assert(arena->blocks == NULL && count_blocks(arena->spare) == 3);
+    assert(arena->spare->cap >= arena->spare->next->cap);
+    json_arena_alloc(arena, 300);
+    json_arena_alloc(arena, 100);
+    assert(count_blocks(arena->blocks) == 1 && count_blocks(arena->spare) == 2);
+    json_arena_alloc(arena, 5000);
+    assert(count_blocks(arena->blocks) == 2 && count_blocks(arena->spare) == 2);
+    json_arena_reset(arena);
+    assert(arena->blocks == NULL && count_blocks(arena->spare) == 4 && arena->spare->cap >= 5000);
+    assert(first != NULL);
+    release_json_arena(arena);
+
+    struct varstr *src = create_varstr();
+    char element[64];
+    int k;
+    append_varstr_literal(src, "{\"list\":[");
+    for(k = 0; k < 5000; k++) {
+        int len = snprintf(element, sizeof(element), "%s{\"id\":%d,\"s\":\"v\\n%d\"}", k ? "," : "", k, k);
+        append_varstr(src, element, len);
+    }
+    append_varstr_literal(src, "],\"tail\":true}");
+
+    int flags[] = { 0, JSON_PARSE_STRUCTURAL, JSON_PARSE_ZERO_COPY };
+    int f;
+    for(f = 0; f < 3; f++) {
+        struct json_document *doc = create_json_document(flags[f]);
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+        size_t blocks = count_blocks(doc->root.arena->blocks);
+        /* recycled blocks are filled largest first, so addresses settle from the second parse on */
+        json_document_reset(doc);
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+        struct json_value *list = json_find_value(&doc->root, "list");
+
+        int round;
+        for(round = 0; round < 3; round++) {
+            assert(json_document_reset(doc) == JSON_SUCCEED);
+            assert(doc->root.elems == NULL && json_find_value(&doc->root, "list") == NULL);
+            assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+
+            assert(json_find_value(&doc->root, "list") == list);
+            assert(count_blocks(doc->root.arena->blocks) + count_blocks(doc->root.arena->spare) == blocks);
+            assert(json_find_value(&doc->root, "list>[4999]>id")->value.number == 4999);
+            assert(json_find_value(&doc->root, "tail")->value.boolean == 1);
+        }
+
+        json_document_reset(doc);
+        struct varstr *small = create_varstr();
+        append_varstr_literal(small, "{\"a\":[1,2]}");
+        assert(json_document_deserialize(doc, small) == JSON_SUCCEED);
+        assert(json_value_count(json_find_value(&doc->root, "a")) == 2 && json_find_value(&doc->root, "list") == NULL);
+        release_varstr(small);
+
+        release_json_document(doc);
+    }
+
+    /* parallel ranges keep their arenas on the document, so cycles neither grow nor allocate */
+    struct counting_allocator global = { 0, 0 }, mine = { 0, 0 };
+    struct json_allocator counting = { counting_alloc, counting_realloc, counting_free, &global };
+    struct json_allocator own = { counting_alloc, counting_realloc, counting_free, &mine };
+    src->len = 0;
+    append_varstr_literal(src, "{\"list\":[");
+    for(k = 0; k < 40000; k++) {
+        int len = snprintf(element, sizeof(element), "%s{\"id\":%d,\"s\":\"v\\n%d\"}", k ? "," : "", k, k);
+        append_varstr(src, element, len);
+    }
+    append_varstr_literal(src, "]}");
+
+    json_set_allocator(&counting);
+    struct json_document *doc = create_json_document_allocator(JSON_PARSE_PARALLEL, &own);
+    doc->threads = 4;
+    long live = 0;
+    size_t calls = 0;
+    int round;
+    for(round = 0; round < 6; round++) {
+        json_document_reset(doc);
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+        assert(json_value_count(json_find_value(&doc->root, "list")) == 40000);
+        assert(json_find_value(&doc->root, "list>[39999]>id")->value.number == 39999);
+        if(round == 2) {
+            live = mine.live + global.live;
+            calls = mine.calls + global.calls;
+        } else if(round > 2) {
+            assert(mine.live + global.live == live && mine.calls + global.calls == calls);
+        }
+    }
+    assert(doc->range_count > 4 && doc->range_count == doc->structurals->count + 1);
+    release_json_document(doc);
+    json_set_allocator(NULL);
+    assert(mine.live == 0);
+
+    release_varstr(src);
+}
+
+void allocator_test()
+{
+    struct counting_allocator global = { 0, 0 };
+    struct json_allocator counting = { counting_alloc, counting_realloc, counting_free, &global };
+    json_set_allocator(&counting);
+    assert(json_get_allocator() == &counting);
+
+    struct json_root *root = create_json_root();
+    struct json_value *list = create_json_array("list");
+    json_value_insert_child(list, create_json_number("n", 1));
+    json_value_insert_child(list, create_json_string("s", "a\"b"));
+    json_root_insert_value(root, list);
+    struct varstr *str = create_varstr();
+    assert(json_serialize(root, str) == JSON_SUCCEED);
+    char *name = json_value_unescape_name(list);
+    assert(!strcmp(name, "list"));
+    json_free(name);
+    release_json_root(root);
+    assert(global.calls > 0 && global.live > 0);
+
+    struct json_keys *keys = create_json_keys();
+    struct json_document *doc = create_json_document(JSON_PARSE_STRUCTURAL);
+    doc->root.keys = keys;
+    assert(json_document_deserialize(doc, str) == JSON_SUCCEED);
+    assert(json_find_value(&doc->root, "list>[1]")->type == STRING);
+    json_document_reset(doc);
+    assert(json_document_deserialize(doc, str) == JSON_SUCCEED);
+    release_json_document(doc);
+    release_json_keys(keys);
+    release_varstr(str);
+    assert(global.live == 0);
+
+    json_set_allocator(NULL);
+    assert(json_get_allocator() != &counting);
+
+    /* a document of its own allocator takes its blocks there, and the rest from the global one */
+    struct counting_allocator mine = { 0, 0 };
+    struct json_allocator own = { counting_alloc, counting_realloc, counting_free, &mine };
+    str = create_varstr();
+    append_varstr_literal(str, "{\"a\":[1,2,3],\"b\":{\"c\":\"d\"}}");
+    doc = create_json_document_allocator(0, &own);
+    assert(doc->root.arena->allocator == &own && mine.live == 2);
+    assert(json_document_deserialize(doc, str) == JSON_SUCCEED);
+    assert(mine.live == 3 && json_value_count(json_find_value(&doc->root, "a")) == 3);
+    release_json_document(doc);
+    release_varstr(str);
+    assert(mine.live == 0);
+
+    /* indexes, cuts, range arenas and deep parse stacks all belong to the document */
+    str = create_varstr();
+    append_varstr_literal(str, "{\"deep\":");
+    int k;
+    for(k = 0; k < 100; k++) {
+        append_varstr_literal(str, "[");
+    }
+    for(k = 0; k < 100; k++) {
+        append_varstr_literal(str, "]");
+    }
+    append_varstr_literal(str, ",\"list\":[");
+    for(k = 0; k < 60000; k++) {
+        char element[64];
+        int len = snprintf(element, sizeof(element), "%s{\"id\":%d,\"v\":[[[%d]]]}", k ? "," : "", k, k);
+        append_varstr(str, element, len);
+    }
+    append_varstr_literal(str, "]}");
+
+    int flags[] = { JSON_PARSE_STRUCTURAL, JSON_PARSE_PARALLEL, JSON_PARSE_STRUCTURAL | JSON_PARSE_PARALLEL };
+    int f;
+    for(f = 0; f < 3; f++) {
+        json_set_allocator(&counting);
+        global.calls = 0;
+        doc = create_json_document_allocator(flags[f], &own);
+        doc->threads = 4;
+        assert(json_document_deserialize(doc, str) == JSON_SUCCEED);
+        assert(json_find_value(&doc->root, "list>[59999]>v>[0]>[0]>[0]")->value.number == 59999);
+        assert(json_find_value(&doc->root, "deep>[0]>[0]")->type == ARRAY);
+        json_document_reset(doc);
+        assert(json_document_deserialize(doc, str) == JSON_SUCCEED);
+        release_json_document(doc);
+        json_set_allocator(NULL);
+        assert(global.calls == 0 && mine.calls > 0 && mine.live == 0);
+    }
+
+    /* so do a push parser's frames and token, and every buffer of a tape */
+    json_set_allocator(&counting);
+    global.calls = 0;
+    mine.calls = 0;
+    doc = create_json_document_allocator(0, &own);
+    struct json_push_parser *push = create_json_push_parser(&doc->root);
+    size_t at;
+    JSON_PUSH_STATUS status = JSON_PUSH_NEED_MORE;
+    for(at = 0; at < str->len; at += 1000) {
+        status = json_push_parser_feed(push, str->data + at, str->len - at < 1000 ? str->len - at : 1000);
+    }
+    assert(status == JSON_PUSH_DONE);
+    assert(json_find_value(&doc->root, "list>[59999]>v>[0]>[0]>[0]")->value.number == 59999);
+    release_json_push_parser(push);
+    release_json_document(doc);
+
+    struct json_tape *tape = create_json_tape_allocator(&own);
+    struct varstr *out = create_varstr_allocator(&own);
+    assert(json_tape_deserialize(tape, str, 0) == JSON_SUCCEED);
+    assert(json_tape_serialize(tape, out) == JSON_SUCCEED);
+    assert(out->len == str->len && !memcmp(out->data, str->data, str->len));
+    release_varstr(out);
+    release_json_tape(tape);
+    json_set_allocator(NULL);
+    assert(global.calls == 0 && mine.calls > 0 && mine.live == 0);
+    release_varstr(str);
+}
+
+void stats_test()
+{
+    struct varstr *str = create_varstr();
+    append_varstr_literal(str, "{\"a\":[1,2.5,{\"b\":[true]}],\"s\":\"x\"}");
+    struct json_root *root = create_json_root();
+
+    json_stats_reset();
+    assert(json_deserialize(root, str) == JSON_SUCCEED);
+    assert(json_find_value(root, "a>[2]>b>[0]")->value.boolean == 1);
+    struct varstr *out = create_varstr();
+    assert(json_serialize(root, out) == JSON_SUCCEED);
+    struct json_stats stats = *json_stats_get();
+
+#ifdef JSON_STATS
+    assert(stats.bytes_parsed == str->len && stats.parses == 1);
+    assert(stats.nodes[ARRAY] == 2 && stats.nodes[OBJECT] == 1 && stats.nodes[NUMBER] == 1);
+    assert(stats.nodes[DOUBLE] == 1 && stats.nodes[BOOLEAN] == 1 && stats.nodes[STRING] == 1);
+    assert(stats.max_depth == 4);
+    assert(stats.finds == 1 && stats.serializes == 1 && stats.allocs > 0 && stats.alloc_bytes > 0);
+    assert(stats.parse_ns > 0 && stats.serialize_ns > 0);
+
+    struct json_document *doc = create_json_document(JSON_PARSE_STRUCTURAL);
+    json_stats_reset();
+    assert(json_document_deserialize(doc, str) == JSON_SUCCEED);
+    assert(json_stats_get()->max_depth == 4 && json_stats_get()->nodes[ARRAY] == 2);
+    release_json_document(doc);
+
+    /* workers hand their counts back to the thread that ran them */
+    struct json_stats total;
+    memset(&total, 0, sizeof(total));
+    json_stats_add(&total, &stats);
+    json_stats_add(&total, &stats);
+    assert(total.nodes[ARRAY] == 4 && total.max_depth == 4 && total.parses == 2);
+#else
+    size_t k;
+    for(k = 0; k < JSON_STATS_TYPES; k++) {
+        assert(stats.nodes[k] == 0);
+    }
+    assert(stats.bytes_parsed == 0 && stats.allocs == 0 && stats.parses == 0 && stats.max_depth == 0);
+#endif
+
+    release_varstr(out);
+    release_json_root(root);
+    release_varstr(str);
+}
+
+void depth_test()
+{
+    /* hostile nesting is refused on the way down, without recursion */
+    struct varstr *deep = create_varstr();
+    int k;
+    append_varstr_literal(deep, "{\"a\":");
+    for(k = 0; k < 100000; k++) {
+        append_varstr_char(deep, '[');
+    }
+    for(k = 0; k < 100000; k++) {
+        append_varstr_char(deep, ']');
+    }
+    append_varstr_char(deep, '}');
+
+    int flags[] = { 0, JSON_PARSE_STRUCTURAL, JSON_PARSE_PARALLEL };
+    int f;
+    for(f = 0; f < 3; f++) {
+        struct json_document *doc = create_json_document(flags[f]);
+        assert(json_document_deserialize(doc, deep) == JSON_FAILURE);
+        release_json_document(doc);
+    }
+    struct json_root *root = create_json_root();
+    assert(json_deserialize_flags(root, deep, JSON_PARSE_STRUCTURAL) == JSON_FAILURE);
+    release_json_root(root);
+    root = create_json_root();
+    struct json_push_parser *push = create_json_push_parser(root);
+    assert(json_push_parser_feed(push, deep->data, deep->len) == JSON_PUSH_ERROR);
+    release_json_push_parser(push);
+    release_json_root(root);
+    struct json_tape *tape = create_json_tape();
+    assert(json_tape_deserialize(tape, deep, 0) == JSON_FAILURE);
+    release_json_tape(tape);
+    struct json_document *lazy = create_json_document(JSON_PARSE_LAZY);
+    assert(json_document_deserialize(lazy, deep) == JSON_SUCCEED);
+    assert(json_document_find(lazy, "a") == NULL);
+    release_json_document(lazy);
+
+    /* the limit counts the root object, and a document right at it still parses */
+    struct varstr *src = create_varstr();
+    append_varstr_literal(src, "{\"a\":[[ [{\"b\":1} ] ],{ }],\"e\":[ ]}");
+    for(f = 0; f < 3; f++) {
+        struct json_document *doc = create_json_document(flags[f]);
+        doc->root.max_depth = 5;
+        assert(json_document_deserialize(doc, src) == JSON_SUCCEED);
+        assert(json_find_value(&doc->root, "a>[0]>[0]>[0]>b")->value.number == 1);
+        assert(json_value_count(json_find_value(&doc->root, "e")) == 0);
+        json_document_reset(doc);
+        doc->root.max_depth = 4;
+        assert(json_document_deserialize(doc, src) == JSON_FAILURE);
+        release_json_document(doc);
+    }
+
+    root = create_json_root();
+    root->max_depth = 4;
+    push = create_json_push_parser(root);
+    assert(json_push_parser_feed(push, src->data, src->len) == JSON_PUSH_ERROR);
+    release_json_push_parser(push);
+    release_json_root(root);
+
+    lazy = create_json_document(JSON_PARSE_LAZY);
+    lazy->root.max_depth = 4;
+    assert(json_document_deserialize(lazy, src) == JSON_SUCCEED);
+    assert(json_document_find(lazy, "a>[1]") != NULL && json_document_find(lazy, "e") != NULL);
+    assert(json_document_find(lazy, "a>[0]") == NULL && json_document_find(lazy, "a>[0]>[0]>[0]>b") == NULL);
+    release_json_document(lazy);
+
+    /* the SAX walk and the tape take the same limit */
+    struct json_sax_handler handler = { count_object, count_end, count_array, count_end, count_key, count_string, count_number, NULL, count_boolean };
+    sax_counter counter;
+    memset(&counter, 0, sizeof(counter));
+    assert(json_sax_parse_depth(src->data, src->len, &handler, &counter, 5) == JSON_SUCCEED);
+    assert(counter.objects == 3 && counter.arrays == 4 && counter.depth == 0);
+    memset(&counter, 0, sizeof(counter));
+    assert(json_sax_parse_depth(src->data, src->len, &handler, &counter, 4) == JSON_FAILURE);
+    assert(json_sax_parse(deep->data, deep->len, &handler, &counter) == JSON_FAILURE);
+    tape = create_json_tape();
+    tape->max_depth = 4;
+    assert(json_tape_deserialize(tape, src, 0) == JSON_FAILURE);
+    release_json_tape(tape);
+
+    /* a tree deeper than the C stack could recurse through is still walked */
+    struct varstr *out = create_varstr();
+    tape = create_json_tape();
+    tape->max_depth = 100001;
+    assert(json_tape_deserialize(tape, deep, 0) == JSON_SUCCEED);
+    assert(json_tape_serialize(tape, out) == JSON_SUCCEED);
+    assert(out->len == deep->len && memcmp(out->data, deep->data, deep->len) == 0);
+    release_json_tape(tape);
+
+    root = create_json_root();
+    root->max_depth = 100001;
+    assert(json_deserialize(root, deep) == JSON_SUCCEED);
+    out->len = 0;
+    assert(json_serialize(root, out) == JSON_SUCCEED);
+    assert(out->len == deep->len && memcmp(out->data, deep->data, deep->len) == 0);
+    out->len = 0;
+    assert(json_snapshot_write(root, out) == JSON_SUCCEED);
+    struct json_snapshot *snap = json_snapshot_from_memory(out->data, out->len);
+    assert(json_view_valid(json_snapshot_find(snap, "a>[0]>[0]", 0)));
+    json_snapshot_close(snap);
+
+    int (*encode[])(struct json_root *, struct varstr *) = { json_msgpack_encode, json_cbor_encode };
+    int (*decode[])(struct json_root *, struct varstr *, int) = { json_msgpack_decode, json_cbor_decode };
+    for(f = 0; f < 2; f++) {
+        struct json_root *copy = create_json_root();
+        struct varstr *text = create_varstr();
+        out->len = 0;
+        assert(encode[f](root, out) == JSON_SUCCEED);
+        assert(decode[f](copy, out, 0) == JSON_FAILURE);
+        release_json_root(copy);
+        copy = create_json_root();
+        copy->max_depth = 100001;
+        assert(decode[f](copy, out, 0) == JSON_SUCCEED);
+        assert(json_serialize(copy, text) == JSON_SUCCEED);
+        assert(text->len == deep->len && memcmp(text->data, deep->data, deep->len) == 0);
+        release_varstr(text);
+        release_json_root(copy);
+    }
+    release_json_root(root);
+
+    release_varstr(out);
+    release_varstr(src);
+    release_varstr(deep);
+}
+
 int main(int argc, char **argv)
 {
     varstr_test();
+    scan_test();
     json_test();
+    document_test();
+    zero_copy_test();
+    structural_test();
+    push_test();
+    sax_test();
+    number_test();
+    format_test();
+    index_test();
+    path_test();
+    array_test();
+    lazy_test();
+    file_test();
+    ndjson_test();
+    parallel_test();
+    serialize_test();
+    binary_test();
+    snapshot_test();
+    tape_test();
+    keys_test();
+    reset_test();
+    allocator_test();
+    stats_test();
+    depth_test();
 
     return 0;
 }
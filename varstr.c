@@ -2,10 +2,19 @@
 #include <string.h>
 #include <stdlib.h>
 #include "varstr.h"
+#include "alloc.h"
+#include "stats.h"
+
+#define VARSTR_MIN_CAP 64
 
 struct varstr *create_varstr()
 {
-    struct varstr *str = (struct varstr *)malloc(sizeof(*str));
+    return create_varstr_allocator(NULL);
+}
+
+struct varstr *create_varstr_allocator(const struct json_allocator *allocator)
+{
+    struct varstr *str = (struct varstr *)json_allocator_alloc(allocator, sizeof(*str));
     if(str == NULL) {
         return NULL;
     }
@@ -13,28 +22,57 @@ struct varstr *create_varstr()
     str->data = NULL;
     str->cap = 0;
     str->len = 0;
+    str->allocator = allocator;
 
     return str;
 }
 
-int expand_varstr(struct varstr *str, int len)
+static int expand_varstr(struct varstr *str, size_t len)
 {
-    int expand_size = 2 * len;
-    char *new_space = (char *)malloc(str->cap + expand_size);
+    size_t need = str->len + len + 1;
+    if(need < str->len) {
+        return 0;
+    }
+
+    size_t cap = str->cap < VARSTR_MIN_CAP ? VARSTR_MIN_CAP : str->cap;
+    while(cap < need) {
+        if(cap > (size_t)-1 / 2) {
+            cap = need;
+            break;
+        }
+        cap *= 2;
+    }
+
+    char *new_space = (char *)json_allocator_realloc(str->allocator, str->data, cap);
     if(new_space == NULL) {
         return 0;
     }
-    memset(new_space, 0, str->cap + expand_size);
-    strncpy(new_space, str->data, str->len);
-    free(str->data);
 
     str->data = new_space;
-    str->cap += expand_size;
+    str->cap = cap;
+    JSON_STAT_ADD(varstr_grows, 1);
 
     return 1;
 }
 
-int append_varstr(struct varstr *str, char *data, int len)
+int reserve_varstr(struct varstr *str, size_t len)
+{
+    if(str == NULL) {
+        return 0;
+    }
+
+    if(str->cap - str->len <= len) {
+        int res = expand_varstr(str, len);
+        if(res == 0) {
+            return 0;
+        }
+        str->data[str->len] = '\0';
+    }
+
+    return 1;
+}
+
+int append_varstr(struct varstr *str, const char *data, size_t len)
 {
     if(str == NULL || data == NULL) {
         return 0;
@@ -47,8 +85,9 @@ int append_varstr(struct varstr *str, char *data, int len)
         }
     }
 
-    strncpy(str->data + str->len, data, len);
+    memcpy(str->data + str->len, data, len);
     str->len += len;
+    str->data[str->len] = '\0';
 
     return 1;
 }
@@ -59,18 +98,22 @@ struct varstr *dup_varstr(struct varstr *src)
         return NULL;
     }
 
-    struct varstr *dst = create_varstr();
+    struct varstr *dst = create_varstr_allocator(src->allocator);
     if(dst == NULL) {
         return NULL;
     }
 
-    dst->data = (char *)malloc(src->cap);
+    if(src->data == NULL) {
+        return dst;
+    }
+
+    dst->data = (char *)json_allocator_alloc(dst->allocator, src->cap);
     if(dst->data == NULL) {
-        free(dst);
+        json_allocator_free(dst->allocator, dst);
         return NULL;
     }
 
-    strncpy(dst->data, src->data, src->len);
+    memcpy(dst->data, src->data, src->len + 1);
     dst->cap = src->cap;
     dst->len = src->len;
 
@@ -81,11 +124,11 @@ int release_varstr(struct varstr *str)
 {
     if(str != NULL) {
         if(str->data != NULL) {
-            free(str->data);
+            json_allocator_free(str->allocator, str->data);
             str->data = NULL;
         }
 
-        free(str);
+        json_allocator_free(str->allocator, str);
         return 1;
     }
 
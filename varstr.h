@@ -1,15 +1,49 @@
 #ifndef _VARSTR_H_
 #define _VARSTR_H_
 
+#include <stddef.h>
+#include <string.h>
+#include "alloc.h"
+
 typedef struct varstr {
     char *data;
-    int cap;
-    int len;
+    size_t cap;
+    size_t len;
+    /* where the string and its buffer come from; NULL means the global allocator */
+    const struct json_allocator *allocator;
 }varstr;
 
 struct varstr *create_varstr();
-int append_varstr(struct varstr *str, char *data, int len);
+struct varstr *create_varstr_allocator(const struct json_allocator *allocator);
+int reserve_varstr(struct varstr *str, size_t len);
+int append_varstr(struct varstr *str, const char *data, size_t len);
 struct varstr *dup_varstr(struct varstr *src);
 int release_varstr(struct varstr *str);
 
+/* the serializer mostly emits single characters and short literals */
+static inline int append_varstr_char(struct varstr *str, char c)
+{
+    if(str->cap - str->len > 1) {
+        str->data[str->len++] = c;
+        str->data[str->len] = '\0';
+        return 1;
+    }
+
+    return append_varstr(str, &c, 1);
+}
+
+static inline int append_varstr_short(struct varstr *str, const char *data, size_t len)
+{
+    if(str->cap - str->len > len) {
+        memcpy(str->data + str->len, data, len);
+        str->len += len;
+        str->data[str->len] = '\0';
+        return 1;
+    }
+
+    return append_varstr(str, data, len);
+}
+
+#define append_varstr_literal(str, literal) append_varstr_short((str), (literal), sizeof(literal) - 1)
+
 #endif